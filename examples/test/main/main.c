@@ -10,6 +10,7 @@ void app_main(void) {
     print_banner("Running all the registered tests");
     UNITY_BEGIN();
     // unity_run_tests_by_tag("lut", false);
+    // unity_run_tests_by_tag("benchmark", false);
     unity_run_all_tests();
     UNITY_END();
 }
@@ -48,6 +48,8 @@ parser.add_argument("name", action="store", help="name of the font.")
 parser.add_argument("size", type=int, help="font size to use.")
 parser.add_argument("fontstack", action="store", nargs='+', help="list of font files, ordered by descending priority. This is not actually implemented please just use one file for now.")
 parser.add_argument("--compress", dest="compress", action="store_true", help="compress glyph bitmaps.")
+parser.add_argument("--rle", dest="rle", action="store_true", help="run-length encode glyph bitmaps. Compresses less than --compress, but is much faster to draw.")
+parser.add_argument("--bpp", dest="bits_per_pixel", type=int, choices=[1, 2, 4], default=4, help="bits per glyph pixel, 4 by default. Fewer bits per pixel save space, but reduce the gray levels of anti-aliasing.")
 parser.add_argument("--additional-intervals", dest="additional_intervals", action="append", help="Additional code point intervals to export as min,max. This argument can be repeated.")
 parser.add_argument("--string", action="store", help="A string of all required characters. intervals are made up of this" )
 
@@ -69,6 +71,10 @@ font_files =  args.fontstack
 face_index = 0
 font_file =  font_files[face_index]
 compress = args.compress
+rle = args.rle
+bits_per_pixel = args.bits_per_pixel
+if compress and rle:
+    sys.exit("--compress and --rle cannot be used together.")
 size = args.size
 font_name = args.name
 
@@ -186,6 +192,62 @@ def load_glyph(code_point):
         print (f"falling back to font {face_index} for {chr(code_point)}.", file=sys.stderr)
     raise ValueError(f"code point {code_point} not found in font stack!")
 
+def pack_pixels(values, width, bits):
+    """
+    Pack pixel values into bytes with `bits` per pixel, the leftmost pixel in the
+    least significant bits. Rows are padded to whole bytes.
+    """
+    per_byte = 8 // bits
+    out = bytearray()
+    for row in range(0, len(values), width):
+        row_values = values[row:row + width]
+        for i in range(0, width, per_byte):
+            byte = 0
+            for j, v in enumerate(row_values[i:i + per_byte]):
+                byte |= v << (j * bits)
+            out.append(byte)
+    return bytes(out)
+
+def rle_encode(values):
+    """
+    Run-length encode 4 bit pixel values in the format decoded by `rle_decode_row()` in font.c.
+    Each token byte holds the kind in the upper two bits and the pixel count minus one:
+    00 for a run of 0, 01 for a run of 15, 10 for literal pixels packed into the following
+    bytes, and 11 for a run of the value in the following byte.
+    """
+    out = bytearray()
+    literal = []
+
+    def flush_literal():
+        while literal:
+            chunk = literal[:64]
+            del literal[:64]
+            out.append(0x80 | (len(chunk) - 1))
+            for i in range(0, len(chunk), 2):
+                high = chunk[i + 1] if i + 1 < len(chunk) else 0
+                out.append(chunk[i] | (high << 4))
+
+    i = 0
+    while i < len(values):
+        value = values[i]
+        count = 1
+        while i + count < len(values) and values[i + count] == value and count < 64:
+            count += 1
+        # short runs are cheaper as part of a literal
+        if (value in (0, 15) and count >= 2) or count >= 4:
+            flush_literal()
+            if value == 0:
+                out.append(count - 1)
+            elif value == 15:
+                out.append(0x40 | (count - 1))
+            else:
+                out += bytes([0xC0 | (count - 1), value])
+        else:
+            literal.extend(values[i:i + count])
+        i += count
+    flush_literal()
+    return bytes(out)
+
 for i_start, i_end in intervals:
     for code_point in range(i_start, i_end + 1):
         # handle missing characters in font file
@@ -194,27 +256,17 @@ for i_start, i_end in intervals:
             continue
         face = load_glyph(code_point)
         bitmap = face.glyph.bitmap
-        pixels = []
-        px = 0
-        for i, v in enumerate(bitmap.buffer):
-            y = i / bitmap.width
-            x = i % bitmap.width
-            if x % 2 == 0:
-                px = (v >> 4)
-            else:
-                px = px | (v & 0xF0)
-                pixels.append(px);
-                px = 0
-            # eol
-            if x == bitmap.width - 1 and bitmap.width % 2 > 0:
-                pixels.append(px)
-                px = 0
-
-        packed = bytes(pixels);
+        # quantize to the available gray levels
+        levels = (1 << bits_per_pixel) - 1
+        values = [((v >> 4) * levels + 7) // 15 for v in bitmap.buffer]
+
+        packed = pack_pixels(values, bitmap.width, bits_per_pixel)
         total_packed += len(packed)
         compressed = packed
         if compress:
             compressed = zlib.compress(packed)
+        elif rle:
+            compressed = rle_encode([v * 15 // levels for v in values])
 
         glyph = GlyphProps(
             width = bitmap.width,
@@ -282,10 +334,12 @@ print(f"    {font_name}_Bitmaps, // (*bitmap) Glyph bitmap pointer, all concaten
 print(f"    {font_name}_Glyphs, // glyphs Glyph array")
 print(f"    {font_name}_Intervals, // intervals Valid unicode intervals for this font")
 print(f"    {len(intervals)},   // interval_count Number of unicode intervals.intervals")
-print(f"    {1 if compress else 0}, // compressed Does this font use compressed glyph bitmaps?")
+print(f"    {1 if compress else 2 if rle else 0}, // compressed Compression of glyph bitmaps, 0: none, 1: zlib, 2: run-length encoded")
 print(f"    {norm_ceil(f_height)}, // advance_y Newline distance (y axis)")
 print(f"    {norm_ceil(ascender)}, // ascender Maximal height of a glyph above the base line")
 print(f"    {norm_floor(descender)}, // descender Maximal height of a glyph below the base line")
+# run-length encoded glyphs are always decoded to 4 bit pixels
+print(f"    {4 if rle else bits_per_pixel}, // bits_per_pixel Bits per glyph pixel")
 print("};")
 print("/*")
 print("Included intervals")
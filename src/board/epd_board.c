@@ -4,6 +4,7 @@
 #include <stddef.h>
 
 #include "epdiy.h"
+#include "output_common/render_method.h"
 
 /**
  * The board's display control pin state.
@@ -16,9 +17,11 @@ static epd_ctrl_state_t ctrl_state;
 const EpdBoardDefinition* epd_board = NULL;
 
 void IRAM_ATTR epd_busy_delay(uint32_t cycles) {
+#ifndef RENDER_METHOD_HOST
     volatile unsigned long counts = XTHAL_GET_CCOUNT() + cycles;
     while (XTHAL_GET_CCOUNT() < counts) {
     };
+#endif
 }
 
 void epd_set_board(const EpdBoardDefinition* board_definition) {
@@ -0,0 +1,39 @@
+/**
+ * @file epd_board_host.c
+ * @brief Board definition without any display hardware.
+ *
+ * Used together with the host render method (ESP-IDF linux target),
+ * where display output is recorded to memory instead of a bus.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#include "epd_board.h"
+#include "epdiy.h"
+
+static void epd_board_init(uint32_t epd_row_width, const EpdInitConfig* init_config) {}
+
+static void epd_board_set_ctrl(epd_ctrl_state_t* state, const epd_ctrl_state_t* const mask) {}
+
+static void epd_board_poweron(epd_ctrl_state_t* state) {}
+
+static void epd_board_poweroff(epd_ctrl_state_t* state) {}
+
+static float epd_board_ambient_temperature() {
+    return 21.0;
+}
+
+const EpdBoardDefinition epd_board_host = {
+    .init = epd_board_init,
+    .deinit = NULL,
+    .set_ctrl = epd_board_set_ctrl,
+    .poweron = epd_board_poweron,
+    .poweroff = epd_board_poweroff,
+
+    .get_temperature = epd_board_ambient_temperature,
+    .set_vcom = NULL,
+
+    .gpio_set_direction = NULL,
+    .gpio_read = NULL,
+    .gpio_write = NULL,
+};
@@ -9,7 +9,9 @@
 #include <stdint.h>
 
 #include <esp_err.h>
+#if __has_include(<xtensa/core-macros.h>)
 #include <xtensa/core-macros.h>
+#endif
 
 #include "epd_init_config.h"
 
@@ -129,6 +131,8 @@ extern const EpdBoardDefinition epd_board_v6;
 extern const EpdBoardDefinition epd_board_v7;
 extern const EpdBoardDefinition epd_board_v7_raw;
 extern const EpdBoardDefinition epd_board_v7_103;  // Experimental board (not ready yet)
+/// Board without display hardware, for use with the host render method.
+extern const EpdBoardDefinition epd_board_host;
 
 /**
  * Helper for short, precise delays.
@@ -69,6 +69,33 @@ extern "C" {
 
 #define EPD_BUILTIN_WAVEFORM NULL
 
+/// Options for `epd_hl_init_with_options()`.
+enum EpdHlOptions {
+    /// Use the default options.
+    EPD_HL_OPTIONS_DEFAULT = 0,
+    /// Don't allocate a difference image, but interlace the framebuffers
+    /// line by line while drawing, see `epd_draw_difference()`.
+    /// This saves a buffer of twice the framebuffer size and the memory traffic
+    /// for writing it, at the cost of interlacing lines in every frame.
+    EPD_HL_FUSED_DIFFERENCE = 1,
+    /// Record which columns of each framebuffer row are changed by the drawing
+    /// functions of `epdiy.h`, so that updates only compare and drive these areas.
+    /// Changes written to the framebuffer by other means must be announced
+    /// with `epd_hl_mark_changed()`, or they may not be drawn.
+    EPD_HL_TRACK_CHANGES = 2,
+};
+
+/// Maximum number of updates waiting in the queue of `epd_hl_post_update()`.
+#define EPD_HL_MAX_PENDING_UPDATES 8
+
+/// An update waiting for the pixels it changes to be no longer driven.
+typedef struct {
+    /// Area to update, in display coordinates.
+    EpdRect area;
+    enum EpdDrawMode mode;
+    int temperature;
+} EpdHlPendingUpdate;
+
 /// Holds the internal state of the high-level API.
 typedef struct {
     /// The "front" framebuffer object.
@@ -76,6 +103,7 @@ typedef struct {
     /// The "back" framebuffer object.
     uint8_t* back_fb;
     /// Buffer for holding the interlaced difference image.
+    /// NULL with `EPD_HL_FUSED_DIFFERENCE`.
     uint8_t* difference_fb;
     /// Tainted lines based on the last difference calculation.
     bool* dirty_lines;
@@ -83,8 +111,18 @@ typedef struct {
     uint8_t* dirty_columns;
     /// The waveform information to use.
     const EpdWaveform* waveform;
-    /// If true, the framebuffer is mirrored horizontally.
+    /// If true, the framebuffer is mirrored horizontally on the display.
+    /// The framebuffers themselves are never mirrored.
     bool mirror_x;
+    /// Changed columns of the front framebuffer per row, not yet drawn.
+    /// NULL without `EPD_HL_TRACK_CHANGES`.
+    EpdRowChanges* row_changes;
+    /// Posted updates waiting to be started, in the order they were posted.
+    EpdHlPendingUpdate pending[EPD_HL_MAX_PENDING_UPDATES];
+    int num_pending;
+    /// Whether updates were posted since the last `epd_hl_wait_updates()`, and their errors.
+    bool posted;
+    enum EpdDrawError post_error;
 } EpdiyHighlevelState;
 
 /**
@@ -99,6 +137,17 @@ typedef struct {
  */
 EpdiyHighlevelState epd_hl_init(const EpdWaveform* waveform);
 
+/**
+ * Like `epd_hl_init()`, with additional options.
+ *
+ * @param waveform: The waveform to use for updates.
+ * @param options: A combination of `EpdHlOptions`.
+ * @returns An initialized state object.
+ */
+EpdiyHighlevelState epd_hl_init_with_options(
+    const EpdWaveform* waveform, enum EpdHlOptions options
+);
+
 /// Get a reference to the front framebuffer.
 /// Use this to draw on the framebuffer before updating the screen with `epd_hl_update_screen()`.
 uint8_t* epd_hl_get_framebuffer(EpdiyHighlevelState* state);
@@ -136,6 +185,48 @@ enum EpdDrawError epd_hl_update_area(
     EpdiyHighlevelState* state, enum EpdDrawMode mode, int temperature, EpdRect area
 );
 
+/**
+ * Post an update of an area of the screen to match the content of the front framebuffer,
+ * without waiting for it to be drawn.
+ *
+ * If no update in progress drives the changed pixels, the update starts with the next frame
+ * of the display update in progress, see `epd_draw_pipelined()`. This way, e.g. new pen strokes
+ * appear within a frame time instead of after the complete waveform of earlier strokes.
+ * Otherwise, the update is queued until `epd_hl_process_updates()` finds its pixels
+ * no longer driven. Updates of the same pixels are always drawn in the order they were posted.
+ *
+ * Changes to the front framebuffer outside of areas posted are not drawn.
+ * With `EPD_HL_FUSED_DIFFERENCE`, the update is drawn like with `epd_hl_update_area()`.
+ * Power to the display must stay enabled until `epd_hl_wait_updates()` returns.
+ *
+ * @param state: A reference to the `EpdiyHighlevelState` object used.
+ * @param mode: See `epd_hl_update_screen()`.
+ * @param temperature: Environmental temperature of the display in °C.
+ * @param area: Area of the screen to update.
+ * @returns `EPD_DRAW_SUCCESS` if the update was started or queued, error flags otherwise.
+ */
+enum EpdDrawError epd_hl_post_update(
+    EpdiyHighlevelState* state, enum EpdDrawMode mode, int temperature, EpdRect area
+);
+
+/**
+ * Start the queued updates whose pixels are no longer driven, without waiting.
+ * Call this regularly while updates are queued, e.g. from the UI loop.
+ *
+ * @param state: A reference to the `EpdiyHighlevelState` object used.
+ * @returns The number of updates still queued.
+ */
+int epd_hl_process_updates(EpdiyHighlevelState* state);
+
+/**
+ * Draw all queued updates and wait for all updates to finish.
+ *
+ * @param state: A reference to the `EpdiyHighlevelState` object used.
+ * @returns `EPD_DRAW_SUCCESS` on sucess, a combination of error flags
+ *      of all updates posted since the last call otherwise.
+ */
+enum EpdDrawError epd_hl_wait_updates(EpdiyHighlevelState* state);
+
 /**
  * Reset the front framebuffer to a white state.
  *
@@ -143,6 +234,16 @@ enum EpdDrawError epd_hl_update_area(
  */
 void epd_hl_set_all_white(EpdiyHighlevelState* state);
 
+/**
+ * Mark an area of the front framebuffer as changed, after writing to it
+ * without the drawing functions of `epdiy.h`.
+ * Only needed with `EPD_HL_TRACK_CHANGES`.
+ *
+ * @param state: A reference to the `EpdiyHighlevelState` object used.
+ * @param area: The changed area, in the same coordinates as for `epd_hl_update_area()`.
+ */
+void epd_hl_mark_changed(EpdiyHighlevelState* state, EpdRect area);
+
 /**
  * Bring the display to a fully white state and get rid of any
  * remaining artifacts.
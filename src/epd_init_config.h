@@ -1,6 +1,11 @@
 #pragma once
 
+#if __has_include(<driver/i2c_master.h>)
 #include <driver/i2c_master.h>
+#else
+// no I2C driver on the host target
+typedef void* i2c_master_bus_handle_t;
+#endif
 
 typedef struct EpdI2cConfig {
     i2c_master_bus_handle_t bus_handle;
@@ -8,4 +13,8 @@ typedef struct EpdI2cConfig {
 
 typedef struct EpdInitConfig {
     const EpdI2cConfig* i2c;
+    /// Number of render threads preparing display lines, 0 for the default of 2.
+    /// Use 1 on single-core chips. The line queue is enlarged to 64 lines if needed.
+    /// The I2S render method needs at least 2, one of which outputs the lines.
+    int render_threads;
 } EpdInitConfig;
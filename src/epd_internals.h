@@ -63,7 +63,7 @@ typedef struct {
     uint16_t advance_x;        ///< Distance to advance cursor (x axis)
     int16_t left;              ///< X dist from cursor pos to UL corner
     int16_t top;               ///< Y dist from cursor pos to UL corner
-    uint32_t compressed_size;  ///< Size of the zlib-compressed font data.
+    uint32_t compressed_size;  ///< Size of the compressed font data.
     uint32_t data_offset;      ///< Pointer into EpdFont->bitmap
 } EpdGlyph;
 
@@ -74,16 +74,28 @@ typedef struct {
     uint32_t offset;  ///< Index of the first code point into the glyph array
 } EpdUnicodeInterval;
 
+/// Compression schemes of glyph bitmaps
+enum EpdFontCompression {
+    /// Glyph bitmaps are stored as packed 4 bit pixels.
+    EPD_FONT_UNCOMPRESSED = 0,
+    /// Glyph bitmaps are zlib-compressed.
+    EPD_FONT_COMPRESSED_ZLIB = 1,
+    /// Glyph bitmaps are run-length encoded 4 bit pixels, see `font.c`.
+    /// The bits per pixel of the font do not apply.
+    EPD_FONT_COMPRESSED_RLE = 2,
+};
+
 /// Data stored for FONT AS A WHOLE
 typedef struct {
     const uint8_t* bitmap;                ///< Glyph bitmaps, concatenated
     const EpdGlyph* glyph;                ///< Glyph array
     const EpdUnicodeInterval* intervals;  ///< Valid unicode intervals for this font
     uint32_t interval_count;              ///< Number of unicode intervals.
-    bool compressed;                      ///< Does this font use compressed glyph bitmaps?
+    uint8_t compressed;                   ///< The `EpdFontCompression` of glyph bitmaps.
     uint16_t advance_y;                   ///< Newline distance (y axis)
     int ascender;                         ///< Maximal height of a glyph above the base line
     int descender;                        ///< Maximal height of a glyph below the base line
+    uint8_t bits_per_pixel;               ///< Bits per glyph pixel: 1, 2 or 4, 0 means 4.
 } EpdFont;
 
 #endif  // EPD_INTERNALS_H
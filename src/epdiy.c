@@ -8,6 +8,7 @@
 #include <esp_heap_caps.h>
 #include <esp_log.h>
 #include <esp_types.h>
+#include <string.h>
 
 // Simple x and y coordinate
 typedef struct {
@@ -20,6 +21,10 @@ static const EpdDisplay_t* display = NULL;
 // Display rotation. Can be updated using epd_set_rotation(enum EpdRotation)
 static enum EpdRotation display_rotation = EPD_ROT_LANDSCAPE;
 
+// Framebuffer whose changed columns per row are recorded in `tracked_rows`.
+static const uint8_t* tracked_framebuffer = NULL;
+static EpdRowChanges* tracked_rows = NULL;
+
 #ifndef _swap_int
 #define _swap_int(a, b) \
     {                   \
@@ -29,6 +34,29 @@ static enum EpdRotation display_rotation = EPD_ROT_LANDSCAPE;
     }
 #endif
 
+void epd_track_row_changes(const uint8_t* framebuffer, EpdRowChanges* rows) {
+    tracked_framebuffer = rows != NULL ? framebuffer : NULL;
+    tracked_rows = rows;
+}
+
+void epd_mark_row_changes(const uint8_t* framebuffer, int y, int x_start, int x_end) {
+    if (framebuffer != tracked_framebuffer || framebuffer == NULL) {
+        return;
+    }
+    EpdRowChanges* row = &tracked_rows[y];
+    if (row->start >= row->end) {
+        row->start = x_start;
+        row->end = x_end;
+        return;
+    }
+    if (x_start < row->start) {
+        row->start = x_start;
+    }
+    if (x_end > row->end) {
+        row->end = x_end;
+    }
+}
+
 EpdRect epd_full_screen() {
     EpdRect area = { .x = 0, .y = 0, .width = epd_width(), .height = epd_height() };
     return area;
@@ -38,20 +66,88 @@ void epd_clear() {
     epd_clear_area(epd_full_screen());
 }
 
-void epd_draw_hline(int x, int y, int length, uint8_t color, uint8_t* framebuffer) {
-    for (int i = 0; i < length; i++) {
-        int xx = x + i;
-        epd_draw_pixel(xx, y, color, framebuffer);
+/**
+ * Convert a rect in coordinates rotated by `rotation`
+ * to coordinates of a buffer of `width` x `height` pixels.
+ */
+static EpdRect rotate_rect_in(EpdRect rect, int width, int height, enum EpdRotation rotation) {
+    EpdRect rotated = rect;
+    switch (rotation) {
+        case EPD_ROT_LANDSCAPE:
+            break;
+        case EPD_ROT_PORTRAIT:
+            rotated.x = width - rect.y - rect.height;
+            rotated.y = rect.x;
+            rotated.width = rect.height;
+            rotated.height = rect.width;
+            break;
+        case EPD_ROT_INVERTED_LANDSCAPE:
+            rotated.x = width - rect.x - rect.width;
+            rotated.y = height - rect.y - rect.height;
+            break;
+        case EPD_ROT_INVERTED_PORTRAIT:
+            rotated.x = rect.y;
+            rotated.y = height - rect.x - rect.width;
+            rotated.width = rect.height;
+            rotated.height = rect.width;
+            break;
     }
+    return rotated;
 }
 
-void epd_draw_vline(int x, int y, int length, uint8_t color, uint8_t* framebuffer) {
-    for (int i = 0; i < length; i++) {
-        int yy = y + i;
-        epd_draw_pixel(x, yy, color, framebuffer);
+/**
+ * Convert a rectangle in the current rotation to framebuffer coordinates,
+ * like `_rotate()` does for pixels.
+ */
+static EpdRect rotate_rect(EpdRect rect) {
+    return rotate_rect_in(rect, epd_width(), epd_height(), display_rotation);
+}
+
+/**
+ * Set the pixels `x_start` to `x_end` (exclusive) of framebuffer row `y` to `color`.
+ * The pixels must lie within the framebuffer.
+ */
+static void fill_span(uint8_t* framebuffer, int y, int x_start, int x_end, uint8_t color) {
+    uint8_t* row = framebuffer + y * epd_width() / 2;
+    int x = x_start;
+    if (x % 2 && x < x_end) {
+        row[x / 2] = (row[x / 2] & 0x0F) | (color & 0xF0);
+        x++;
+    }
+    int pairs_end = x + (x_end - x) / 2 * 2;
+    memset(row + x / 2, (color & 0xF0) | (color >> 4), (pairs_end - x) / 2);
+    if (pairs_end < x_end) {
+        row[pairs_end / 2] = (row[pairs_end / 2] & 0xF0) | (color >> 4);
+    }
+    epd_mark_row_changes(framebuffer, y, x_start, x_end);
+}
+
+/**
+ * Fill a rectangle in framebuffer coordinates, clipped to the framebuffer.
+ */
+static void fill_framebuffer_rect(EpdRect rect, uint8_t color, uint8_t* framebuffer) {
+    int x_start = rect.x < 0 ? 0 : rect.x;
+    int x_end = rect.x + rect.width > epd_width() ? epd_width() : rect.x + rect.width;
+    int y_start = rect.y < 0 ? 0 : rect.y;
+    int y_end = rect.y + rect.height > epd_height() ? epd_height() : rect.y + rect.height;
+    if (x_start >= x_end) {
+        return;
+    }
+    for (int y = y_start; y < y_end; y++) {
+        fill_span(framebuffer, y, x_start, x_end, color);
     }
 }
 
+void epd_draw_hline(int x, int y, int length, uint8_t color, uint8_t* framebuffer) {
+    EpdRect line = { .x = x, .y = y, .width = length, .height = 1 };
+    fill_framebuffer_rect(rotate_rect(line), color, framebuffer);
+}
+
+void epd_draw_vline(int x, int y, int length, uint8_t color, uint8_t* framebuffer) {
+    EpdRect line = { .x = x, .y = y, .width = 1, .height = length };
+    fill_framebuffer_rect(rotate_rect(line), color, framebuffer);
+}
+
 Coord_xy _rotate(uint16_t x, uint16_t y) {
     switch (display_rotation) {
         case EPD_ROT_LANDSCAPE:
@@ -92,6 +188,7 @@ void epd_draw_pixel(int x, int y, uint8_t color, uint8_t* framebuffer) {
     } else {
         *buf_ptr = (*buf_ptr & 0xF0) | (color >> 4);
     }
+    epd_mark_row_changes(framebuffer, y, x, x + 1);
 }
 
 void epd_draw_circle(int x0, int y0, int r, uint8_t color, uint8_t* framebuffer) {
@@ -185,13 +282,7 @@ void epd_draw_rect(EpdRect rect, uint8_t color, uint8_t* framebuffer) {
 }
 
 void epd_fill_rect(EpdRect rect, uint8_t color, uint8_t* framebuffer) {
-    int x = rect.x;
-    int y = rect.y;
-    int w = rect.width;
-    int h = rect.height;
-    for (int i = y; i < y + h; i++) {
-        epd_draw_hline(x, i, w, color, framebuffer);
-    }
+    fill_framebuffer_rect(rotate_rect(rect), color, framebuffer);
 }
 
 static void epd_write_line(int x0, int y0, int x1, int y1, uint8_t color, uint8_t* framebuffer) {
@@ -337,33 +428,60 @@ void epd_fill_triangle(
     }
 }
 
+/**
+ * Copy `len` 4bpp pixels from `src`, starting at pixel `src_x`,
+ * to `dst`, starting at pixel `dst_x`.
+ */
+static void copy_pixels(uint8_t* dst, int dst_x, const uint8_t* src, int src_x, int len) {
+    int end = dst_x + len;
+    if (dst_x % 2 && dst_x < end) {
+        uint8_t val = src_x % 2 ? src[src_x / 2] >> 4 : src[src_x / 2] & 0x0F;
+        dst[dst_x / 2] = (dst[dst_x / 2] & 0x0F) | (val << 4);
+        dst_x++;
+        src_x++;
+    }
+    int pairs = (end - dst_x) / 2;
+    if (src_x % 2 == 0) {
+        memcpy(dst + dst_x / 2, src + src_x / 2, pairs);
+    } else {
+        // every destination byte combines the nibbles of two source bytes
+        const uint8_t* s = src + src_x / 2;
+        uint8_t* d = dst + dst_x / 2;
+        for (int i = 0; i < pairs; i++) {
+            d[i] = (s[i] >> 4) | (s[i + 1] << 4);
+        }
+    }
+    dst_x += 2 * pairs;
+    src_x += 2 * pairs;
+    if (dst_x < end) {
+        uint8_t val = src_x % 2 ? src[src_x / 2] >> 4 : src[src_x / 2] & 0x0F;
+        dst[dst_x / 2] = (dst[dst_x / 2] & 0xF0) | val;
+    }
+}
+
 void epd_copy_to_framebuffer(EpdRect image_area, const uint8_t* image_data, uint8_t* framebuffer) {
     assert(framebuffer != NULL);
 
-    for (uint32_t i = 0; i < image_area.width * image_area.height; i++) {
-        uint32_t value_index = i;
-        // for images of uneven width,
-        // consume an additional nibble per row.
-        if (image_area.width % 2) {
-            value_index += i / image_area.width;
-        }
-        uint8_t val = (value_index % 2) ? (image_data[value_index / 2] & 0xF0) >> 4
-                                        : image_data[value_index / 2] & 0x0F;
+    // images of uneven width have an additional nibble per row.
+    int stride = (image_area.width + 1) / 2;
+    int x_start = image_area.x < 0 ? 0 : image_area.x;
+    int x_end = image_area.x + image_area.width;
+    x_end = x_end > epd_width() ? epd_width() : x_end;
+    int y_end = image_area.y + image_area.height;
+    y_end = y_end > epd_height() ? epd_height() : y_end;
+    if (x_start >= x_end) {
+        return;
+    }
 
-        int xx = image_area.x + i % image_area.width;
-        if (xx < 0 || xx >= epd_width()) {
-            continue;
-        }
-        int yy = image_area.y + i / image_area.width;
-        if (yy < 0 || yy >= epd_height()) {
-            continue;
-        }
-        uint8_t* buf_ptr = &framebuffer[yy * epd_width() / 2 + xx / 2];
-        if (xx % 2) {
-            *buf_ptr = (*buf_ptr & 0x0F) | (val << 4);
-        } else {
-            *buf_ptr = (*buf_ptr & 0xF0) | val;
-        }
+    for (int y = image_area.y < 0 ? 0 : image_area.y; y < y_end; y++) {
+        copy_pixels(
+            framebuffer + y * epd_width() / 2,
+            x_start,
+            image_data + (y - image_area.y) * stride,
+            x_start - image_area.x,
+            x_end - x_start
+        );
+        epd_mark_row_changes(framebuffer, y, x_start, x_end);
     }
 }
 
@@ -438,42 +556,338 @@ uint8_t epd_get_pixel(int x, int y, int fb_width, int fb_height, const uint8_t*
     return buf_val << 4;
 }
 
-static void draw_rotated_transparent_image(
-    EpdRect image_area,
-    const uint8_t* image_buffer,
-    uint8_t* framebuffer,
-    uint8_t* transparent_color
+/// Number of pixels `epd_blit()` reads from the image at once.
+#define BLIT_CHUNK_PIXELS 64
+/// Value of image pixels that `epd_blit()` does not draw.
+#define BLIT_SKIP 0x10
+
+/// A 4 bit per pixel buffer drawn to by `epd_blit()` or `epd_blit_to_image()`.
+typedef struct {
+    uint8_t* data;
+    int width;
+    int height;
+    /// Rotation of the drawing coordinates.
+    enum EpdRotation rotation;
+} BlitTarget;
+
+static int image_stride(const EpdImage* image) {
+    if (image->stride > 0) {
+        return image->stride;
+    }
+    if (image->format == EPD_IMAGE_1BPP) {
+        return (image->width + 7) / 8;
+    }
+    if (image->format == EPD_IMAGE_2BPP) {
+        return (image->width + 3) / 4;
+    }
+    return (image->width + 1) / 2;
+}
+
+/**
+ * Read `n` pixels of an image as 4 bit values to `out`,
+ * starting at `(x, y)` and advancing by `(dx, dy)`.
+ * Bits of 1bpp images are read as `fg` or `bg`.
+ */
+static void read_image_pixels(
+    const EpdImage* image,
+    int x,
+    int y,
+    int dx,
+    int dy,
+    int n,
+    uint8_t fg,
+    uint8_t bg,
+    uint8_t* out
+) {
+    int stride = image_stride(image);
+    const uint8_t* row = image->data + y * stride;
+    int row_step = dy * stride;
+    if (image->format == EPD_IMAGE_1BPP) {
+        for (int i = 0; i < n; i++, x += dx, row += row_step) {
+            out[i] = (row[x / 8] >> (x % 8)) & 1 ? fg : bg;
+        }
+    } else if (image->format == EPD_IMAGE_2BPP) {
+        static const uint8_t levels[4] = { 0x0, 0x5, 0xA, 0xF };
+        for (int i = 0; i < n; i++, x += dx, row += row_step) {
+            out[i] = levels[(row[x / 4] >> (x % 4 * 2)) & 0x03];
+        }
+    } else {
+        for (int i = 0; i < n; i++, x += dx, row += row_step) {
+            out[i] = (row[x / 2] >> (x % 2 * 4)) & 0x0F;
+        }
+    }
+}
+
+/**
+ * Write `n` 4 bit values to framebuffer row `row`, starting at pixel `x`.
+ */
+static void write_row_pixels(uint8_t* row, int x, const uint8_t* values, int n) {
+    int i = 0;
+    if (x % 2 && n > 0) {
+        row[x / 2] = (row[x / 2] & 0x0F) | (values[0] << 4);
+        i = 1;
+    }
+    uint8_t* dst = row + (x + i) / 2;
+    for (; i + 1 < n; i += 2) {
+        *dst++ = values[i] | (values[i + 1] << 4);
+    }
+    if (i < n) {
+        *dst = (*dst & 0xF0) | values[i];
+    }
+}
+
+/**
+ * Write `n` 4 bit values to framebuffer row `row`, starting at pixel `x`,
+ * skipping values of `BLIT_SKIP`.
+ */
+static void write_row_pixels_keyed(uint8_t* row, int x, const uint8_t* values, int n) {
+    int i = 0;
+    if (x % 2 && n > 0) {
+        if (values[0] != BLIT_SKIP) {
+            row[x / 2] = (row[x / 2] & 0x0F) | (values[0] << 4);
+        }
+        i = 1;
+    }
+    uint8_t* dst = row + (x + i) / 2;
+    for (; i + 1 < n; i += 2, dst++) {
+        bool lower = values[i] != BLIT_SKIP;
+        bool upper = values[i + 1] != BLIT_SKIP;
+        if (lower && upper) {
+            *dst = values[i] | (values[i + 1] << 4);
+        } else if (lower) {
+            *dst = (*dst & 0xF0) | values[i];
+        } else if (upper) {
+            *dst = (*dst & 0x0F) | (values[i + 1] << 4);
+        }
+    }
+    if (i < n && values[i] != BLIT_SKIP) {
+        *dst = (*dst & 0xF0) | values[i];
+    }
+}
+
+/**
+ * Blend `n` 4 bit values with framebuffer row `row`, starting at pixel `x`,
+ * using the 4 bit opacities in `alpha` and skipping values of `BLIT_SKIP`.
+ */
+static void blend_row_pixels(
+    uint8_t* row, int x, const uint8_t* values, const uint8_t* alpha, int n
+) {
+    for (int i = 0; i < n; i++, x++) {
+        uint8_t v = values[i];
+        if (v == BLIT_SKIP) {
+            continue;
+        }
+        uint8_t* byte = &row[x / 2];
+        int shift = x % 2 * 4;
+        uint8_t a = alpha[i];
+        uint8_t d = (*byte >> shift) & 0x0F;
+        v = (v * a + d * (15 - a) + 7) / 15;
+        *byte = (*byte & (0xF0 >> shift)) | (v << shift);
+    }
+}
+
+static void blit(
+    const EpdImage* image,
+    EpdRect src_rect,
+    int x,
+    int y,
+    const EpdBlitOptions* options,
+    const BlitTarget* target
 ) {
-    uint16_t x_offset = 0;
-    uint16_t y_offset = 0;
-    uint8_t pixel_color;
-    for (uint16_t y = 0; y < image_area.height; y++) {
-        for (uint16_t x = 0; x < image_area.width; x++) {
-            x_offset = image_area.x + x;
-            y_offset = image_area.y + y;
-            if (x_offset >= epd_rotated_display_width())
-                continue;
-            if (y_offset >= epd_rotated_display_height())
-                continue;
-            pixel_color = epd_get_pixel(x, y, image_area.width, image_area.height, image_buffer);
-            if (transparent_color == NULL || pixel_color != (*transparent_color))
-                epd_draw_pixel(x_offset, y_offset, pixel_color, framebuffer);
+    static const EpdBlitOptions default_options = {
+        .fg_color = 0xF0,
+        .bg_color = 0x00,
+    };
+    if (options == NULL) {
+        options = &default_options;
+    }
+
+    // clip the source area to the image
+    if (src_rect.x < 0) {
+        x -= src_rect.x;
+        src_rect.width += src_rect.x;
+        src_rect.x = 0;
+    }
+    if (src_rect.y < 0) {
+        y -= src_rect.y;
+        src_rect.height += src_rect.y;
+        src_rect.y = 0;
+    }
+    if (src_rect.x + src_rect.width > image->width) {
+        src_rect.width = image->width - src_rect.x;
+    }
+    if (src_rect.y + src_rect.height > image->height) {
+        src_rect.height = image->height - src_rect.y;
+    }
+
+    // the drawn area in target coordinates, clipped to the target
+    int width = target->width;
+    int height = target->height;
+    EpdRect area = rotate_rect_in(
+        (EpdRect){ x, y, src_rect.width, src_rect.height }, width, height, target->rotation
+    );
+    int x_start = area.x < 0 ? 0 : area.x;
+    int x_end = area.x + area.width > width ? width : area.x + area.width;
+    int y_start = area.y < 0 ? 0 : area.y;
+    int y_end = area.y + area.height > height ? height : area.y + area.height;
+    if (x_start >= x_end || src_rect.width <= 0 || src_rect.height <= 0) {
+        return;
+    }
+
+    // Image pixel of the target pixel (x_start, fy) is (ix + fy * row_dx, iy + fy * row_dy),
+    // following target rows steps through the image by (dx, dy).
+    int dx = 0, dy = 0, row_dx = 0, row_dy = 0;
+    int ix = 0, iy = 0;
+    switch (target->rotation) {
+        case EPD_ROT_LANDSCAPE:
+            dx = 1;
+            row_dy = 1;
+            ix = x_start - x;
+            iy = -y;
+            break;
+        case EPD_ROT_PORTRAIT:
+            dy = -1;
+            row_dx = 1;
+            ix = -x;
+            iy = width - 1 - x_start - y;
+            break;
+        case EPD_ROT_INVERTED_LANDSCAPE:
+            dx = -1;
+            row_dy = -1;
+            ix = width - 1 - x_start - x;
+            iy = height - 1 - y;
+            break;
+        case EPD_ROT_INVERTED_PORTRAIT:
+            dy = 1;
+            row_dx = -1;
+            ix = height - 1 - x;
+            iy = x_start - y;
+            break;
+    }
+    ix += src_rect.x;
+    iy += src_rect.y;
+
+    // image values are mapped to the colors to draw, or `BLIT_SKIP`
+    bool keyed = options->flags & EPD_BLIT_COLOR_KEY;
+    bool mapped = keyed || options->palette != NULL;
+    uint8_t value_map[16];
+    for (int v = 0; v < 16; v++) {
+        value_map[v] = options->palette != NULL ? options->palette[v] >> 4 : v;
+    }
+    if (keyed) {
+        value_map[options->color_key >> 4] = BLIT_SKIP;
+    }
+    EpdImage alpha_mask = {
+        .data = options->alpha,
+        .width = image->width,
+        .height = image->height,
+        .format = EPD_IMAGE_4BPP,
+    };
+    uint8_t fg = options->fg_color >> 4;
+    uint8_t bg = options->bg_color >> 4;
+    uint8_t values[BLIT_CHUNK_PIXELS];
+    uint8_t alpha[BLIT_CHUNK_PIXELS];
+
+    for (int fy = y_start; fy < y_end; fy++) {
+        uint8_t* row = target->data + fy * ((width + 1) / 2);
+        int row_ix = ix + fy * row_dx;
+        int row_iy = iy + fy * row_dy;
+
+        // unrotated plain copies of 4bpp images are byte-wise copies
+        if (!mapped && options->alpha == NULL && dx == 1 && image->format == EPD_IMAGE_4BPP) {
+            const uint8_t* src = image->data + row_iy * image_stride(image);
+            copy_pixels(row, x_start, src, row_ix, x_end - x_start);
+            epd_mark_row_changes(target->data, fy, x_start, x_end);
+            continue;
+        }
+
+        for (int fx = x_start; fx < x_end; fx += BLIT_CHUNK_PIXELS) {
+            int n = x_end - fx < BLIT_CHUNK_PIXELS ? x_end - fx : BLIT_CHUNK_PIXELS;
+            int cx = row_ix + (fx - x_start) * dx;
+            int cy = row_iy + (fx - x_start) * dy;
+            read_image_pixels(image, cx, cy, dx, dy, n, fg, bg, values);
+            if (mapped) {
+                for (int i = 0; i < n; i++) {
+                    values[i] = value_map[values[i]];
+                }
+            }
+            if (options->alpha != NULL) {
+                read_image_pixels(&alpha_mask, cx, cy, dx, dy, n, 0, 0, alpha);
+                blend_row_pixels(row, fx, values, alpha, n);
+            } else if (keyed) {
+                write_row_pixels_keyed(row, fx, values, n);
+            } else {
+                write_row_pixels(row, fx, values, n);
+            }
         }
+        epd_mark_row_changes(target->data, fy, x_start, x_end);
     }
 }
 
+void epd_blit(
+    const EpdImage* image,
+    EpdRect src_rect,
+    int x,
+    int y,
+    const EpdBlitOptions* options,
+    uint8_t* framebuffer
+) {
+    assert(image != NULL && framebuffer != NULL);
+    BlitTarget target = {
+        .data = framebuffer,
+        .width = epd_width(),
+        .height = epd_height(),
+        .rotation = display_rotation,
+    };
+    blit(image, src_rect, x, y, options, &target);
+}
+
+void epd_blit_to_image(
+    const EpdImage* image,
+    EpdRect src_rect,
+    int x,
+    int y,
+    const EpdBlitOptions* options,
+    uint8_t* target_data,
+    int target_width,
+    int target_height
+) {
+    assert(image != NULL && target_data != NULL);
+    BlitTarget target = {
+        .data = target_data,
+        .width = target_width,
+        .height = target_height,
+        .rotation = EPD_ROT_LANDSCAPE,
+    };
+    blit(image, src_rect, x, y, options, &target);
+}
+
 void epd_draw_rotated_transparent_image(
     EpdRect image_area, const uint8_t* image_buffer, uint8_t* framebuffer, uint8_t transparent_color
 ) {
-    draw_rotated_transparent_image(image_area, image_buffer, framebuffer, &transparent_color);
+    EpdImage image = {
+        .data = image_buffer,
+        .width = image_area.width,
+        .height = image_area.height,
+        .format = EPD_IMAGE_4BPP,
+    };
+    EpdRect src_rect = { 0, 0, image_area.width, image_area.height };
+    EpdBlitOptions options = {
+        .flags = EPD_BLIT_COLOR_KEY,
+        .color_key = transparent_color,
+    };
+    epd_blit(&image, src_rect, image_area.x, image_area.y, &options, framebuffer);
 }
 
 void epd_draw_rotated_image(EpdRect image_area, const uint8_t* image_buffer, uint8_t* framebuffer) {
-    if (epd_get_rotation() != EPD_ROT_LANDSCAPE) {
-        draw_rotated_transparent_image(image_area, image_buffer, framebuffer, NULL);
-    } else {
-        epd_copy_to_framebuffer(image_area, image_buffer, framebuffer);
-    }
+    EpdImage image = {
+        .data = image_buffer,
+        .width = image_area.width,
+        .height = image_area.height,
+        .format = EPD_IMAGE_4BPP,
+    };
+    EpdRect src_rect = { 0, 0, image_area.width, image_area.height };
+    epd_blit(&image, src_rect, image_area.x, image_area.y, NULL, framebuffer);
 }
 
 void epd_poweron() {
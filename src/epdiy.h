@@ -10,6 +10,7 @@ extern "C" {
 #pragma once
 #include <esp_attr.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "epd_init_config.h"
@@ -27,6 +28,74 @@ typedef struct {
     int height;
 } EpdRect;
 
+/// Maximum number of rectangles in an `EpdDirtyRegions` list.
+#define EPD_MAX_DIRTY_REGIONS 8
+
+/// A list of disjoint rectangles, e.g. of changed areas of the screen.
+typedef struct {
+    /// Number of valid rectangles in `rects`.
+    int count;
+    EpdRect rects[EPD_MAX_DIRTY_REGIONS];
+} EpdDirtyRegions;
+
+/// The changed framebuffer columns `[start, end)` of a row,
+/// empty if `start >= end`. See `EPD_HL_TRACK_CHANGES`.
+typedef struct {
+    int16_t start;
+    int16_t end;
+} EpdRowChanges;
+
+/// Pixel format of an `EpdImage`.
+enum EpdImageFormat {
+    /// 4 bit per pixel, with 0x0 = black and 0xF = white.
+    /// The lower nibble is the left pixel, as in framebuffers.
+    EPD_IMAGE_4BPP = 0,
+    /// 1 bit per pixel, the least significant bit is the leftmost pixel.
+    /// See `EpdBlitOptions` for the colors of set and cleared bits.
+    EPD_IMAGE_1BPP = 1,
+    /// 2 bit per pixel, the least significant bits are the leftmost pixel.
+    /// The values 0 to 3 are drawn as the 4 bit colors 0x0, 0x5, 0xA and 0xF.
+    EPD_IMAGE_2BPP = 2,
+};
+
+/// A source image for `epd_blit()`.
+typedef struct {
+    const uint8_t* data;
+    int width;
+    int height;
+    /// Bytes per row, or 0 for rows padded to whole bytes.
+    int stride;
+    enum EpdImageFormat format;
+} EpdImage;
+
+/// Flags for `EpdBlitOptions`.
+enum EpdBlitFlags {
+    EPD_BLIT_DEFAULT = 0,
+    /// Don't draw image pixels of `color_key`.
+    EPD_BLIT_COLOR_KEY = 1,
+};
+
+/// How `epd_blit()` combines an image with the framebuffer.
+typedef struct {
+    /// A combination of `EpdBlitFlags`.
+    enum EpdBlitFlags flags;
+    /// Color of transparent pixels with `EPD_BLIT_COLOR_KEY`,
+    /// compared to the image colors as in `epd_draw_pixel()`, before `palette` is applied.
+    uint8_t color_key;
+    /// An optional map of the 16 image colors to the colors to draw,
+    /// e.g. to draw grayscale glyphs in arbitrary colors.
+    const uint8_t* palette;
+    /// An optional 4 bit per pixel alpha mask of the image size, with rows padded
+    /// to whole bytes. 0x0 is fully transparent, 0xF fully opaque.
+    const uint8_t* alpha;
+    /// The colors of set and cleared bits of `EPD_IMAGE_1BPP` images.
+    uint8_t fg_color;
+    uint8_t bg_color;
+} EpdBlitOptions;
+
+/// Maximum number of regions in a multi-mode draw, see `epd_draw_multi()`.
+#define EPD_MAX_DRAW_REGIONS 4
+
 /// Global EPD driver options.
 enum EpdInitOptions {
     /// Use the default options.
@@ -44,6 +113,12 @@ enum EpdInitOptions {
     /// Use a feed queue of 32 display lines. (default)
     /// Best performance, but larger memory footprint.
     EPD_FEED_QUEUE_32 = 8,
+
+    /// Allocate a second LUT of the selected size, to build the next frame's
+    /// LUT while the current frame is output. Takes LUT building off the
+    /// critical path between frames, at the cost of another block of internal memory.
+    /// Must be combined with `EPD_LUT_1K` or `EPD_LUT_64K`.
+    EPD_LUT_DOUBLE_BUFFERED = 16,
 };
 
 /// The image drawing mode.
@@ -164,11 +239,75 @@ enum EpdDrawError {
     ///
     /// Reduce the display clock speed.
     EPD_DRAW_EMPTY_LINE_QUEUE = 0x400,
+
+    /// A compressed glyph bitmap of the font could not be decompressed.
+    EPD_DRAW_GLYPH_CORRUPT = 0x800,
 };
 
 /// The default draw mode (non-flashy refresh, whith previously white screen).
 #define EPD_MODE_DEFAULT (MODE_GL16 | PREVIOUSLY_WHITE)
 
+/// Collect render statistics, see `epd_get_render_stats()`.
+/// Define as 0 to compile out all statistics collection.
+#ifndef EPD_RENDER_STATS
+#define EPD_RENDER_STATS 1
+#endif
+
+/// Number of buckets of the line lookup time histograms, 1us each.
+/// The last bucket also counts all slower lookups.
+#define EPD_STATS_LOOKUP_BUCKETS 64
+/// Maximum number of render threads statistics are collected for.
+#define EPD_STATS_MAX_THREADS 8
+
+/// Render statistics of a single render thread.
+typedef struct {
+    /// Number of lines looked up.
+    uint32_t lines;
+    /// Number of lines skipped, because they were not drawn.
+    uint32_t skipped_lines;
+    /// Number of lookups that took `i` us, for every bucket `i`.
+    uint32_t lookup_us[EPD_STATS_LOOKUP_BUCKETS];
+} EpdThreadStats;
+
+/// Render statistics, accumulated over all draws since the last reset.
+typedef struct {
+    /// Number of frames output.
+    uint32_t frames;
+    /// Total time of all frames in us, from preparing a frame to its last line.
+    uint64_t scan_time_us;
+    /// Longest frame time in us.
+    uint32_t max_frame_us;
+    /// Total time spent preparing LUTs before frames in us.
+    uint64_t lut_time_us;
+    /// Longest LUT preparation before a frame in us.
+    uint32_t max_lut_us;
+    /// Number of LUTs built from scratch, patched and re-used.
+    uint32_t lut_builds;
+    uint32_t lut_patches;
+    uint32_t lut_reuses;
+    /// Lowest number of prepared lines in the line queue when a line was output.
+    /// -1 if no line was output.
+    int queue_low_water;
+    /// Highest number of prepared lines in the line queue.
+    int queue_high_water;
+    /// Number of lines that were not prepared in time for output.
+    uint32_t underruns;
+    /// Number of render threads with statistics in `threads`.
+    int num_threads;
+    EpdThreadStats threads[EPD_STATS_MAX_THREADS];
+} EpdRenderStats;
+
+/// A region of the screen drawn with its own waveform mode, see `epd_draw_multi()`.
+typedef struct {
+    /// The area to draw, in display coordinates.
+    EpdRect area;
+    /// The waveform mode and previous display state of the region.
+    /// The framebuffer packing must be the same for all regions of a draw.
+    enum EpdDrawMode mode;
+    /// The waveform to draw the region with.
+    const EpdWaveform* waveform;
+} EpdDrawRegion;
+
 /// Font drawing flags
 enum EpdFontFlags {
     /// Draw a background.
@@ -197,6 +336,53 @@ typedef struct {
     enum EpdFontFlags flags;
 } EpdFontProperties;
 
+/// A glyph placed by `epd_layout_text()`.
+typedef struct {
+    const EpdGlyph* glyph;
+    /// Cursor position of the glyph, relative to the start of its line.
+    int16_t x;
+} EpdLayoutGlyph;
+
+/// A line of text placed by `epd_layout_text()`.
+typedef struct {
+    /// Index of the first glyph of the line in `EpdTextLayout.glyphs`.
+    int first_glyph;
+    int glyph_count;
+    /// Start of the line relative to the layout position, including the alignment.
+    int x;
+    /// Base line of the line relative to the base line of the first line.
+    int y;
+    /// Width of the line, as measured by `epd_get_text_bounds()`.
+    int width;
+} EpdLayoutLine;
+
+/**
+ * Text laid out for drawing with `epd_draw_text_layout()`.
+ *
+ * The caller provides the memory for glyphs and lines,
+ * so that no allocation is necessary for laying out and drawing text.
+ */
+typedef struct {
+    /// Storage for the placed glyphs, provided by the caller.
+    EpdLayoutGlyph* glyphs;
+    int glyph_capacity;
+    /// Storage for the lines, provided by the caller.
+    EpdLayoutLine* lines;
+    int line_capacity;
+
+    /// The font the text was laid out with.
+    const EpdFont* font;
+    int glyph_count;
+    int line_count;
+    /// Width of the widest line.
+    int width;
+    /// Height of all lines, which is `line_count` times the line advance of the font.
+    int height;
+    /// Number of bytes of the string that were laid out.
+    /// If the text did not fit, the rest of the string starts here.
+    size_t length;
+} EpdTextLayout;
+
 #include "epd_board.h"
 #include "epd_board_specific.h"
 #include "epd_display.h"
@@ -487,11 +673,86 @@ enum EpdDrawError epd_write_default(
     const EpdFont* font, const char* string, int* cursor_x, int* cursor_y, uint8_t* framebuffer
 );
 
+/**
+ * Lay out a (multi-line) string for drawing with `epd_draw_text_layout()`.
+ *
+ * The string is decoded and measured once, so the layout can be measured
+ * and drawn repeatedly without looking up glyphs again.
+ * `layout` must have its glyph and line storage set up, everything else is filled in.
+ *
+ * @param box_width: If positive, lines are wrapped at spaces to fit this width,
+ *      or between glyphs if a single word does not fit. Lines are aligned
+ *      within the box. Otherwise, lines are only broken at newlines and aligned
+ *      around the drawing position like with `epd_write_string()`.
+ * @param box_height: If positive, only as many lines as fit this height are laid out.
+ *      This also stops when the glyph or line storage is full.
+ *      `layout->length` tells where to continue with the next layout, e.g. for a new page.
+ * @returns `EPD_DRAW_GLYPH_FALLBACK_FAILED` if glyphs were missing and left out.
+ */
+enum EpdDrawError epd_layout_text(
+    const EpdFont* font,
+    const char* string,
+    int box_width,
+    int box_height,
+    const EpdFontProperties* properties,
+    EpdTextLayout* layout
+);
+
+/**
+ * Draw text laid out by `epd_layout_text()`, with the base line
+ * of the first line at `y`. The properties should be the ones it was laid out with.
+ */
+enum EpdDrawError epd_draw_text_layout(
+    const EpdTextLayout* layout,
+    int x,
+    int y,
+    uint8_t* framebuffer,
+    const EpdFontProperties* properties
+);
+
 /**
  * Get the font glyph for a unicode code point.
  */
 const EpdGlyph* epd_get_glyph(const EpdFont* font, uint32_t code_point);
 
+/**
+ * Set up a cache for the decompressed glyph bitmaps of zlib-compressed fonts.
+ * Without it, glyphs are decompressed every time they are drawn.
+ * Recently drawn glyphs are kept until the cache exceeds `budget`.
+ * The cache also makes font functions share a single decompressor,
+ * and serializes drawing of compressed glyphs between tasks.
+ *
+ * @param budget: Maximum size of the cache in bytes.
+ *      With 0, only the decompressor is shared.
+ * @param caps: The `heap_caps` capabilities of the cache memory,
+ *      e.g. `MALLOC_CAP_SPIRAM` or `MALLOC_CAP_INTERNAL`.
+ */
+void epd_glyph_cache_init(size_t budget, uint32_t caps);
+
+/**
+ * Free the glyph cache and its memory.
+ */
+void epd_glyph_cache_deinit();
+
+/**
+ * Set up a cache for lines of text written with `epd_write_string()`.
+ * A line is rendered once for its font and font properties, and drawn
+ * as an image when the same line is written again. This makes redrawing
+ * labels, units and headings nearly free.
+ * Recently drawn lines are kept until the cache exceeds `budget`.
+ *
+ * @param budget: Maximum size of the cache in bytes.
+ *      Lines that are larger on their own are not cached.
+ * @param caps: The `heap_caps` capabilities of the cache memory,
+ *      e.g. `MALLOC_CAP_SPIRAM` or `MALLOC_CAP_INTERNAL`.
+ */
+void epd_text_cache_init(size_t budget, uint32_t caps);
+
+/**
+ * Free the text cache and its memory.
+ */
+void epd_text_cache_deinit();
+
 /**
  * Darken / lighten an area for a given time.
  *
@@ -538,6 +799,162 @@ enum EpdDrawError epd_draw_base(
     const uint8_t* drawn_columns,
     const EpdWaveform* waveform
 );
+
+/**
+ * Called when an asynchronous draw is done, with the result of the draw.
+ * It runs on the epdiy draw task before the next draw can start,
+ * so it must not draw or wait for draws itself.
+ */
+typedef void (*EpdDrawCallback)(enum EpdDrawError result, void* user_data);
+
+/**
+ * Like `epd_draw_base()`, but returns as soon as the draw is started.
+ * The frames are output by a driver task while the caller continues.
+ * If another draw is in progress, this waits for it to finish first.
+ *
+ * `data` and `drawn_lines` are read throughout the draw and must not be modified
+ * or freed until it is done, i.e. `on_done` was called or `epd_draw_wait()` returned.
+ * `drawn_columns` is only read when starting and may be re-used right away.
+ * The display must stay powered on until the draw is done.
+ *
+ * @param on_done: Called when the draw is done, may be NULL.
+ * @param user_data: Passed to `on_done`.
+ * @returns `EPD_DRAW_SUCCESS` if the draw was started, error flags otherwise.
+ *      Errors found while drawing are passed to `on_done`.
+ */
+enum EpdDrawError epd_draw_base_async(
+    EpdRect area,
+    const uint8_t* data,
+    EpdRect crop_to,
+    enum EpdDrawMode mode,
+    int temperature,
+    const bool* drawn_lines,
+    const uint8_t* drawn_columns,
+    const EpdWaveform* waveform,
+    EpdDrawCallback on_done,
+    void* user_data
+);
+
+/**
+ * Wait for the draw in progress to finish, if any.
+ *
+ * @returns The result of the last draw.
+ */
+enum EpdDrawError epd_draw_wait();
+
+/**
+ * Check if a draw is in progress, without waiting.
+ */
+bool epd_draw_in_progress();
+
+/**
+ * Like `epd_draw_base()`, but only updates the pixels covered by `regions`,
+ * in a single scan of the display.
+ * Lines outside of all regions are skipped, on other lines the waveform lookup
+ * is limited to the columns of the regions covering that line.
+ *
+ * @param regions: Disjoint rectangles to draw, in display coordinates.
+ *      If NULL or empty, this is the same as `epd_draw_base()`.
+ */
+enum EpdDrawError epd_draw_regions(
+    EpdRect area,
+    const uint8_t* data,
+    EpdRect crop_to,
+    enum EpdDrawMode mode,
+    int temperature,
+    const bool* drawn_lines,
+    const uint8_t* drawn_columns,
+    const EpdWaveform* waveform,
+    const EpdDirtyRegions* regions
+);
+
+/**
+ * Draw multiple regions of a framebuffer with different waveform modes
+ * in a single display update, e.g. a clock with `MODE_DU` next to an image with
+ * `MODE_GL16`. Every frame drives each region with the corresponding phase of its
+ * waveform. Regions with fewer phases are done early and not driven after their last phase.
+ * With the I2S output, which supports individual phase times, a frame lasts as long as
+ * the longest current phase of all regions.
+ *
+ * Every mode apart from the one with the most phases needs its own LUT,
+ * which is allocated with the size of the main LUT on first use.
+ *
+ * @param data: A framebuffer of the full display size, in the packing mode of the regions.
+ * @param regions: Disjoint regions to draw, at most `EPD_MAX_DRAW_REGIONS`.
+ * @param num_regions: The number of regions.
+ * @param temperature: The temperature of the display in °C.
+ * @returns `EPD_DRAW_SUCCESS` on sucess, a combination of error flags otherwise.
+ */
+enum EpdDrawError epd_draw_multi(
+    const uint8_t* data, const EpdDrawRegion* regions, int num_regions, int temperature
+);
+
+/**
+ * Draw regions of a framebuffer asynchronously, letting them join a pipelined draw
+ * already in progress if possible: Regions that don't overlap the regions of that draw
+ * start with its next frame, driven with their own waveform phases, instead of
+ * waiting for the draw to finish. Otherwise, this waits for the draw in progress
+ * to finish and starts a new pipelined draw.
+ *
+ * Like `epd_draw_multi()`, every mode joined needs its own LUT.
+ * At most `EPD_MAX_DRAW_REGIONS - 1` modes and `EPD_MAX_DIRTY_REGIONS` regions
+ * can be driven at the same time.
+ *
+ * The framebuffer is read until the draw is done, including the frames of joined regions.
+ * Meanwhile, it may only be changed outside of the regions still driven,
+ * see `epd_draw_is_driving()`.
+ *
+ * @param data: A framebuffer of the full display size, which all joined draws share.
+ * @param mode: Waveform mode and packing mode of the regions.
+ * @param temperature: The temperature of the display in °C.
+ * @param waveform: The waveform to use.
+ * @param regions: Disjoint regions of the framebuffer to draw.
+ * @returns `EPD_DRAW_SUCCESS` if the regions are drawn, an error flag otherwise.
+ *      Errors while drawing are reported by `epd_draw_wait()`, combined with those
+ *      of earlier pipelined draws it has not reported yet.
+ */
+enum EpdDrawError epd_draw_pipelined(
+    const uint8_t* data,
+    enum EpdDrawMode mode,
+    int temperature,
+    const EpdWaveform* waveform,
+    const EpdDirtyRegions* regions
+);
+
+/**
+ * Check if a draw in progress may still drive pixels in `area`.
+ * For a pipelined draw, these are its regions with phases left and those waiting
+ * to join it, any other draw may drive all pixels.
+ */
+bool epd_draw_is_driving(EpdRect area);
+
+/**
+ * Draw the difference between two 4bpp framebuffers of the full display size,
+ * like `epd_draw_regions()` with a `MODE_PACKING_1PPB_DIFFERENCE` image of them.
+ * The difference image is never stored. Instead, the lines of both framebuffers are
+ * interlaced while feeding the display, which saves the memory and bandwidth for it.
+ *
+ * @param to: The framebuffer with the new display contents.
+ * @param from: The framebuffer with the current display contents,
+ *      with the same alignment as `to`.
+ * @param mode: The waveform mode to use, without packing mode.
+ * @param drawn_lines, drawn_columns, regions: As for `epd_draw_regions()`,
+ *      usually calculated with `epd_difference_image_regions()`.
+ * @param mirror_x: Horizontally mirror the framebuffers on the display.
+ *      `drawn_lines`, `drawn_columns` and `regions` are in display coordinates.
+ */
+enum EpdDrawError epd_draw_difference(
+    const uint8_t* to,
+    const uint8_t* from,
+    enum EpdDrawMode mode,
+    int temperature,
+    const bool* drawn_lines,
+    const uint8_t* drawn_columns,
+    const EpdWaveform* waveform,
+    const EpdDirtyRegions* regions,
+    bool mirror_x
+);
+
 /**
  * Calculate a `MODE_PACKING_1PPB_DIFFERENCE` difference image
  * from two `MODE_PACKING_2PPB` (4 bit-per-pixel) buffers.
@@ -565,6 +982,25 @@ EpdRect epd_difference_image_cropped(
     uint8_t* col_dirtiness
 );
 
+/**
+ * Like `epd_difference_image_cropped()`, but additionally describes the changes
+ * as a list of disjoint rectangles in `regions`, instead of only their bounding box.
+ * Nearby changes are combined where this is estimated to be cheaper to output
+ * than separate rectangles.
+ * `interlaced` may be NULL if the changes are drawn with `epd_draw_difference()`.
+ *
+ * @returns The smallest rectangle containing all regions.
+ */
+EpdRect epd_difference_image_regions(
+    const uint8_t* to,
+    const uint8_t* from,
+    EpdRect crop_to,
+    uint8_t* interlaced,
+    bool* dirty_lines,
+    uint8_t* col_dirtiness,
+    EpdDirtyRegions* regions
+);
+
 /**
  * Simplified version of `epd_difference_image_cropped()`, which considers the
  * whole display frame buffer.
@@ -588,18 +1024,77 @@ EpdRect epd_difference_image(
 uint8_t epd_get_pixel(int x, int y, int fb_width, int fb_height, const uint8_t* framebuffer);
 
 /**
- * Draw an image reading pixel per pixel and being rotation aware (via epd_draw_pixel)
+ * Draw a 4 bit per pixel image, being rotation aware. See `epd_blit()`.
  */
 void epd_draw_rotated_image(EpdRect image_area, const uint8_t* image_buffer, uint8_t* framebuffer);
 
 /**
- * Draw an image reading pixel per pixel and being rotation aware (via epd_draw_pixel)
- * With an optional transparent color (color key transparency)
+ * Draw a 4 bit per pixel image, being rotation aware,
+ * with a transparent color (color key transparency). See `epd_blit()`.
  */
 void epd_draw_rotated_transparent_image(
     EpdRect image_area, const uint8_t* image_buffer, uint8_t* framebuffer, uint8_t transparent_color
 );
 
+/**
+ * Draw an area of an image to a framebuffer, rotation aware.
+ * The image is clipped to the framebuffer and written in runs of pixels along
+ * framebuffer rows, which is much faster than drawing it pixel by pixel.
+ *
+ * @param image: The image to draw from.
+ * @param src_rect: The area of the image to draw, clipped to the image.
+ * @param x, y: Where to draw the top left corner of `src_rect`, in rotated coordinates.
+ * @param options: How to combine the image with the framebuffer.
+ *      NULL copies the image, with set bits of `EPD_IMAGE_1BPP` images as white.
+ * @param framebuffer: The framebuffer to draw to.
+ */
+void epd_blit(
+    const EpdImage* image,
+    EpdRect src_rect,
+    int x,
+    int y,
+    const EpdBlitOptions* options,
+    uint8_t* framebuffer
+);
+
+/**
+ * Draw an area of an image to another 4 bit per pixel image, like `epd_blit()`,
+ * but without rotation. E.g. to compose images off-screen.
+ *
+ * @param target_data: The pixels of the target image, with rows padded to whole bytes.
+ * @param target_width, target_height: The size of the target image.
+ */
+void epd_blit_to_image(
+    const EpdImage* image,
+    EpdRect src_rect,
+    int x,
+    int y,
+    const EpdBlitOptions* options,
+    uint8_t* target_data,
+    int target_width,
+    int target_height
+);
+
+/**
+ * Get the render statistics collected since the last call to `epd_reset_render_stats()`.
+ * Should be called between draws, values are not consistent while drawing.
+ *
+ * @returns `false` if statistics are compiled out with `EPD_RENDER_STATS`.
+ */
+bool epd_get_render_stats(EpdRenderStats* stats);
+
+/**
+ * Reset all render statistics.
+ */
+void epd_reset_render_stats();
+
+/**
+ * Get a percentile of the line lookup times of a render thread in us,
+ * e.g. 50 for the median. This is the upper bound of the histogram bucket
+ * the percentile falls into. Returns -1 if the thread looked up no lines.
+ */
+int epd_render_stats_lookup_percentile(const EpdThreadStats* thread, int percentile);
+
 /**
  * Override the pixel clock when using the LCD driver for display output (Epdiy V7+).
  * This may result in draws failing if it's set too high!
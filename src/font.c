@@ -2,14 +2,121 @@
 #include <esp_heap_caps.h>
 #include <esp_idf_version.h>
 #include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 #include "epdiy.h"
 
+#include <limits.h>
 #include <miniz.h>
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
 
+/// Number of hash buckets of the glyph cache.
+#define GLYPH_CACHE_BUCKETS 64
+/// Size of the buffer for decoded rows of run-length encoded glyphs.
+#define RLE_CHUNK_BYTES 256
+/// Number of hash buckets of the text cache.
+#define TEXT_CACHE_BUCKETS 64
+
+/// A decompressed glyph bitmap held by the glyph cache.
+typedef struct GlyphCacheEntry {
+    const EpdGlyph* glyph;
+    /// Next entry in the same hash bucket.
+    struct GlyphCacheEntry* next;
+    /// Neighbours in the order of last use.
+    struct GlyphCacheEntry* newer;
+    struct GlyphCacheEntry* older;
+    /// Size of the entry, including the bitmap.
+    size_t size;
+    uint8_t bitmap[];
+} GlyphCacheEntry;
+
+/// Cache of decompressed glyph bitmaps, see `epd_glyph_cache_init()`.
+typedef struct {
+    /// Held while decompressing or drawing a glyph. NULL if the cache is not initialized.
+    SemaphoreHandle_t lock;
+    tinfl_decompressor* decompressor;
+    GlyphCacheEntry* buckets[GLYPH_CACHE_BUCKETS];
+    GlyphCacheEntry* newest;
+    GlyphCacheEntry* oldest;
+    size_t budget;
+    size_t used;
+    uint32_t caps;
+} GlyphCache;
+
+static GlyphCache glyph_cache = { 0 };
+
+/// A rendered line of text held by the text cache.
+typedef struct TextCacheEntry {
+    /// Next entry in the same hash bucket.
+    struct TextCacheEntry* next;
+    /// Neighbours in the order of last use.
+    struct TextCacheEntry* newer;
+    struct TextCacheEntry* older;
+    uint32_t hash;
+    const EpdFont* font;
+    EpdFontProperties props;
+    /// The line, stored after the bitmap.
+    const char* string;
+    /// Offset of the aligned line from the cursor.
+    int align_x;
+    /// Cursor advance of the line.
+    int advance;
+    /// Area of the bitmap relative to the aligned cursor.
+    EpdRect area;
+    /// Errors of drawing the line, reported whenever it is drawn.
+    enum EpdDrawError err;
+    /// Size of the entry, including the bitmap and string.
+    size_t size;
+    /// Glyph values of the line, before colors are applied.
+    uint8_t bitmap[];
+} TextCacheEntry;
+
+/// Cache of rendered lines of text, see `epd_text_cache_init()`.
+typedef struct {
+    /// Held while using the cache. NULL if the cache is not initialized.
+    SemaphoreHandle_t lock;
+    TextCacheEntry* buckets[TEXT_CACHE_BUCKETS];
+    TextCacheEntry* newest;
+    TextCacheEntry* oldest;
+    size_t budget;
+    size_t used;
+    uint32_t caps;
+} TextCache;
+
+static TextCache text_cache = { 0 };
+
+/// Where `draw_char()` draws to: the framebuffer, or an unrotated image of the text cache.
+typedef struct {
+    uint8_t* data;
+    /// Size of an image target, 0 for the framebuffer.
+    int width;
+    int height;
+} GlyphTarget;
+
+/**
+ * Decoding state of a run-length encoded glyph bitmap.
+ *
+ * The pixels of a glyph are encoded row by row, without padding at the end of rows.
+ * Each token starts with a byte whose upper two bits select the kind of the token
+ * and whose lower six bits are the number of pixels minus one:
+ *  - 00: a run of pixels of value 0.
+ *  - 01: a run of pixels of value 15.
+ *  - 10: literal pixels, two per following byte with the first pixel in the low nibble.
+ *  - 11: a run of pixels with the value in the low nibble of the following byte.
+ */
+typedef struct {
+    const uint8_t* data;
+    /// Pixels left of the current token.
+    int remaining;
+    /// Pixel value of the current run, or -1 for literal pixels.
+    int value;
+    /// The next literal pixel is in the high nibble of `*data`.
+    bool high_nibble;
+} RleDecoder;
+
 typedef struct {
     uint8_t mask;    /* char data will be bitwise AND with this */
     uint8_t lead;    /* start bytes of current char in utf-8 encoded character */
@@ -78,30 +185,57 @@ EpdFontProperties epd_font_properties_default() {
 }
 
 const EpdGlyph* epd_get_glyph(const EpdFont* font, uint32_t code_point) {
-    const EpdUnicodeInterval* intervals = font->intervals;
-    for (int i = 0; i < font->interval_count; i++) {
-        const EpdUnicodeInterval* interval = &intervals[i];
-        if (code_point >= interval->first && code_point <= interval->last) {
-            return &font->glyph[interval->offset + (code_point - interval->first)];
-        }
+    // intervals are sorted and disjoint
+    int low = 0;
+    int high = (int)font->interval_count - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        const EpdUnicodeInterval* interval = &font->intervals[mid];
         if (code_point < interval->first) {
-            return NULL;
+            high = mid - 1;
+        } else if (code_point > interval->last) {
+            low = mid + 1;
+        } else {
+            return &font->glyph[interval->offset + (code_point - interval->first)];
         }
     }
     return NULL;
 }
 
+/**
+ * Get the glyph for a code point, or the fallback glyph if the font does not have it.
+ */
+static const EpdGlyph* lookup_glyph(
+    const EpdFont* font, uint32_t code_point, const EpdFontProperties* props
+) {
+    const EpdGlyph* glyph = epd_get_glyph(font, code_point);
+    if (!glyph) {
+        glyph = epd_get_glyph(font, props->fallback_glyph);
+    }
+    return glyph;
+}
+
+/**
+ * Decompress a glyph bitmap with `decomp`, or a temporary decompressor if it is NULL.
+ */
 static int uncompress(
-    uint8_t* dest, size_t uncompressed_size, const uint8_t* source, size_t source_size
+    tinfl_decompressor* decomp,
+    uint8_t* dest,
+    size_t uncompressed_size,
+    const uint8_t* source,
+    size_t source_size
 ) {
-    tinfl_decompressor* decomp;
     if (uncompressed_size == 0 || dest == NULL || source_size == 0 || source == NULL) {
         return -1;
     }
-    decomp = malloc(sizeof(tinfl_decompressor));
-    if (!decomp) {
-        // Out of memory
-        return -1;
+    tinfl_decompressor* own_decomp = NULL;
+    if (decomp == NULL) {
+        own_decomp = malloc(sizeof(tinfl_decompressor));
+        if (!own_decomp) {
+            // Out of memory
+            return -1;
+        }
+        decomp = own_decomp;
     }
     tinfl_init(decomp);
 
@@ -115,86 +249,375 @@ static int uncompress(
         &uncompressed_size,
         TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF
     );
-    free(decomp);
+    free(own_decomp);
     if (decomp_status != TINFL_STATUS_DONE) {
         return decomp_status;
     }
     return 0;
 }
 
+static GlyphCacheEntry** glyph_bucket(const EpdGlyph* glyph) {
+    return &glyph_cache.buckets[(uintptr_t)glyph / sizeof(EpdGlyph) % GLYPH_CACHE_BUCKETS];
+}
+
+void epd_glyph_cache_init(size_t budget, uint32_t caps) {
+    assert(glyph_cache.lock == NULL);
+    glyph_cache.lock = xSemaphoreCreateMutex();
+    assert(glyph_cache.lock != NULL);
+    glyph_cache.decompressor = malloc(sizeof(tinfl_decompressor));
+    assert(glyph_cache.decompressor != NULL);
+    glyph_cache.budget = budget;
+    glyph_cache.caps = caps;
+}
+
+/**
+ * Remove the least recently used entry from the glyph cache.
+ */
+static void glyph_cache_evict() {
+    GlyphCacheEntry* entry = glyph_cache.oldest;
+    GlyphCacheEntry** link = glyph_bucket(entry->glyph);
+    while (*link != entry) {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+
+    glyph_cache.oldest = entry->newer;
+    if (glyph_cache.oldest != NULL) {
+        glyph_cache.oldest->older = NULL;
+    } else {
+        glyph_cache.newest = NULL;
+    }
+    glyph_cache.used -= entry->size;
+    heap_caps_free(entry);
+}
+
+void epd_glyph_cache_deinit() {
+    assert(glyph_cache.lock != NULL);
+    while (glyph_cache.oldest != NULL) {
+        glyph_cache_evict();
+    }
+    free(glyph_cache.decompressor);
+    vSemaphoreDelete(glyph_cache.lock);
+    memset(&glyph_cache, 0, sizeof(glyph_cache));
+}
+
+/**
+ * Get the decompressed bitmap of a glyph of a compressed font from the glyph cache,
+ * decompressing it if it is not cached.
+ * Must be called with the cache lock taken. The bitmap is valid until the lock is given.
+ *
+ * @returns NULL if the bitmap does not fit into the cache or can't be decompressed.
+ */
+static const uint8_t* cached_glyph_bitmap(
+    const EpdFont* font, const EpdGlyph* glyph, size_t bitmap_size
+) {
+    GlyphCacheEntry** bucket = glyph_bucket(glyph);
+    GlyphCacheEntry* entry = *bucket;
+    while (entry != NULL && entry->glyph != glyph) {
+        entry = entry->next;
+    }
+
+    if (entry != NULL) {
+        // move to the front of the use order
+        if (entry != glyph_cache.newest) {
+            entry->newer->older = entry->older;
+            if (entry->older != NULL) {
+                entry->older->newer = entry->newer;
+            } else {
+                glyph_cache.oldest = entry->newer;
+            }
+            entry->older = glyph_cache.newest;
+            entry->newer = NULL;
+            glyph_cache.newest->newer = entry;
+            glyph_cache.newest = entry;
+        }
+        return entry->bitmap;
+    }
+
+    size_t size = sizeof(GlyphCacheEntry) + bitmap_size;
+    if (size > glyph_cache.budget) {
+        return NULL;
+    }
+    while (glyph_cache.used + size > glyph_cache.budget) {
+        glyph_cache_evict();
+    }
+    entry = heap_caps_malloc(size, glyph_cache.caps);
+    if (entry == NULL) {
+        return NULL;
+    }
+    int status = uncompress(
+        glyph_cache.decompressor,
+        entry->bitmap,
+        bitmap_size,
+        &font->bitmap[glyph->data_offset],
+        glyph->compressed_size
+    );
+    if (status != 0) {
+        heap_caps_free(entry);
+        return NULL;
+    }
+
+    entry->glyph = glyph;
+    entry->size = size;
+    entry->next = *bucket;
+    *bucket = entry;
+    entry->newer = NULL;
+    entry->older = glyph_cache.newest;
+    if (glyph_cache.newest != NULL) {
+        glyph_cache.newest->newer = entry;
+    } else {
+        glyph_cache.oldest = entry;
+    }
+    glyph_cache.newest = entry;
+    glyph_cache.used += size;
+    return entry->bitmap;
+}
+
+/**
+ * Get the options for blitting glyph values with `props`.
+ * Glyph pixels are drawn as a blend of the foreground and background color,
+ * empty pixels are transparent without a background.
+ *
+ * @param palette: Storage for the 16 colors of glyph values.
+ */
+static EpdBlitOptions glyph_blit_options(const EpdFontProperties* props, uint8_t* palette) {
+    for (int c = 0; c < 16; c++) {
+        int color_difference = (int)props->fg_color - (int)props->bg_color;
+        palette[c] = max(0, min(15, props->bg_color + c * color_difference / 15)) << 4;
+    }
+    EpdBlitOptions options = {
+        .flags = (props->flags & EPD_DRAW_BACKGROUND) ? EPD_BLIT_DEFAULT : EPD_BLIT_COLOR_KEY,
+        .color_key = 0x00,
+        .palette = palette,
+    };
+    return options;
+}
+
+static void blit_glyph(
+    const GlyphTarget* target,
+    const EpdImage* image,
+    EpdRect src_rect,
+    int x,
+    int y,
+    const EpdBlitOptions* options
+) {
+    if (target->width > 0) {
+        epd_blit_to_image(
+            image, src_rect, x, y, options, target->data, target->width, target->height
+        );
+    } else {
+        epd_blit(image, src_rect, x, y, options, target->data);
+    }
+}
+
+/**
+ * Set `count` pixels of a packed 4 bit row, starting at `x`, to `value`.
+ */
+static inline void set_row_pixels(uint8_t* row, int x, int count, uint8_t value) {
+    if (x % 2 && count > 0) {
+        row[x / 2] = (row[x / 2] & 0x0F) | (value << 4);
+        x++;
+        count--;
+    }
+    memset(&row[x / 2], value * 0x11, count / 2);
+    if (count % 2) {
+        row[(x + count) / 2] = (row[(x + count) / 2] & 0xF0) | value;
+    }
+}
+
+/**
+ * Decode the next `width` pixels of a run-length encoded glyph into a packed row.
+ */
+static void rle_decode_row(RleDecoder* decoder, uint8_t* row, int width) {
+    int x = 0;
+    while (x < width) {
+        if (decoder->remaining == 0) {
+            // skip the unused nibble of an uneven literal
+            if (decoder->high_nibble) {
+                decoder->data++;
+                decoder->high_nibble = false;
+            }
+            uint8_t token = *decoder->data++;
+            decoder->remaining = (token & 0x3F) + 1;
+            switch (token >> 6) {
+                case 0:
+                    decoder->value = 0;
+                    break;
+                case 1:
+                    decoder->value = 15;
+                    break;
+                case 2:
+                    decoder->value = -1;
+                    break;
+                default:
+                    decoder->value = *decoder->data++ & 0x0F;
+                    break;
+            }
+        }
+
+        int count = min(decoder->remaining, width - x);
+        if (decoder->value >= 0) {
+            set_row_pixels(row, x, count, decoder->value);
+        } else {
+            for (int i = x; i < x + count; i++) {
+                uint8_t byte = *decoder->data;
+                uint8_t value = decoder->high_nibble ? byte >> 4 : byte & 0x0F;
+                decoder->data += decoder->high_nibble;
+                decoder->high_nibble = !decoder->high_nibble;
+                set_row_pixels(row, i, 1, value);
+            }
+        }
+        x += count;
+        decoder->remaining -= count;
+    }
+}
+
+/**
+ * Decode a run-length encoded glyph in chunks of rows and blit them to `target`,
+ * without decoding the whole bitmap first.
+ */
+static enum EpdDrawError blit_rle_glyph(
+    const EpdFont* font,
+    const EpdGlyph* glyph,
+    int x,
+    int y,
+    const EpdBlitOptions* options,
+    const GlyphTarget* target
+) {
+    int byte_width = (glyph->width + 1) / 2;
+    uint8_t chunk[RLE_CHUNK_BYTES];
+    uint8_t* rows = chunk;
+    int chunk_rows = RLE_CHUNK_BYTES / byte_width;
+    if (chunk_rows == 0) {
+        rows = malloc(byte_width);
+        if (rows == NULL) {
+            ESP_LOGE("font", "malloc failed.");
+            return EPD_DRAW_FAILED_ALLOC;
+        }
+        chunk_rows = 1;
+    }
+
+    RleDecoder decoder = { .data = &font->bitmap[glyph->data_offset] };
+    for (int row = 0; row < glyph->height; row += chunk_rows) {
+        int count = min(chunk_rows, glyph->height - row);
+        for (int i = 0; i < count; i++) {
+            rle_decode_row(&decoder, &rows[i * byte_width], glyph->width);
+        }
+        EpdImage image = {
+            .data = rows,
+            .width = glyph->width,
+            .height = count,
+            .format = EPD_IMAGE_4BPP,
+        };
+        EpdRect rows_rect = { 0, 0, glyph->width, count };
+        blit_glyph(target, &image, rows_rect, x, y + row, options);
+    }
+
+    if (rows != chunk) {
+        free(rows);
+    }
+    return EPD_DRAW_SUCCESS;
+}
+
 /*!
-   @brief   Draw a single character to a pre-allocated buffer.
+   @brief   Draw a single glyph to a pre-allocated buffer.
 */
 static enum EpdDrawError IRAM_ATTR draw_char(
     const EpdFont* font,
-    uint8_t* buffer,
+    const GlyphTarget* target,
     int* cursor_x,
     int cursor_y,
-    uint32_t cp,
+    const EpdGlyph* glyph,
     const EpdFontProperties* props
 ) {
     assert(props != NULL);
 
-    const EpdGlyph* glyph = epd_get_glyph(font, cp);
-    if (!glyph) {
-        glyph = epd_get_glyph(font, props->fallback_glyph);
-    }
-
     if (!glyph) {
         return EPD_DRAW_GLYPH_FALLBACK_FAILED;
     }
 
     uint32_t offset = glyph->data_offset;
     uint16_t width = glyph->width, height = glyph->height;
-    int left = glyph->left;
+    int x = *cursor_x + glyph->left;
+    int y = cursor_y - glyph->top;
+
+    uint8_t palette[16];
+    EpdBlitOptions options = glyph_blit_options(props, palette);
 
-    int byte_width = (width / 2 + width % 2);
+    // glyph bitmaps of fewer bits per pixel are expanded to 4 bit while blitting
+    enum EpdImageFormat format = EPD_IMAGE_4BPP;
+    int bits_per_pixel = 4;
+    if (font->compressed != EPD_FONT_COMPRESSED_RLE && font->bits_per_pixel == 1) {
+        format = EPD_IMAGE_1BPP;
+        bits_per_pixel = 1;
+        options.fg_color = 0xF0;
+        options.bg_color = 0x00;
+    } else if (font->compressed != EPD_FONT_COMPRESSED_RLE && font->bits_per_pixel == 2) {
+        format = EPD_IMAGE_2BPP;
+        bits_per_pixel = 2;
+    }
+
+    int byte_width = (width * bits_per_pixel + 7) / 8;
     unsigned long bitmap_size = byte_width * height;
-    const uint8_t* bitmap = NULL;
-    if (bitmap_size > 0 && font->compressed) {
-        uint8_t* tmp_bitmap = (uint8_t*)malloc(bitmap_size);
-        if (tmp_bitmap == NULL && bitmap_size) {
-            ESP_LOGE("font", "malloc failed.");
-            return EPD_DRAW_FAILED_ALLOC;
+    if (bitmap_size > 0 && font->compressed == EPD_FONT_COMPRESSED_RLE) {
+        enum EpdDrawError err = blit_rle_glyph(font, glyph, x, y, &options, target);
+        if (err == EPD_DRAW_SUCCESS) {
+            *cursor_x += glyph->advance_x;
         }
-        uncompress(tmp_bitmap, bitmap_size, &font->bitmap[offset], glyph->compressed_size);
-        bitmap = tmp_bitmap;
-    } else {
-        bitmap = &font->bitmap[offset];
+        return err;
     }
 
-    uint8_t color_lut[16];
-    for (int c = 0; c < 16; c++) {
-        int color_difference = (int)props->fg_color - (int)props->bg_color;
-        color_lut[c] = max(0, min(15, props->bg_color + c * color_difference / 15));
-    }
-    bool background_needed = props->flags & EPD_DRAW_BACKGROUND;
-
-    for (int y = 0; y < height; y++) {
-        int yy = cursor_y - glyph->top + y;
-        int start_pos = *cursor_x + left;
-        bool byte_complete = start_pos % 2;
-        int x = max(0, -start_pos);
-        int max_x = start_pos + width;
-        uint8_t color;
-
-        for (int xx = start_pos; xx < max_x; xx++) {
-            uint8_t bm = bitmap[y * byte_width + x / 2];
-            if ((x & 1) == 0) {
-                bm = bm & 0xF;
-            } else {
-                bm = bm >> 4;
+    const uint8_t* bitmap = NULL;
+    uint8_t* tmp_bitmap = NULL;
+    bool locked = false;
+    if (bitmap_size > 0 && font->compressed == EPD_FONT_COMPRESSED_ZLIB) {
+        if (glyph_cache.lock != NULL) {
+            xSemaphoreTake(glyph_cache.lock, portMAX_DELAY);
+            locked = true;
+            bitmap = cached_glyph_bitmap(font, glyph, bitmap_size);
+        }
+        if (bitmap == NULL) {
+            tmp_bitmap = (uint8_t*)malloc(bitmap_size);
+            if (tmp_bitmap == NULL) {
+                ESP_LOGE("font", "malloc failed.");
+                if (locked) {
+                    xSemaphoreGive(glyph_cache.lock);
+                }
+                return EPD_DRAW_FAILED_ALLOC;
             }
-            if (background_needed || bm) {
-                color = color_lut[bm] << 4;
-                epd_draw_pixel(xx, yy, color, buffer);
+            int status = uncompress(
+                glyph_cache.decompressor,
+                tmp_bitmap,
+                bitmap_size,
+                &font->bitmap[offset],
+                glyph->compressed_size
+            );
+            if (status != 0) {
+                ESP_LOGE("font", "could not decompress glyph: %d", status);
+                free(tmp_bitmap);
+                if (locked) {
+                    xSemaphoreGive(glyph_cache.lock);
+                }
+                return EPD_DRAW_GLYPH_CORRUPT;
             }
-            byte_complete = !byte_complete;
-            x++;
+            bitmap = tmp_bitmap;
         }
+    } else {
+        bitmap = &font->bitmap[offset];
     }
-    if (bitmap_size > 0 && font->compressed) {
-        free((uint8_t*)bitmap);
+
+    EpdImage image = {
+        .data = bitmap,
+        .width = width,
+        .height = height,
+        .format = format,
+    };
+    EpdRect glyph_rect = { 0, 0, width, height };
+    blit_glyph(target, &image, glyph_rect, x, y, &options);
+
+    free(tmp_bitmap);
+    if (locked) {
+        xSemaphoreGive(glyph_cache.lock);
     }
     *cursor_x += glyph->advance_x;
     return EPD_DRAW_SUCCESS;
@@ -206,7 +629,7 @@ static enum EpdDrawError IRAM_ATTR draw_char(
  */
 static void get_char_bounds(
     const EpdFont* font,
-    uint32_t cp,
+    const EpdGlyph* glyph,
     int* x,
     int* y,
     int* minx,
@@ -217,12 +640,6 @@ static void get_char_bounds(
 ) {
     assert(props != NULL);
 
-    const EpdGlyph* glyph = epd_get_glyph(font, cp);
-
-    if (!glyph) {
-        glyph = epd_get_glyph(font, props->fallback_glyph);
-    }
-
     if (!glyph) {
         return;
     }
@@ -274,8 +691,10 @@ EpdRect epd_get_string_rect(
         {
             temp_x = x;
             temp_y += font->advance_y;
-        } else
-            get_char_bounds(font, c, &temp_x, &temp_y, &minx, &miny, &maxx, &maxy, &props);
+        } else {
+            const EpdGlyph* glyph = lookup_glyph(font, c, &props);
+            get_char_bounds(font, glyph, &temp_x, &temp_y, &minx, &miny, &maxx, &maxy, &props);
+        }
     }
     temp.width = maxx - x + (margin * 2);
     temp.height = maxy - miny + (margin * 2);
@@ -311,7 +730,8 @@ void epd_get_text_bounds(
     int temp_y = *y;
     uint32_t c;
     while ((c = next_cp((const uint8_t**)&string))) {
-        get_char_bounds(font, c, &temp_x, &temp_y, &minx, &miny, &maxx, &maxy, &props);
+        const EpdGlyph* glyph = lookup_glyph(font, c, &props);
+        get_char_bounds(font, glyph, &temp_x, &temp_y, &minx, &miny, &maxx, &maxy, &props);
     }
     *x1 = min(original_x, minx);
     *w = maxx - *x1;
@@ -319,45 +739,270 @@ void epd_get_text_bounds(
     *h = maxy - miny;
 }
 
-static enum EpdDrawError epd_write_line(
+static uint32_t text_line_hash(
+    const EpdFont* font, const char* string, const EpdFontProperties* props
+) {
+    // FNV-1a
+    uint32_t hash = 2166136261u ^ (uint32_t)(uintptr_t)font;
+    hash = (hash ^ (props->fg_color | props->bg_color << 4 | props->flags << 8)) * 16777619u;
+    hash = (hash ^ props->fallback_glyph) * 16777619u;
+    for (const char* c = string; *c; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    return hash;
+}
+
+void epd_text_cache_init(size_t budget, uint32_t caps) {
+    assert(text_cache.lock == NULL);
+    text_cache.lock = xSemaphoreCreateMutex();
+    assert(text_cache.lock != NULL);
+    text_cache.budget = budget;
+    text_cache.caps = caps;
+}
+
+/**
+ * Remove the least recently used entry from the text cache.
+ */
+static void text_cache_evict() {
+    TextCacheEntry* entry = text_cache.oldest;
+    TextCacheEntry** link = &text_cache.buckets[entry->hash % TEXT_CACHE_BUCKETS];
+    while (*link != entry) {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+
+    text_cache.oldest = entry->newer;
+    if (text_cache.oldest != NULL) {
+        text_cache.oldest->older = NULL;
+    } else {
+        text_cache.newest = NULL;
+    }
+    text_cache.used -= entry->size;
+    heap_caps_free(entry);
+}
+
+void epd_text_cache_deinit() {
+    assert(text_cache.lock != NULL);
+    while (text_cache.oldest != NULL) {
+        text_cache_evict();
+    }
+    vSemaphoreDelete(text_cache.lock);
+    memset(&text_cache, 0, sizeof(text_cache));
+}
+
+/**
+ * Find a line in the text cache and mark it as the most recently used.
+ * Must be called with the cache lock taken.
+ */
+static TextCacheEntry* find_text_line(
+    const EpdFont* font, const char* string, const EpdFontProperties* props
+) {
+    uint32_t hash = text_line_hash(font, string, props);
+    TextCacheEntry* entry = text_cache.buckets[hash % TEXT_CACHE_BUCKETS];
+    while (entry != NULL
+           && (entry->hash != hash || entry->font != font
+               || entry->props.fg_color != props->fg_color
+               || entry->props.bg_color != props->bg_color || entry->props.flags != props->flags
+               || entry->props.fallback_glyph != props->fallback_glyph
+               || strcmp(entry->string, string) != 0)) {
+        entry = entry->next;
+    }
+
+    // move to the front of the use order
+    if (entry != NULL && entry != text_cache.newest) {
+        entry->newer->older = entry->older;
+        if (entry->older != NULL) {
+            entry->older->newer = entry->newer;
+        } else {
+            text_cache.oldest = entry->newer;
+        }
+        entry->older = text_cache.newest;
+        entry->newer = NULL;
+        text_cache.newest->newer = entry;
+        text_cache.newest = entry;
+    }
+    return entry;
+}
+
+/**
+ * Render a measured line to a new entry of the text cache.
+ * Must be called with the cache lock taken.
+ *
+ * @returns NULL if the line cannot be cached.
+ */
+static TextCacheEntry* add_text_line(
     const EpdFont* font,
     const char* string,
-    int* cursor_x,
-    int* cursor_y,
-    uint8_t* framebuffer,
-    const EpdFontProperties* properties
+    const EpdGlyph** glyphs,
+    int glyph_count,
+    int width,
+    int align_x,
+    const EpdFontProperties* props
 ) {
-    assert(framebuffer != NULL);
+    // the area of all glyphs, relative to the aligned cursor
+    int advance = 0;
+    int x_start = INT_MAX, x_end = INT_MIN, y_start = INT_MAX, y_end = INT_MIN;
+    for (int i = 0; i < glyph_count; i++) {
+        const EpdGlyph* glyph = glyphs[i];
+        if (glyph == NULL) {
+            continue;
+        }
+        if (glyph->width > 0 && glyph->height > 0) {
+            x_start = min(x_start, advance + glyph->left);
+            x_end = max(x_end, advance + glyph->left + glyph->width);
+            y_start = min(y_start, -glyph->top);
+            y_end = max(y_end, glyph->height - glyph->top);
+        }
+        advance += glyph->advance_x;
+    }
 
-    if (*string == '\0') {
-        return EPD_DRAW_SUCCESS;
+    EpdRect area = { 0, 0, 0, 0 };
+    if (props->flags & EPD_DRAW_BACKGROUND) {
+        // the background is part of the bitmap and must contain all glyphs
+        area = (EpdRect){ 0, -font->ascender, width, font->ascender - font->descender };
+        if (x_start < x_end
+            && (x_start < area.x || x_end > area.x + area.width || y_start < area.y
+                || y_end > area.y + area.height)) {
+            return NULL;
+        }
+    } else if (x_start < x_end) {
+        area = (EpdRect){ x_start, y_start, x_end - x_start, y_end - y_start };
     }
 
-    assert(properties != NULL);
+    size_t bitmap_size = (size_t)(area.width + 1) / 2 * area.height;
+    size_t size = sizeof(TextCacheEntry) + bitmap_size + strlen(string) + 1;
+    if (size > text_cache.budget) {
+        return NULL;
+    }
+    while (text_cache.used + size > text_cache.budget) {
+        text_cache_evict();
+    }
+    TextCacheEntry* entry = heap_caps_malloc(size, text_cache.caps);
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    // draw glyph values, which are mapped to colors when the line is drawn.
+    // Value 0 is the background, or transparent without a background.
+    memset(entry->bitmap, 0, bitmap_size);
+    EpdFontProperties value_props = *props;
+    value_props.fg_color = 15;
+    value_props.bg_color = 0;
+    GlyphTarget target = { .data = entry->bitmap, .width = area.width, .height = area.height };
+    int cursor_x = -area.x;
+    enum EpdDrawError err = EPD_DRAW_SUCCESS;
+    for (int i = 0; i < glyph_count && area.width > 0; i++) {
+        err |= draw_char(font, &target, &cursor_x, -area.y, glyphs[i], &value_props);
+    }
+    // glyphs that failed to draw don't move the cursor, and may draw next time
+    if (err & ~EPD_DRAW_GLYPH_FALLBACK_FAILED) {
+        heap_caps_free(entry);
+        return NULL;
+    }
+    // missing glyphs are reported, even if no glyph was drawn
+    for (int i = 0; i < glyph_count; i++) {
+        if (glyphs[i] == NULL) {
+            err |= EPD_DRAW_GLYPH_FALLBACK_FAILED;
+        }
+    }
+
+    char* entry_string = (char*)&entry->bitmap[bitmap_size];
+    strcpy(entry_string, string);
+    entry->hash = text_line_hash(font, string, props);
+    entry->font = font;
+    entry->props = *props;
+    entry->string = entry_string;
+    entry->align_x = align_x;
+    entry->advance = advance;
+    entry->area = area;
+    entry->err = err;
+    entry->size = size;
+
+    TextCacheEntry** bucket = &text_cache.buckets[entry->hash % TEXT_CACHE_BUCKETS];
+    entry->next = *bucket;
+    *bucket = entry;
+    entry->newer = NULL;
+    entry->older = text_cache.newest;
+    if (text_cache.newest != NULL) {
+        text_cache.newest->newer = entry;
+    } else {
+        text_cache.oldest = entry;
+    }
+    text_cache.newest = entry;
+    text_cache.used += size;
+    return entry;
+}
+
+/**
+ * Draw a line from the text cache and move the cursor like `epd_write_line()`.
+ */
+static enum EpdDrawError draw_text_line(
+    const TextCacheEntry* entry, int* cursor_x, int cursor_y, uint8_t* framebuffer
+) {
+    int x = *cursor_x + entry->align_x;
+    if (entry->area.width > 0 && entry->area.height > 0) {
+        uint8_t palette[16];
+        EpdBlitOptions options = glyph_blit_options(&entry->props, palette);
+        EpdImage image = {
+            .data = entry->bitmap,
+            .width = entry->area.width,
+            .height = entry->area.height,
+            .format = EPD_IMAGE_4BPP,
+        };
+        EpdRect src_rect = { 0, 0, entry->area.width, entry->area.height };
+        epd_blit(
+            &image, src_rect, x + entry->area.x, cursor_y + entry->area.y, &options, framebuffer
+        );
+    }
+    *cursor_x = x + entry->advance;
+    return entry->err;
+}
+
+/**
+ * Write a single line of text, adding it to the text cache if `cache_line` is set.
+ * `glyphs` must have room for a glyph pointer per byte of `string`.
+ * The glyphs are looked up once and used for measuring as well as drawing.
+ */
+static enum EpdDrawError write_line(
+    const EpdFont* font,
+    const char* string,
+    const EpdGlyph** glyphs,
+    int* cursor_x,
+    int* cursor_y,
+    uint8_t* framebuffer,
+    const EpdFontProperties* properties,
+    bool cache_line
+) {
     EpdFontProperties props = *properties;
     enum EpdFontFlags alignment_mask
         = EPD_DRAW_ALIGN_LEFT | EPD_DRAW_ALIGN_RIGHT | EPD_DRAW_ALIGN_CENTER;
     enum EpdFontFlags alignment = props.flags & alignment_mask;
-
-    // alignments are mutually exclusive!
-    if ((alignment & (alignment - 1)) != 0) {
-        return EPD_DRAW_INVALID_FONT_FLAGS;
+    const char* line = string;
+    int glyph_count = 0;
+    uint32_t c;
+    while ((c = next_cp((const uint8_t**)&string))) {
+        glyphs[glyph_count++] = lookup_glyph(font, c, &props);
     }
 
-    int x1 = 0, y1 = 0, w = 0, h = 0;
+    // same as `epd_get_text_bounds()`, but with the glyphs looked up already
+    int minx = 100000, miny = 100000, maxx = -1, maxy = -1;
     int tmp_cur_x = *cursor_x;
     int tmp_cur_y = *cursor_y;
-    epd_get_text_bounds(font, string, &tmp_cur_x, &tmp_cur_y, &x1, &y1, &w, &h, &props);
+    for (int i = 0; i < glyph_count; i++) {
+        get_char_bounds(
+            font, glyphs[i], &tmp_cur_x, &tmp_cur_y, &minx, &miny, &maxx, &maxy, &props
+        );
+    }
+    int w = maxx - min(*cursor_x, minx);
+    int h = maxy - miny;
 
     // no printable characters
     if (w < 0 || h < 0) {
         return EPD_DRAW_NO_DRAWABLE_CHARACTERS;
     }
 
-    uint8_t* buffer = framebuffer;
     int local_cursor_x = *cursor_x;
     int local_cursor_y = *cursor_y;
-    uint32_t c;
 
     int cursor_x_init = local_cursor_x;
     int cursor_y_init = local_cursor_y;
@@ -378,15 +1023,29 @@ static enum EpdDrawError epd_write_line(
             break;
     }
 
+    if (cache_line) {
+        int align_x = local_cursor_x - cursor_x_init;
+        TextCacheEntry* entry
+            = add_text_line(font, line, glyphs, glyph_count, w, align_x, &props);
+        if (entry != NULL) {
+            return draw_text_line(entry, cursor_x, *cursor_y, framebuffer);
+        }
+    }
+
+    GlyphTarget target = { .data = framebuffer };
     uint8_t bg = props.bg_color;
     if (props.flags & EPD_DRAW_BACKGROUND) {
-        for (int l = local_cursor_y - font->ascender; l < local_cursor_y - font->descender; l++) {
-            epd_draw_hline(local_cursor_x, l, w, bg << 4, buffer);
-        }
+        EpdRect background = {
+            .x = local_cursor_x,
+            .y = local_cursor_y - font->ascender,
+            .width = w,
+            .height = font->ascender - font->descender,
+        };
+        epd_fill_rect(background, bg << 4, framebuffer);
     }
     enum EpdDrawError err = EPD_DRAW_SUCCESS;
-    while ((c = next_cp((const uint8_t**)&string))) {
-        err |= draw_char(font, buffer, &local_cursor_x, local_cursor_y, c, &props);
+    for (int i = 0; i < glyph_count; i++) {
+        err |= draw_char(font, &target, &local_cursor_x, local_cursor_y, glyphs[i], &props);
     }
 
     *cursor_x += local_cursor_x - cursor_x_init;
@@ -394,6 +1053,266 @@ static enum EpdDrawError epd_write_line(
     return err;
 }
 
+/**
+ * Write a single line of text, from the text cache if it is set up.
+ * `glyphs` must have room for a glyph pointer per byte of `string`.
+ */
+static enum EpdDrawError epd_write_line(
+    const EpdFont* font,
+    const char* string,
+    const EpdGlyph** glyphs,
+    int* cursor_x,
+    int* cursor_y,
+    uint8_t* framebuffer,
+    const EpdFontProperties* properties
+) {
+    assert(framebuffer != NULL);
+
+    if (*string == '\0') {
+        return EPD_DRAW_SUCCESS;
+    }
+
+    assert(properties != NULL);
+    enum EpdFontFlags alignment_mask
+        = EPD_DRAW_ALIGN_LEFT | EPD_DRAW_ALIGN_RIGHT | EPD_DRAW_ALIGN_CENTER;
+    enum EpdFontFlags alignment = properties->flags & alignment_mask;
+
+    // alignments are mutually exclusive!
+    if ((alignment & (alignment - 1)) != 0) {
+        return EPD_DRAW_INVALID_FONT_FLAGS;
+    }
+
+    if (text_cache.lock == NULL) {
+        return write_line(
+            font, string, glyphs, cursor_x, cursor_y, framebuffer, properties, false
+        );
+    }
+
+    xSemaphoreTake(text_cache.lock, portMAX_DELAY);
+    enum EpdDrawError err;
+    const TextCacheEntry* entry = find_text_line(font, string, properties);
+    if (entry != NULL) {
+        err = draw_text_line(entry, cursor_x, *cursor_y, framebuffer);
+    } else {
+        err = write_line(font, string, glyphs, cursor_x, cursor_y, framebuffer, properties, true);
+    }
+    xSemaphoreGive(text_cache.lock);
+    return err;
+}
+
+/**
+ * Measure and align a line of `layout` and add it to the layout.
+ */
+static void finish_layout_line(
+    EpdTextLayout* layout,
+    int first_glyph,
+    int glyph_count,
+    int box_width,
+    const EpdFontProperties* props
+) {
+    int minx = 100000, miny = 100000, maxx = -1, maxy = -1;
+    int x = 0, y = 0;
+    for (int i = first_glyph; i < first_glyph + glyph_count; i++) {
+        const EpdGlyph* glyph = layout->glyphs[i].glyph;
+        get_char_bounds(layout->font, glyph, &x, &y, &minx, &miny, &maxx, &maxy, props);
+    }
+    int width = max(0, maxx - min(0, minx));
+
+    // without a box, lines are aligned around the drawing position
+    int space = box_width > 0 ? box_width - width : -width;
+    int offset = 0;
+    if (props->flags & EPD_DRAW_ALIGN_CENTER) {
+        offset = space / 2;
+    } else if (props->flags & EPD_DRAW_ALIGN_RIGHT) {
+        offset = space;
+    }
+
+    EpdLayoutLine* line = &layout->lines[layout->line_count];
+    line->first_glyph = first_glyph;
+    line->glyph_count = glyph_count;
+    line->x = offset;
+    line->y = layout->line_count * layout->font->advance_y;
+    line->width = width;
+    layout->line_count++;
+    layout->width = max(layout->width, width);
+    layout->height = layout->line_count * layout->font->advance_y;
+}
+
+enum EpdDrawError epd_layout_text(
+    const EpdFont* font,
+    const char* string,
+    int box_width,
+    int box_height,
+    const EpdFontProperties* properties,
+    EpdTextLayout* layout
+) {
+    assert(properties != NULL);
+    assert(layout != NULL);
+
+    layout->font = font;
+    layout->glyph_count = 0;
+    layout->line_count = 0;
+    layout->width = 0;
+    layout->height = 0;
+    layout->length = 0;
+
+    if (string == NULL) {
+        ESP_LOGE("font.c", "cannot lay out a NULL string!");
+        return EPD_DRAW_STRING_INVALID;
+    }
+
+    enum EpdFontFlags alignment_mask
+        = EPD_DRAW_ALIGN_LEFT | EPD_DRAW_ALIGN_RIGHT | EPD_DRAW_ALIGN_CENTER;
+    enum EpdFontFlags alignment = properties->flags & alignment_mask;
+
+    // alignments are mutually exclusive!
+    if ((alignment & (alignment - 1)) != 0) {
+        return EPD_DRAW_INVALID_FONT_FLAGS;
+    }
+
+    int max_lines = layout->line_capacity;
+    if (box_height > 0) {
+        max_lines = min(max_lines, max(1, box_height / font->advance_y));
+    }
+    if (max_lines <= 0) {
+        return EPD_DRAW_SUCCESS;
+    }
+
+    enum EpdDrawError err = EPD_DRAW_SUCCESS;
+    EpdLayoutGlyph* glyphs = layout->glyphs;
+    const uint8_t* start = (const uint8_t*)string;
+    const uint8_t* pos = start;
+
+    int line_start = 0;
+    int pen = 0;
+    // where the current line can be wrapped: before the last run of spaces,
+    // continuing with the word after it.
+    int space_start = -1;
+    int word_start = -1;
+    int word_pen = 0;
+    const uint8_t* word_pos = NULL;
+    bool in_space = false;
+
+    while (true) {
+        const uint8_t* cp_pos = pos;
+        uint32_t c = next_cp(&pos);
+        bool full = layout->glyph_count == layout->glyph_capacity;
+
+        if (c == 0 || c == '\n' || full) {
+            finish_layout_line(
+                layout, line_start, layout->glyph_count - line_start, box_width, properties
+            );
+            if (c == '\n' && !full && layout->line_count < max_lines) {
+                line_start = layout->glyph_count;
+                pen = 0;
+                space_start = word_start = -1;
+                in_space = false;
+                continue;
+            }
+            // a newline ending the last line is consumed
+            const uint8_t* end = (c == '\n' && !full) ? pos : cp_pos;
+            layout->length = end - start;
+            return err;
+        }
+
+        const EpdGlyph* glyph = lookup_glyph(font, c, properties);
+        if (!glyph) {
+            err |= EPD_DRAW_GLYPH_FALLBACK_FAILED;
+            continue;
+        }
+
+        if (c == ' ') {
+            if (!in_space) {
+                space_start = layout->glyph_count;
+                in_space = true;
+            }
+        } else {
+            if (in_space) {
+                word_start = layout->glyph_count;
+                word_pen = pen;
+                word_pos = cp_pos;
+                in_space = false;
+            }
+
+            bool overflow = box_width > 0 && layout->glyph_count > line_start
+                            && pen + glyph->left + glyph->width > box_width;
+            if (overflow) {
+                // wrap before the last spaces if there are any, otherwise before this glyph
+                int line_end = layout->glyph_count;
+                int next_start = layout->glyph_count;
+                int shift = pen;
+                const uint8_t* next_pos = cp_pos;
+                if (space_start > line_start && word_start > space_start) {
+                    line_end = space_start;
+                    next_start = word_start;
+                    shift = word_pen;
+                    next_pos = word_pos;
+                }
+
+                finish_layout_line(
+                    layout, line_start, line_end - line_start, box_width, properties
+                );
+                if (layout->line_count == max_lines) {
+                    layout->glyph_count = line_end;
+                    layout->length = next_pos - start;
+                    return err;
+                }
+
+                // move the partial word to the start of the new line
+                int moved = layout->glyph_count - next_start;
+                memmove(&glyphs[line_end], &glyphs[next_start], moved * sizeof(EpdLayoutGlyph));
+                for (int i = line_end; i < line_end + moved; i++) {
+                    glyphs[i].x -= shift;
+                }
+                layout->glyph_count = line_end + moved;
+                line_start = line_end;
+                pen -= shift;
+                space_start = word_start = -1;
+            }
+        }
+
+        glyphs[layout->glyph_count].glyph = glyph;
+        glyphs[layout->glyph_count].x = pen;
+        layout->glyph_count++;
+        pen += glyph->advance_x;
+    }
+}
+
+enum EpdDrawError epd_draw_text_layout(
+    const EpdTextLayout* layout,
+    int x,
+    int y,
+    uint8_t* framebuffer,
+    const EpdFontProperties* properties
+) {
+    assert(framebuffer != NULL);
+    assert(properties != NULL);
+
+    const EpdFont* font = layout->font;
+    GlyphTarget target = { .data = framebuffer };
+    enum EpdDrawError err = EPD_DRAW_SUCCESS;
+    for (int l = 0; l < layout->line_count; l++) {
+        const EpdLayoutLine* line = &layout->lines[l];
+        int line_x = x + line->x;
+        int line_y = y + line->y;
+        if (properties->flags & EPD_DRAW_BACKGROUND) {
+            EpdRect background = {
+                .x = line_x,
+                .y = line_y - font->ascender,
+                .width = line->width,
+                .height = font->ascender - font->descender,
+            };
+            epd_fill_rect(background, properties->bg_color << 4, framebuffer);
+        }
+        for (int i = line->first_glyph; i < line->first_glyph + line->glyph_count; i++) {
+            const EpdLayoutGlyph* placed = &layout->glyphs[i];
+            int cursor_x = line_x + placed->x;
+            err |= draw_char(font, &target, &cursor_x, line_y, placed->glyph, properties);
+        }
+    }
+    return err;
+}
+
 enum EpdDrawError epd_write_default(
     const EpdFont* font, const char* string, int* cursor_x, int* cursor_y, uint8_t* framebuffer
 ) {
@@ -419,16 +1338,24 @@ enum EpdDrawError epd_write_string(
         ESP_LOGE("font.c", "cannot allocate string copy!");
         return EPD_DRAW_FAILED_ALLOC;
     }
+    // a line has at most one code point per byte
+    const EpdGlyph** glyphs = malloc((strlen(string) + 1) * sizeof(EpdGlyph*));
+    if (glyphs == NULL) {
+        ESP_LOGE("font.c", "cannot allocate glyph array!");
+        free(tofree);
+        return EPD_DRAW_FAILED_ALLOC;
+    }
 
     enum EpdDrawError err = EPD_DRAW_SUCCESS;
     // taken from the strsep manpage
     int line_start = *cursor_x;
     while ((token = strsep(&newstring, "\n")) != NULL) {
         *cursor_x = line_start;
-        err |= epd_write_line(font, token, cursor_x, cursor_y, framebuffer, properties);
+        err |= epd_write_line(font, token, glyphs, cursor_x, cursor_y, framebuffer, properties);
         *cursor_y += font->advance_y;
     }
 
+    free(glyphs);
     free(tofree);
     return err;
 }
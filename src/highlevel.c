@@ -11,6 +11,7 @@
 
 #include "epd_highlevel.h"
 #include "epdiy.h"
+#include "render.h"
 
 #ifndef _swap_int
 #define _swap_int(a, b) \
@@ -21,9 +22,22 @@
     }
 #endif
 
+static inline int min(int x, int y) {
+    return x < y ? x : y;
+}
+static inline int max(int x, int y) {
+    return x > y ? x : y;
+}
+
 static bool already_initialized = 0;
 
 EpdiyHighlevelState epd_hl_init(const EpdWaveform* waveform) {
+    return epd_hl_init_with_options(waveform, EPD_HL_OPTIONS_DEFAULT);
+}
+
+EpdiyHighlevelState epd_hl_init_with_options(
+    const EpdWaveform* waveform, enum EpdHlOptions options
+) {
     assert(!already_initialized);
     if (waveform == NULL) {
         waveform = epd_get_display()->default_waveform;
@@ -44,19 +58,33 @@ EpdiyHighlevelState epd_hl_init(const EpdWaveform* waveform) {
     assert(state.back_fb != NULL);
     state.front_fb = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_SPIRAM);
     assert(state.front_fb != NULL);
-    state.difference_fb = heap_caps_aligned_alloc(16, 2 * fb_size, MALLOC_CAP_SPIRAM);
-    assert(state.difference_fb != NULL);
+    state.difference_fb = NULL;
+    if (!(options & EPD_HL_FUSED_DIFFERENCE)) {
+        state.difference_fb = heap_caps_aligned_alloc(16, 2 * fb_size, MALLOC_CAP_SPIRAM);
+        assert(state.difference_fb != NULL);
+    }
     state.dirty_lines = malloc(epd_height() * sizeof(bool));
     assert(state.dirty_lines != NULL);
     state.dirty_columns
         = heap_caps_aligned_alloc(16, epd_width() / 2, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
     assert(state.dirty_columns != NULL);
     state.waveform = waveform;
+    state.row_changes = NULL;
+    if (options & EPD_HL_TRACK_CHANGES) {
+        state.row_changes = heap_caps_calloc(
+            epd_height(), sizeof(EpdRowChanges), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT
+        );
+        assert(state.row_changes != NULL);
+        epd_track_row_changes(state.front_fb, state.row_changes);
+    }
 
     memset(state.front_fb, 0xFF, fb_size);
     memset(state.back_fb, 0xFF, fb_size);
     bool is_mirrored = ((epd_get_display()->display_type & DISPLAY_TYPE_HORIZONTAL_MIRRORED) != 0);
     state.mirror_x = is_mirrored;
+    state.num_pending = 0;
+    state.post_error = EPD_DRAW_SUCCESS;
+    state.posted = false;
     already_initialized = true;
     return state;
 }
@@ -106,137 +134,16 @@ EpdRect _inverse_rotated_area(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
     return rotated;
 }
 
-// Pre-computed lookup table for reversing 2 pixels within a byte
-static const uint8_t __attribute__((aligned(4))) reverse_2px_lut[256] = {
-    0x00, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70,  // 0x00-0x07
-    0x80, 0x90, 0xA0, 0xB0, 0xC0, 0xD0, 0xE0, 0xF0,  // 0x08-0x0F
-    0x01, 0x11, 0x21, 0x31, 0x41, 0x51, 0x61, 0x71,  // 0x10-0x17
-    0x81, 0x91, 0xA1, 0xB1, 0xC1, 0xD1, 0xE1, 0xF1,  // 0x18-0x1F
-    0x02, 0x12, 0x22, 0x32, 0x42, 0x52, 0x62, 0x72,  // 0x20-0x27
-    0x82, 0x92, 0xA2, 0xB2, 0xC2, 0xD2, 0xE2, 0xF2,  // 0x28-0x2F
-    0x03, 0x13, 0x23, 0x33, 0x43, 0x53, 0x63, 0x73,  // 0x30-0x37
-    0x83, 0x93, 0xA3, 0xB3, 0xC3, 0xD3, 0xE3, 0xF3,  // 0x38-0x3F
-    0x04, 0x14, 0x24, 0x34, 0x44, 0x54, 0x64, 0x74,  // 0x40-0x47
-    0x84, 0x94, 0xA4, 0xB4, 0xC4, 0xD4, 0xE4, 0xF4,  // 0x48-0x4F
-    0x05, 0x15, 0x25, 0x35, 0x45, 0x55, 0x65, 0x75,  // 0x50-0x57
-    0x85, 0x95, 0xA5, 0xB5, 0xC5, 0xD5, 0xE5, 0xF5,  // 0x58-0x5F
-    0x06, 0x16, 0x26, 0x36, 0x46, 0x56, 0x66, 0x76,  // 0x60-0x67
-    0x86, 0x96, 0xA6, 0xB6, 0xC6, 0xD6, 0xE6, 0xF6,  // 0x68-0x6F
-    0x07, 0x17, 0x27, 0x37, 0x47, 0x57, 0x67, 0x77,  // 0x70-0x77
-    0x87, 0x97, 0xA7, 0xB7, 0xC7, 0xD7, 0xE7, 0xF7,  // 0x78-0x7F
-    0x08, 0x18, 0x28, 0x38, 0x48, 0x58, 0x68, 0x78,  // 0x80-0x87
-    0x88, 0x98, 0xA8, 0xB8, 0xC8, 0xD8, 0xE8, 0xF8,  // 0x88-0x8F
-    0x09, 0x19, 0x29, 0x39, 0x49, 0x59, 0x69, 0x79,  // 0x90-0x97
-    0x89, 0x99, 0xA9, 0xB9, 0xC9, 0xD9, 0xE9, 0xF9,  // 0x98-0x9F
-    0x0A, 0x1A, 0x2A, 0x3A, 0x4A, 0x5A, 0x6A, 0x7A,  // 0xA0-0xA7
-    0x8A, 0x9A, 0xAA, 0xBA, 0xCA, 0xDA, 0xEA, 0xFA,  // 0xA8-0xAF
-    0x0B, 0x1B, 0x2B, 0x3B, 0x4B, 0x5B, 0x6B, 0x7B,  // 0xB0-0xB7
-    0x8B, 0x9B, 0xAB, 0xBB, 0xCB, 0xDB, 0xEB, 0xFB,  // 0xB8-0xBF
-    0x0C, 0x1C, 0x2C, 0x3C, 0x4C, 0x5C, 0x6C, 0x7C,  // 0xC0-0xC7
-    0x8C, 0x9C, 0xAC, 0xBC, 0xCC, 0xDC, 0xEC, 0xFC,  // 0xC8-0xCF
-    0x0D, 0x1D, 0x2D, 0x3D, 0x4D, 0x5D, 0x6D, 0x7D,  // 0xD0-0xD7
-    0x8D, 0x9D, 0xAD, 0xBD, 0xCD, 0xDD, 0xED, 0xFD,  // 0xD8-0xDF
-    0x0E, 0x1E, 0x2E, 0x3E, 0x4E, 0x5E, 0x6E, 0x7E,  // 0xE0-0xE7
-    0x8E, 0x9E, 0xAE, 0xBE, 0xCE, 0xDE, 0xEE, 0xFE,  // 0xE8-0xEF
-    0x0F, 0x1F, 0x2F, 0x3F, 0x4F, 0x5F, 0x6F, 0x7F,  // 0xF0-0xF7
-    0x8F, 0x9F, 0xAF, 0xBF, 0xCF, 0xDF, 0xEF, 0xFF   // 0xF8-0xFF
-};
-
-/**
- * Horizontally mirror a framebuffer line with 4-bit packed pixels
- *
- * Performs horizontal mirroring by reversing both byte order and pixel order
- * within each byte. Each byte contains 2 pixels in 4-bit format [P1|P0].
- * Uses loop unrolling and lookup table for optimal scalar performance.
- *
- * @param line Pointer to the line buffer to mirror in-place
- * @param line_bytes Number of bytes in the line (width_pixels / 2)
- */
-__attribute__((optimize("O3"))) static inline void mirror_framebuffer_line_horizontal_scalar(
-    uint8_t* line, int line_bytes
-) {
-    uint8_t* start = line;
-    uint8_t* end = line + line_bytes - 1;
-
-    // Process 4 byte pairs at a time (unroll by 4)
-    while (start + 3 < end) {
-        // Load and reverse 4 pairs of bytes
-        uint8_t s0 = reverse_2px_lut[start[0]];
-        uint8_t s1 = reverse_2px_lut[start[1]];
-        uint8_t s2 = reverse_2px_lut[start[2]];
-        uint8_t s3 = reverse_2px_lut[start[3]];
-
-        uint8_t e0 = reverse_2px_lut[end[0]];
-        uint8_t e1 = reverse_2px_lut[end[-1]];
-        uint8_t e2 = reverse_2px_lut[end[-2]];
-        uint8_t e3 = reverse_2px_lut[end[-3]];
-
-        // Store swapped values
-        start[0] = e0;
-        start[1] = e1;
-        start[2] = e2;
-        start[3] = e3;
-
-        end[0] = s0;
-        end[-1] = s1;
-        end[-2] = s2;
-        end[-3] = s3;
-
-        start += 4;
-        end -= 4;
-    }
-
-    // Handle remaining bytes
-    while (start < end) {
-        uint8_t temp_start = reverse_2px_lut[*start];
-        uint8_t temp_end = reverse_2px_lut[*end];
-
-        *start = temp_end;
-        *end = temp_start;
-
-        start++;
-        end--;
-    }
-
-    // Handle middle byte for odd line_bytes
-    if (start == end) {
-        *start = reverse_2px_lut[*start];
-    }
-}
-
-/**
- * Mirror entire framebuffer horizontally
- */
-void epd_hl_mirror_framebuffer_horizontal(uint8_t* framebuffer, int width, int height) {
-    int line_bytes = width / 2;  // 2 pixels per byte in framebuffer
-
-    for (int y = 0; y < height; y++) {
-        uint8_t* line = framebuffer + y * line_bytes;
-        mirror_framebuffer_line_horizontal_scalar(line, line_bytes);
-    }
-}
-
-/**
- * Updated epd_hl_update_area with horizontal mirroring support
- */
 enum EpdDrawError epd_hl_update_area(
     EpdiyHighlevelState* state, enum EpdDrawMode mode, int temperature, EpdRect area
 ) {
     assert(state != NULL);
 
-    // Check if we need to apply horizontal mirroring
-    bool mirror_x = state->mirror_x;
+    // posted updates share the difference image
+    enum EpdDrawError post_err = epd_hl_wait_updates(state);
 
     uint32_t ts = esp_timer_get_time() / 1000;
 
-    // Apply mirroring to framebuffers if needed
-    if (mirror_x) {
-        epd_hl_mirror_framebuffer_horizontal(state->front_fb, epd_width(), epd_height());
-        epd_hl_mirror_framebuffer_horizontal(state->back_fb, epd_width(), epd_height());
-    }
-
-    uint32_t tm1 = esp_timer_get_time() / 1000;  // After first mirroring
-
     // Apply rotation transformation to area
     EpdRect rotated_area = _inverse_rotated_area(area.x, area.y, area.width, area.height);
     area.x = rotated_area.x;
@@ -246,23 +153,29 @@ enum EpdDrawError epd_hl_update_area(
 
     uint32_t tr = esp_timer_get_time() / 1000;
 
-    // FIXME: use crop information here, if available
-    EpdRect diff_area = epd_difference_image_cropped(
+    // The difference image is mirrored line by line if needed, so the framebuffers
+    // themselves are never mirrored. The back buffer is brought up to date in the same
+    // pass: All pixels of the area that differ are drawn, the others are already equal.
+    // Without a difference image, the back buffer is read while drawing and updated after.
+    bool fused = state->difference_fb == NULL;
+    EpdDirtyRegions regions;
+    EpdRect diff_area = epd_difference_image_base(
         state->front_fb,
         state->back_fb,
         area,
+        epd_width(),
+        epd_height(),
         state->difference_fb,
         state->dirty_lines,
-        state->dirty_columns
+        state->dirty_columns,
+        &regions,
+        fused ? NULL : state->back_fb,
+        state->row_changes,
+        state->mirror_x
     );
 
     if (diff_area.height == 0 || diff_area.width == 0) {
-        // Restore framebuffers if they were mirrored
-        if (mirror_x) {
-            epd_hl_mirror_framebuffer_horizontal(state->front_fb, epd_width(), epd_height());
-            epd_hl_mirror_framebuffer_horizontal(state->back_fb, epd_width(), epd_height());
-        }
-        return EPD_DRAW_SUCCESS;
+        return post_err;
     }
 
     uint32_t t1 = esp_timer_get_time() / 1000;
@@ -272,72 +185,238 @@ enum EpdDrawError epd_hl_update_area(
     diff_area.width = epd_width();
     diff_area.height = epd_height();
 
+    // all regions are drawn in a single scan of the display
     enum EpdDrawError err = EPD_DRAW_SUCCESS;
-    err = epd_draw_base(
-        epd_full_screen(),
-        state->difference_fb,
-        diff_area,
-        MODE_PACKING_1PPB_DIFFERENCE | mode,
-        temperature,
-        state->dirty_lines,
-        state->dirty_columns,
-        state->waveform
-    );
+    if (fused) {
+        err = epd_draw_difference(
+            state->front_fb,
+            state->back_fb,
+            mode,
+            temperature,
+            state->dirty_lines,
+            state->dirty_columns,
+            state->waveform,
+            &regions,
+            state->mirror_x
+        );
+        epd_sync_dirty_lines(
+            state->back_fb,
+            state->front_fb,
+            area,
+            epd_width(),
+            epd_height(),
+            state->dirty_lines,
+            state->mirror_x
+        );
+    } else {
+        err = epd_draw_regions(
+            epd_full_screen(),
+            state->difference_fb,
+            diff_area,
+            MODE_PACKING_1PPB_DIFFERENCE | mode,
+            temperature,
+            state->dirty_lines,
+            state->dirty_columns,
+            state->waveform,
+            &regions
+        );
+    }
 
     uint32_t t2 = esp_timer_get_time() / 1000;
 
-    diff_area.x = 0;
-    diff_area.y = 0;
-    diff_area.width = epd_width();
-    diff_area.height = epd_height();
+    ESP_LOGI(
+        "epdiy",
+        "rot: %dms, diff: %dms, draw: %dms (%d regions), total: %dms",
+        tr - ts,
+        t1 - tr,
+        t2 - t1,
+        regions.count,
+        t2 - ts
+    );
+
+    return err | post_err;
+}
 
-    int buf_width = epd_width();
+static inline bool rects_overlap(EpdRect a, EpdRect b) {
+    return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height
+           && b.y < a.y + a.height;
+}
 
-    for (int l = diff_area.y; l < diff_area.y + diff_area.height; l++) {
-        if (state->dirty_lines[l] > 0) {
-            uint8_t* lfb = state->front_fb + buf_width / 2 * l;
-            uint8_t* lbb = state->back_fb + buf_width / 2 * l;
+/**
+ * Check if `area` overlaps one of the first `count` queued updates.
+ */
+static bool overlaps_pending(EpdiyHighlevelState* state, EpdRect area, int count) {
+    for (int i = 0; i < count; i++) {
+        if (rects_overlap(area, state->pending[i].area)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Draw the changes within `area` (in display coordinates), joining the draw in progress
+ * if possible. Only the pixels of `area` are written to the difference image,
+ * as the draw in progress still reads other areas of it.
+ */
+static enum EpdDrawError start_posted_update(
+    EpdiyHighlevelState* state, enum EpdDrawMode mode, int temperature, EpdRect area
+) {
+    EpdDirtyRegions regions;
+    EpdRect diff_area = epd_difference_image_base(
+        state->front_fb,
+        state->back_fb,
+        area,
+        epd_width(),
+        epd_height(),
+        NULL,
+        state->dirty_lines,
+        state->dirty_columns,
+        &regions,
+        NULL,
+        state->row_changes,
+        state->mirror_x
+    );
+    if (diff_area.height == 0 || diff_area.width == 0) {
+        return EPD_DRAW_SUCCESS;
+    }
 
-            int x = diff_area.x;
-            int x_last = diff_area.x + diff_area.width - 1;
+    epd_interlace_dirty_lines(
+        state->front_fb,
+        state->back_fb,
+        state->difference_fb,
+        area,
+        epd_width(),
+        epd_height(),
+        state->dirty_lines,
+        state->mirror_x
+    );
+    epd_sync_dirty_lines(
+        state->back_fb,
+        state->front_fb,
+        area,
+        epd_width(),
+        epd_height(),
+        state->dirty_lines,
+        state->mirror_x
+    );
+    return epd_draw_pipelined(
+        state->difference_fb,
+        MODE_PACKING_1PPB_DIFFERENCE | mode,
+        temperature,
+        state->waveform,
+        &regions
+    );
+}
 
-            if (x % 2) {
-                *(lbb + x / 2) = (*(lfb + x / 2) & 0xF0) | (*(lbb + x / 2) & 0x0F);
-                x += 1;
-            }
+/**
+ * Merge `area` into the queued update `index` with the same mode, if the bounding box
+ * of both covers no other pixels and no pixels of later updates with another mode.
+ */
+static bool merge_pending_update(EpdiyHighlevelState* state, int index, EpdRect area) {
+    EpdHlPendingUpdate* pending = &state->pending[index];
+    EpdRect merged;
+    merged.x = min(area.x, pending->area.x);
+    merged.y = min(area.y, pending->area.y);
+    merged.width = max(area.x + area.width, pending->area.x + pending->area.width) - merged.x;
+    merged.height = max(area.y + area.height, pending->area.y + pending->area.height) - merged.y;
+
+    int overlap_width = min(area.x + area.width, pending->area.x + pending->area.width)
+                        - max(area.x, pending->area.x);
+    int overlap_height = min(area.y + area.height, pending->area.y + pending->area.height)
+                         - max(area.y, pending->area.y);
+    int union_size = area.width * area.height + pending->area.width * pending->area.height
+                     - overlap_width * overlap_height;
+    if (merged.width * merged.height != union_size) {
+        return false;
+    }
 
-            if (!(x_last % 2)) {
-                *(lbb + x_last / 2) = (*(lfb + x_last / 2) & 0x0F) | (*(lbb + x_last / 2) & 0xF0);
-                x_last -= 1;
-            }
+    for (int i = index + 1; i < state->num_pending; i++) {
+        EpdHlPendingUpdate* later = &state->pending[i];
+        bool same_mode
+            = later->mode == pending->mode && later->temperature == pending->temperature;
+        if (!same_mode && rects_overlap(merged, later->area)) {
+            return false;
+        }
+    }
+    pending->area = merged;
+    return true;
+}
 
-            memcpy(lbb + (x / 2), lfb + (x / 2), (x_last - x + 1) / 2);
+/**
+ * Queue an update, merging it into the last queued update of the same pixels
+ * if that one has the same mode and the merged area is not larger than both.
+ */
+static void queue_update(
+    EpdiyHighlevelState* state, enum EpdDrawMode mode, int temperature, EpdRect area
+) {
+    for (int i = state->num_pending - 1; i >= 0; i--) {
+        EpdHlPendingUpdate* pending = &state->pending[i];
+        if (!rects_overlap(area, pending->area)) {
+            continue;
+        }
+        if (pending->mode == mode && pending->temperature == temperature
+            && merge_pending_update(state, i, area)) {
+            return;
         }
+        break;
     }
 
-    uint32_t tm2_start = esp_timer_get_time() / 1000;
+    // the update in progress finishing makes room
+    while (state->num_pending == EPD_HL_MAX_PENDING_UPDATES) {
+        state->post_error |= epd_draw_wait();
+        epd_hl_process_updates(state);
+    }
+    EpdHlPendingUpdate update = { .area = area, .mode = mode, .temperature = temperature };
+    state->pending[state->num_pending++] = update;
+}
 
-    // Restore framebuffers if they were mirrored (second mirroring)
-    if (mirror_x) {
-        epd_hl_mirror_framebuffer_horizontal(state->front_fb, epd_width(), epd_height());
-        epd_hl_mirror_framebuffer_horizontal(state->back_fb, epd_width(), epd_height());
+enum EpdDrawError epd_hl_post_update(
+    EpdiyHighlevelState* state, enum EpdDrawMode mode, int temperature, EpdRect area
+) {
+    assert(state != NULL);
+    if (state->difference_fb == NULL) {
+        return epd_hl_update_area(state, mode, temperature, area);
     }
 
-    uint32_t tm2_end = esp_timer_get_time() / 1000;
+    area = _inverse_rotated_area(area.x, area.y, area.width, area.height);
+    state->posted = true;
+    epd_hl_process_updates(state);
+    if (overlaps_pending(state, area, state->num_pending) || epd_draw_is_driving(area)) {
+        queue_update(state, mode, temperature, area);
+        return EPD_DRAW_SUCCESS;
+    }
+    return start_posted_update(state, mode, temperature, area);
+}
 
-    ESP_LOGI(
-        "epdiy",
-        "mirror: %dms, rot: %dms, diff: %dms, draw: %dms, buffer update: %dms, mirror_rev: %dms, "
-        "total: %dms",
-        tm1 - ts,             // First mirroring time
-        tr - tm1,             // Rotation time
-        t1 - tr,              // Difference calculation time
-        t2 - t1,              // Drawing time
-        tm2_start - t2,       // Buffer update time
-        tm2_end - tm2_start,  // Second mirroring time
-        tm2_end - ts          // Total time
-    );
+int epd_hl_process_updates(EpdiyHighlevelState* state) {
+    assert(state != NULL);
+    int kept = 0;
+    for (int i = 0; i < state->num_pending; i++) {
+        EpdHlPendingUpdate update = state->pending[i];
+        // updates must not overtake earlier ones of the same pixels
+        if (overlaps_pending(state, update.area, kept) || epd_draw_is_driving(update.area)) {
+            state->pending[kept++] = update;
+            continue;
+        }
+        state->post_error
+            |= start_posted_update(state, update.mode, update.temperature, update.area);
+    }
+    state->num_pending = kept;
+    return kept;
+}
 
+enum EpdDrawError epd_hl_wait_updates(EpdiyHighlevelState* state) {
+    assert(state != NULL);
+    if (!state->posted) {
+        return EPD_DRAW_SUCCESS;
+    }
+    while (epd_hl_process_updates(state) > 0) {
+        state->post_error |= epd_draw_wait();
+    }
+    enum EpdDrawError err = state->post_error | epd_draw_wait();
+    state->post_error = EPD_DRAW_SUCCESS;
+    state->posted = false;
     return err;
 }
 
@@ -345,6 +424,21 @@ void epd_hl_set_all_white(EpdiyHighlevelState* state) {
     assert(state != NULL);
     int fb_size = epd_width() / 2 * epd_height();
     memset(state->front_fb, 0xFF, fb_size);
+    epd_hl_mark_changed(state, epd_full_screen());
+}
+
+void epd_hl_mark_changed(EpdiyHighlevelState* state, EpdRect area) {
+    assert(state != NULL);
+    if (state->row_changes == NULL) {
+        return;
+    }
+    EpdRect rotated = _inverse_rotated_area(area.x, area.y, area.width, area.height);
+    int x_start = max(rotated.x, 0);
+    int x_end = min(rotated.x + rotated.width, epd_width());
+    int y_end = min(rotated.y + rotated.height, epd_height());
+    for (int y = max(rotated.y, 0); y < y_end && x_start < x_end; y++) {
+        epd_mark_row_changes(state->front_fb, y, x_start, x_end);
+    }
 }
 
 void epd_fullclear(EpdiyHighlevelState* state, int temperature) {
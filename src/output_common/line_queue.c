@@ -1,12 +1,14 @@
 #include <assert.h>
 #include <esp_attr.h>
 #include <esp_heap_caps.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "line_queue.h"
 #include "render_method.h"
+#include "render_stats.h"
 
 static inline int ceil_div(int x, int y) {
     return x / y + (x % y != 0);
@@ -14,22 +16,27 @@ static inline int ceil_div(int x, int y) {
 
 /// Initialize the line queue and allocate memory.
 LineQueue_t lq_init(int queue_len, int element_size) {
+    // an element must not be free and ready for different lines at the same time
+    assert(queue_len >= 2);
+
     LineQueue_t queue;
     queue.element_size = element_size;
     queue.size = queue_len;
-    queue.current = 0;
-    queue.last = 0;
 
     int elem_buf_size = ceil_div(element_size, 16) * 16;
 
     queue.bufs = calloc(queue.size, sizeof(uint8_t*));
     assert(queue.bufs != NULL);
+    queue.sequence = calloc(queue.size, sizeof(atomic_int));
+    assert(queue.sequence != NULL);
 
     for (int i = 0; i < queue.size; i++) {
         queue.bufs[i] = heap_caps_aligned_alloc(16, elem_buf_size, MALLOC_CAP_INTERNAL);
         assert(queue.bufs[i] != NULL);
     }
 
+    lq_reset(&queue);
+    lq_reset_stats(&queue);
     return queue;
 }
 
@@ -40,47 +47,71 @@ void lq_free(LineQueue_t* queue) {
     }
 
     free(queue->bufs);
+    free(queue->sequence);
 }
 
-uint8_t* IRAM_ATTR lq_current(LineQueue_t* queue) {
-    int current = atomic_load_explicit(&queue->current, memory_order_acquire);
-    int last = atomic_load_explicit(&queue->last, memory_order_acquire);
-
-    if ((current + 1) % queue->size == last) {
+uint8_t* IRAM_ATTR lq_current(LineQueue_t* queue, int line) {
+    int index = line % queue->size;
+    if (atomic_load_explicit(&queue->sequence[index], memory_order_acquire) != line) {
         return NULL;
     }
-    return queue->bufs[current];
+    return queue->bufs[index];
 }
 
-void IRAM_ATTR lq_commit(LineQueue_t* queue) {
-    int current = atomic_load_explicit(&queue->current, memory_order_acquire);
-
-    if (current == queue->size - 1) {
-        queue->current = 0;
-    } else {
-        atomic_fetch_add(&queue->current, 1);
+void IRAM_ATTR lq_commit(LineQueue_t* queue, int line) {
+#if EPD_RENDER_STATS
+    int fill = atomic_fetch_add_explicit(&queue->fill, 1, memory_order_relaxed) + 1;
+    int high_water = atomic_load_explicit(&queue->high_water, memory_order_relaxed);
+    while (fill > high_water
+           && !atomic_compare_exchange_weak_explicit(
+               &queue->high_water, &high_water, fill, memory_order_relaxed, memory_order_relaxed
+           )) {
     }
+#endif
+
+    atomic_store_explicit(&queue->sequence[line % queue->size], line + 1, memory_order_release);
 }
 
-int IRAM_ATTR lq_read(LineQueue_t* queue, uint8_t* dst) {
-    int current = atomic_load_explicit(&queue->current, memory_order_acquire);
-    int last = atomic_load_explicit(&queue->last, memory_order_acquire);
+uint8_t* IRAM_ATTR lq_read(LineQueue_t* queue, int line) {
+    int index = line % queue->size;
+    if (atomic_load_explicit(&queue->sequence[index], memory_order_acquire) != line + 1) {
+#if EPD_RENDER_STATS
+        if (queue->underrun_line != line) {
+            queue->underrun_line = line;
+            atomic_fetch_add_explicit(&queue->underruns, 1, memory_order_relaxed);
+        }
+#endif
+        return NULL;
+    }
 
-    if (current == last) {
-        return -1;
+#if EPD_RENDER_STATS
+    int fill = atomic_load_explicit(&queue->fill, memory_order_relaxed);
+    if (fill < queue->low_water) {
+        queue->low_water = fill;
     }
+#endif
+    return queue->bufs[index];
+}
 
-    memcpy(dst, queue->bufs[last], queue->element_size);
+void IRAM_ATTR lq_release(LineQueue_t* queue, int line) {
+#if EPD_RENDER_STATS
+    atomic_fetch_sub_explicit(&queue->fill, 1, memory_order_relaxed);
+#endif
+    atomic_store_explicit(
+        &queue->sequence[line % queue->size], line + queue->size, memory_order_release
+    );
+}
 
-    if (last == queue->size - 1) {
-        queue->last = 0;
-    } else {
-        atomic_fetch_add(&queue->last, 1);
+void IRAM_ATTR lq_reset(LineQueue_t* queue) {
+    for (int i = 0; i < queue->size; i++) {
+        queue->sequence[i] = i;
     }
-    return 0;
+    queue->fill = 0;
+    queue->underrun_line = -1;
 }
 
-void IRAM_ATTR lq_reset(LineQueue_t* queue) {
-    queue->current = 0;
-    queue->last = 0;
+void lq_reset_stats(LineQueue_t* queue) {
+    queue->high_water = 0;
+    queue->low_water = INT_MAX;
+    queue->underruns = 0;
 }
@@ -5,15 +5,35 @@
 #include <stddef.h>
 #include <stdint.h>
 
-/// Circular line queue with atomic read / write operations
-/// and accelerated masking on the output buffer.
+/// Ordered circular line queue, shared by any number of producers.
+///
+/// Line `l` of a frame is always held by element `l % size`, so producers
+/// may prepare lines in any order while the consumer reads them in display order.
+/// Elements are handed out instead of copied: Producers write a line in place
+/// and commit it, the consumer reads it in place and releases it afterwards.
 typedef struct {
     int size;
-    atomic_int current;
-    atomic_int last;
     uint8_t** bufs;
+    /// Per element: `l` if it is free for line `l`,
+    /// `l + 1` if it holds line `l` ready to be read.
+    atomic_int* sequence;
     // size of an element
     size_t element_size;
+
+    /// Statistics below are only recorded with `EPD_RENDER_STATS`.
+
+    /// Number of committed lines not yet released.
+    atomic_int fill;
+    /// Highest number of committed lines not yet released since the last stats reset.
+    atomic_int high_water;
+    /// Lowest number of committed lines not yet released when a line was read
+    /// since the last stats reset. `INT_MAX` if no line was read.
+    int low_water;
+    /// Number of lines the consumer wanted to read before they were ready
+    /// since the last stats reset.
+    atomic_int underruns;
+    /// Last line that was counted as an underrun, to count every line only once.
+    int underrun_line;
 } LineQueue_t;
 
 /// Initialize the line queue and allocate memory.
@@ -22,19 +42,26 @@ LineQueue_t lq_init(int queue_len, int element_size);
 /// Deinitialize the line queue and free memory.
 void lq_free(LineQueue_t* queue);
 
-/// Pointer to the next empty element in the line queue.
+/// Pointer to the element to write line `line` to.
 ///
-/// NULL if the queue is currently full.
-uint8_t* lq_current(LineQueue_t* queue);
+/// NULL if the element still holds an earlier line.
+uint8_t* lq_current(LineQueue_t* queue, int line);
 
-/// Advance the line queue.
-void lq_commit(LineQueue_t* queue);
+/// Mark line `line` as ready to be read.
+void lq_commit(LineQueue_t* queue, int line);
 
-/// Read from the line queue.
+/// Pointer to the element holding line `line`, to be released with `lq_release()`.
 ///
-/// Returns 0 for a successful read to `dst`, -1 for a failed read (empty queue).
-int lq_read(LineQueue_t* queue, uint8_t* dst);
+/// NULL if the line is not ready yet, which is counted as an underrun
+/// with `EPD_RENDER_STATS`.
+uint8_t* lq_read(LineQueue_t* queue, int line);
 
-/// Reset the queue into an empty state.
+/// Release the element holding line `line` for re-use.
+void lq_release(LineQueue_t* queue, int line);
+
+/// Reset the queue into an empty state, to start again at line 0.
 /// This operation is *not* atomic!
 void lq_reset(LineQueue_t* queue);
+
+/// Reset the high-water mark and underrun counter.
+void lq_reset_stats(LineQueue_t* queue);
@@ -171,7 +171,7 @@ void IRAM_ATTR calc_epd_input_1ppB_1k_S3_VE_aligned(
     const uint32_t* ld, uint8_t* epd_input, const uint8_t* conversion_lut, uint32_t epd_width
 );
 
-#ifdef RENDER_METHOD_I2S
+#ifndef RENDER_METHOD_LCD
 void calc_epd_input_1ppB_1k_S3_VE_aligned(
     const uint32_t* ld, uint8_t* epd_input, const uint8_t* conversion_lut, uint32_t epd_width
 ) {
@@ -211,13 +211,30 @@ void IRAM_ATTR calc_epd_input_1ppB_1k_S3_VE(
 
 /**
  * Calculate EPD input for a difference image with one pixel per byte.
+ * Each word of input holds the 4 pixels of an output byte, which are looked up in pairs.
  */
 __attribute__((optimize("O3"))) void IRAM_ATTR calc_epd_input_1ppB_64k(
     const uint32_t* ld, uint8_t* epd_input, const uint8_t* conversion_lut, uint32_t epd_width
 ) {
-    const uint16_t* lp = (uint16_t*)ld;
     for (uint32_t j = 0; j < epd_width / 4; j++) {
-        epd_input[j] = (conversion_lut[lp[2 * j + 1]] << 4) | conversion_lut[lp[2 * j]];
+        uint32_t v = ld[j];
+        epd_input[j] = (conversion_lut[v >> 16] << 4) | conversion_lut[v & 0xFFFF];
+    }
+}
+
+/**
+ * Calculate EPD input for a difference image with one pixel per byte,
+ * using the 1k LUT of `build_2ppB_lut_1k()`: Every pixel is looked up on its own
+ * in the copy of the transition table shifted to its output position.
+ */
+__attribute__((optimize("O3"))) void IRAM_ATTR calc_epd_input_1ppB_1k(
+    const uint32_t* ld, uint8_t* epd_input, const uint8_t* conversion_lut, uint32_t epd_width
+) {
+    for (uint32_t j = 0; j < epd_width / 4; j++) {
+        uint32_t v = ld[j];
+        epd_input[j] = conversion_lut[v & 0xFF] | (conversion_lut + 0x100)[(v >> 8) & 0xFF]
+                       | (conversion_lut + 0x200)[(v >> 16) & 0xFF]
+                       | (conversion_lut + 0x300)[v >> 24];
     }
 }
 
@@ -225,9 +242,21 @@ __attribute__((optimize("O3"))) void IRAM_ATTR calc_epd_input_2ppB_lut_64k(
     const uint32_t* line_data, uint8_t* epd_input, const uint8_t* conversion_lut, uint32_t epd_width
 ) {
     const uint16_t* line_data_16 = (const uint16_t*)line_data;
+    uint32_t len = epd_width / 4;
+    uint32_t j = 0;
 
-    for (uint32_t j = 0; j < epd_width / 4; j++) {
-        epd_input[j] = conversion_lut[*(line_data_16++)];
+    // read a word of input for every two output bytes
+    if ((uintptr_t)line_data_16 % 4 && len > 0) {
+        epd_input[j++] = conversion_lut[*(line_data_16++)];
+    }
+    const uint32_t* line_data_32 = (const uint32_t*)line_data_16;
+    for (; j + 2 <= len; j += 2) {
+        uint32_t v = *(line_data_32++);
+        epd_input[j] = conversion_lut[v & 0xFFFF];
+        epd_input[j + 1] = conversion_lut[v >> 16];
+    }
+    if (j < len) {
+        epd_input[j] = conversion_lut[*(const uint16_t*)line_data_32];
     }
 }
 
@@ -264,10 +293,22 @@ __attribute__((optimize("O3"))) void IRAM_ATTR calc_epd_input_2ppB_1k_lut(
     uint32_t epd_width
 ) {
     const uint16_t* line_data_16 = (const uint16_t*)ld;
+    uint32_t len = epd_width / 4;
+    uint32_t j = 0;
 
-    for (uint32_t j = 0; j < epd_width / 4; j++) {
-        epd_input[j] = lookup_pixels_2ppB_1k(*(line_data_16++), conversion_lut, from);
-    };
+    // read a word of input for every two output bytes
+    if ((uintptr_t)line_data_16 % 4 && len > 0) {
+        epd_input[j++] = lookup_pixels_2ppB_1k(*(line_data_16++), conversion_lut, from);
+    }
+    const uint32_t* line_data_32 = (const uint32_t*)line_data_16;
+    for (; j + 2 <= len; j += 2) {
+        uint32_t v = *(line_data_32++);
+        epd_input[j] = lookup_pixels_2ppB_1k(v & 0xFFFF, conversion_lut, from);
+        epd_input[j + 1] = lookup_pixels_2ppB_1k(v >> 16, conversion_lut, from);
+    }
+    if (j < len) {
+        epd_input[j] = lookup_pixels_2ppB_1k(*(const uint16_t*)line_data_32, conversion_lut, from);
+    }
 }
 
 __attribute__((optimize("O3"))) void IRAM_ATTR calc_epd_input_2ppB_1k_lut_white(
@@ -287,6 +328,7 @@ __attribute__((optimize("O3"))) void IRAM_ATTR calc_epd_input_2ppB_1k_lut_black(
 
 /**
  * Unpack the waveform data into a lookup table, with bit shifted copies.
+ * The table holds every transition, so it serves 1ppB difference images as well.
  */
 __attribute__((optimize("O3"))) static void IRAM_ATTR
 build_2ppB_lut_1k(uint8_t* lut, const EpdWaveformPhases* phases, int frame) {
@@ -419,6 +461,105 @@ static void build_2ppB_lut_64k_from_15(uint8_t* lut, const EpdWaveformPhases* ph
     build_2ppB_lut_64k_static_from(lut, phases, 0xF, frame);
 }
 
+///////////////////////////// Patch Lookup Tables
+//////////////////////////////////
+
+/// Maximum number of changed transitions for which patching
+/// a 1ppB 64k LUT is cheaper than rebuilding it.
+#define PATCH_1PPB_64K_MAX_CHANGES 32
+/// Maximum number of changed target colors for which patching
+/// a 2ppB 64k LUT is cheaper than rebuilding it.
+#define PATCH_2PPB_64K_MAX_CHANGES 2
+
+/**
+ * Get the 2-bit output of the transition `from` -> `to` in a packed waveform phase.
+ */
+static inline uint8_t phase_transition(const uint8_t* phase, uint8_t from, uint8_t to) {
+    return (phase[(to << 2) + (from >> 2)] >> (6 - 2 * (from & 3))) & 0x03;
+}
+
+/**
+ * Patch a LUT built by `build_1ppB_lut_64k`, where each entry
+ * is the combination of two transitions: `lut[o << 8 | i] = v(i) | v(o) << 2`.
+ * For every changed transition, one row and one column of the LUT are rewritten.
+ */
+__attribute__((optimize("O3"))) static bool IRAM_ATTR
+patch_1ppB_lut_64k(uint8_t* lut, const uint8_t* prev_phase, const uint8_t* next_phase) {
+    uint8_t values[256];
+    uint8_t changed[PATCH_1PPB_64K_MAX_CHANGES];
+    int num_changed = 0;
+
+    for (int i = 0; i < 256; i++) {
+        values[i] = phase_transition(next_phase, i & 0xF, i >> 4);
+        if (values[i] != phase_transition(prev_phase, i & 0xF, i >> 4)) {
+            if (num_changed == PATCH_1PPB_64K_MAX_CHANGES) {
+                return false;
+            }
+            changed[num_changed++] = i;
+        }
+    }
+
+    for (int c = 0; c < num_changed; c++) {
+        uint8_t e = changed[c];
+        uint8_t* row = &lut[e << 8];
+        for (int i = 0; i < 256; i++) {
+            row[i] = values[i] | (values[e] << 2);
+            lut[(i << 8) | e] = values[e] | (values[i] << 2);
+        }
+    }
+    return true;
+}
+
+/**
+ * Patch a LUT built by `build_2ppB_lut_64k_static_from`.
+ * Each of the four pixel nibbles of an index determines two bits of the entry,
+ * so for each changed target color only the bits of matching nibbles are rewritten.
+ */
+__attribute__((optimize("O3"))) static bool IRAM_ATTR patch_2ppB_lut_64k_static_from(
+    uint8_t* lut, const uint8_t* prev_phase, const uint8_t* next_phase, uint8_t from
+) {
+    uint8_t changed[PATCH_2PPB_64K_MAX_CHANGES];
+    int num_changed = 0;
+
+    for (uint8_t to = 0; to < 16; to++) {
+        if (phase_transition(next_phase, from, to) != phase_transition(prev_phase, from, to)) {
+            if (num_changed == PATCH_2PPB_64K_MAX_CHANGES) {
+                return false;
+            }
+            changed[num_changed++] = to;
+        }
+    }
+
+    for (int c = 0; c < num_changed; c++) {
+        uint8_t to = changed[c];
+        uint8_t v = phase_transition(next_phase, from, to);
+        for (int nibble = 0; nibble < 4; nibble++) {
+            int shift = 4 * nibble;
+            uint32_t low_mask = (1 << shift) - 1;
+            uint8_t keep = ~(0x03 << (2 * nibble));
+            uint8_t set = v << (2 * nibble);
+            // iterate over all combinations of the other three nibbles
+            for (uint32_t rest = 0; rest < 1 << 12; rest++) {
+                uint32_t index = ((rest & ~low_mask) << 4) | (to << shift) | (rest & low_mask);
+                lut[index] = (lut[index] & keep) | set;
+            }
+        }
+    }
+    return true;
+}
+
+static bool patch_2ppB_lut_64k_from_0(
+    uint8_t* lut, const uint8_t* prev_phase, const uint8_t* next_phase
+) {
+    return patch_2ppB_lut_64k_static_from(lut, prev_phase, next_phase, 0);
+}
+
+static bool patch_2ppB_lut_64k_from_15(
+    uint8_t* lut, const uint8_t* prev_phase, const uint8_t* next_phase
+) {
+    return patch_2ppB_lut_64k_static_from(lut, prev_phase, next_phase, 0xF);
+}
+
 static void build_8ppB_lut_256b_from_white(
     uint8_t* lut, const EpdWaveformPhases* phases, int frame
 ) {
@@ -441,6 +582,7 @@ LutFunctionPair find_lut_functions(enum EpdDrawMode mode, uint32_t lut_size) {
     LutFunctionPair pair;
     pair.build_func = NULL;
     pair.lookup_func = NULL;
+    pair.patch_func = NULL;
 
     if (mode & MODE_PACKING_1PPB_DIFFERENCE) {
         if (EPD_CURRENT_RENDER_METHOD == RENDER_METHOD_LCD && !(mode & MODE_FORCE_NO_PIE)
@@ -451,6 +593,11 @@ LutFunctionPair find_lut_functions(enum EpdDrawMode mode, uint32_t lut_size) {
         } else if (lut_size >= 1 << 16) {
             pair.build_func = &build_1ppB_lut_64k;
             pair.lookup_func = &calc_epd_input_1ppB_64k;
+            pair.patch_func = &patch_1ppB_lut_64k;
+            return pair;
+        } else if (lut_size >= 1024) {
+            pair.build_func = &build_2ppB_lut_1k;
+            pair.lookup_func = &calc_epd_input_1ppB_1k;
             return pair;
         }
     } else if (mode & MODE_PACKING_2PPB) {
@@ -458,10 +605,12 @@ LutFunctionPair find_lut_functions(enum EpdDrawMode mode, uint32_t lut_size) {
             if (mode & PREVIOUSLY_WHITE) {
                 pair.build_func = &build_2ppB_lut_64k_from_15;
                 pair.lookup_func = &calc_epd_input_2ppB_lut_64k;
+                pair.patch_func = &patch_2ppB_lut_64k_from_15;
                 return pair;
             } else if (mode & PREVIOUSLY_BLACK) {
                 pair.build_func = &build_2ppB_lut_64k_from_0;
                 pair.lookup_func = &calc_epd_input_2ppB_lut_64k;
+                pair.patch_func = &patch_2ppB_lut_64k_from_0;
                 return pair;
             }
         } else if (lut_size >= 1024) {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include "epdiy.h"
 
@@ -20,9 +21,22 @@ typedef void (*lut_func_t)(
  */
 typedef void (*lut_build_func_t)(uint8_t* lut, const EpdWaveformPhases* phases, int frame);
 
+/**
+ * Type signature of a LUT patching function.
+ *
+ * Updates a LUT built from the (64 byte) waveform phase `prev_phase`
+ * to match `next_phase`, rewriting only entries affected by the change.
+ * Returns false without modifying the LUT if a full rebuild is cheaper.
+ */
+typedef bool (*lut_patch_func_t)(
+    uint8_t* lut, const uint8_t* prev_phase, const uint8_t* next_phase
+);
+
 typedef struct {
     lut_build_func_t build_func;
     lut_func_t lookup_func;
+    /// Optional, NULL if the LUT is cheap to rebuild.
+    lut_patch_func_t patch_func;
 } LutFunctionPair;
 
 /**
@@ -1,11 +1,13 @@
 #include "render_context.h"
 
+#include <assert.h>
 #include <string.h>
 #include "esp_log.h"
 
 #include "../epdiy.h"
 #include "lut.h"
 #include "render_method.h"
+#include "render_stats.h"
 
 /// For waveforms without timing and the I2S diving method,
 /// the default hold time for each line is 12us
@@ -15,6 +17,21 @@ static inline int min(int x, int y) {
     return x < y ? x : y;
 }
 
+static inline int max(int x, int y) {
+    return x > y ? x : y;
+}
+
+int render_queue_lines(enum EpdInitOptions options, int render_threads) {
+    // the queue length is given per render thread
+    int queue_len = 32;
+    if (options & EPD_FEED_QUEUE_32) {
+        queue_len = 32;
+    } else if (options & EPD_FEED_QUEUE_8) {
+        queue_len = 8;
+    }
+    return max(queue_len * render_threads, FRAME_START_LINES);
+}
+
 void get_buffer_params(
     RenderContext_t* ctx,
     int* bytes_per_line,
@@ -33,7 +50,11 @@ void get_buffer_params(
     // number of pixels per byte of input data
     int width_divider = 0;
 
-    if (mode & MODE_PACKING_1PPB_DIFFERENCE) {
+    if (ctx->difference_from != NULL) {
+        // 4bpp framebuffers, interlaced to 1ppB while feeding
+        *bytes_per_line = area.width / 2 + area.width % 2;
+        width_divider = 2;
+    } else if (mode & MODE_PACKING_1PPB_DIFFERENCE) {
         *bytes_per_line = area.width;
         width_divider = 1;
     } else if (mode & MODE_PACKING_2PPB) {
@@ -65,28 +86,480 @@ void get_buffer_params(
     *min_y = area.y + crop_y;
     *max_y = min(*min_y + (vertically_cropped ? crop_h : area.height), area.height);
     *start_ptr = ptr_start;
-    *pixels_per_byte = width_divider;
+    *pixels_per_byte = ctx->difference_from != NULL ? 1 : width_divider;
 }
 
-void IRAM_ATTR prepare_context_for_next_frame(RenderContext_t* ctx) {
-    int frame_time = DEFAULT_FRAME_TIME;
-    if (ctx->phase_times != NULL) {
-        frame_time = ctx->phase_times[ctx->current_frame];
+static inline const EpdWaveformPhases* current_phases(RenderContext_t* ctx) {
+    return ctx->waveform->mode_data[ctx->waveform_index]->range_data[ctx->waveform_range];
+}
+
+/**
+ * Check if a LUT buffer already holds the LUT for a waveform phase.
+ */
+static inline bool lut_matches(
+    lut_build_func_t build_func, const LutBufferState* state, const uint8_t* phase
+) {
+    return state->build_func == build_func
+           && memcmp(state->phase, phase, WAVEFORM_PHASE_SIZE) == 0;
+}
+
+/**
+ * Bring a LUT buffer up to date for `frame`.
+ * Identical phases are skipped, small changes are patched if possible.
+ */
+static enum RenderStatsLut IRAM_ATTR update_lut(
+    lut_build_func_t build_func,
+    lut_patch_func_t patch_func,
+    uint8_t* lut,
+    LutBufferState* state,
+    const EpdWaveformPhases* phases,
+    int frame
+) {
+    const uint8_t* phase = phases->luts + WAVEFORM_PHASE_SIZE * frame;
+    if (lut_matches(build_func, state, phase)) {
+        return RENDER_STATS_LUT_REUSED;
     }
 
-    if (ctx->mode & MODE_EPDIY_MONOCHROME) {
-        frame_time = MONOCHROME_FRAME_TIME;
+    bool patched = state->build_func == build_func && patch_func != NULL
+                   && patch_func(lut, state->phase, phase);
+    if (!patched) {
+        assert(build_func != NULL);
+        build_func(lut, phases, frame);
+        state->build_func = build_func;
     }
-    ctx->frame_time = frame_time;
+    memcpy(state->phase, phase, WAVEFORM_PHASE_SIZE);
+    return patched ? RENDER_STATS_LUT_PATCHED : RENDER_STATS_LUT_BUILT;
+}
 
-    const EpdWaveformPhases* phases
-        = ctx->waveform->mode_data[ctx->waveform_index]->range_data[ctx->waveform_range];
+/**
+ * Time of a frame drawn with waveform phase `frame` in a mode, in 1/10us.
+ */
+static inline int phase_frame_time(
+    enum EpdDrawMode mode, const EpdWaveformPhases* phases, int frame
+) {
+    if (mode & MODE_EPDIY_MONOCHROME) {
+        return MONOCHROME_FRAME_TIME;
+    }
+    if (phases->phase_times != NULL) {
+        return phases->phase_times[frame];
+    }
+    return DEFAULT_FRAME_TIME;
+}
+
+/**
+ * Bring the LUT in `lut` up to date for `frame`, swapping it with `lut_next`
+ * if that one was prepared for the frame while the previous frame was output.
+ */
+static void IRAM_ATTR prepare_frame_lut(
+    lut_build_func_t build_func,
+    lut_patch_func_t patch_func,
+    uint8_t** lut,
+    LutBufferState* state,
+    uint8_t** lut_next,
+    LutBufferState* next_state,
+    const EpdWaveformPhases* phases,
+    int frame
+) {
+    uint32_t lut_start = render_stats_timestamp();
+    const uint8_t* phase = phases->luts + WAVEFORM_PHASE_SIZE * frame;
+
+    // use the LUT prepared while outputting the previous frame
+    if (!lut_matches(build_func, state, phase) && lut_matches(build_func, next_state, phase)) {
+        uint8_t* tmp = *lut;
+        *lut = *lut_next;
+        *lut_next = tmp;
 
-    assert(ctx->lut_build_func != NULL);
-    ctx->lut_build_func(ctx->conversion_lut, phases, ctx->current_frame);
+        LutBufferState tmp_state = *state;
+        *state = *next_state;
+        *next_state = tmp_state;
+    }
+    enum RenderStatsLut lut_outcome
+        = update_lut(build_func, patch_func, *lut, state, phases, frame);
+    render_stats_lut_done(lut_outcome, lut_start);
+}
+
+/**
+ * Bring the LUTs of the active additional modes of a multi-mode draw up to date.
+ * The frame lasts as long as the longest phase of all active modes.
+ */
+static void IRAM_ATTR prepare_mode_slots(RenderContext_t* ctx) {
+    for (int i = 0; i < ctx->num_mode_slots; i++) {
+        RenderModeSlot* slot = &ctx->mode_slots[i];
+        if (!slot->active) {
+            continue;
+        }
+        int frame = ctx->current_frame - slot->start_frame;
+        prepare_frame_lut(
+            slot->lut_functions.build_func,
+            slot->lut_functions.patch_func,
+            &slot->lut,
+            &slot->lut_state,
+            &slot->lut_next,
+            &slot->lut_next_state,
+            slot->phases,
+            frame
+        );
+        int frame_time = phase_frame_time(slot->mode, slot->phases, frame);
+        if (frame_time > ctx->frame_time) {
+            ctx->frame_time = frame_time;
+        }
+    }
+}
 
+/**
+ * Bring the main LUT up to date for the current frame.
+ */
+static void IRAM_ATTR prepare_main_lut(RenderContext_t* ctx) {
+    const EpdWaveformPhases* phases = current_phases(ctx);
+    ctx->frame_time = phase_frame_time(ctx->mode, phases, ctx->current_frame);
+    prepare_frame_lut(
+        ctx->lut_build_func,
+        ctx->lut_patch_func,
+        &ctx->conversion_lut,
+        &ctx->lut_state,
+        &ctx->conversion_lut_next,
+        &ctx->lut_next_state,
+        phases,
+        ctx->current_frame
+    );
+}
+
+void add_context_region(RenderContext_t* ctx, EpdRect r, int slot) {
+    int j = ctx->num_regions++;
+    while (j > 0 && ctx->regions[j - 1].x > r.x) {
+        ctx->regions[j] = ctx->regions[j - 1];
+        ctx->region_slot[j] = ctx->region_slot[j - 1];
+        j--;
+    }
+    ctx->regions[j] = r;
+    ctx->region_slot[j] = slot;
+}
+
+/**
+ * Check if mode slot `slot` is done with all its phases before the current frame.
+ * Slot 0 is the draw mode.
+ */
+static inline bool slot_done(RenderContext_t* ctx, int slot) {
+    if (slot == 0) {
+        return ctx->current_frame >= ctx->main_frames;
+    }
+    const RenderModeSlot* s = &ctx->mode_slots[slot - 1];
+    return s->start_frame >= 0 && ctx->current_frame >= s->start_frame + s->frames;
+}
+
+/**
+ * Let the regions waiting to join a pipelined draw start with the current frame,
+ * and drop the regions that are done. Must be called with `join_lock` taken.
+ */
+static void IRAM_ATTR apply_joined_regions(RenderContext_t* ctx) {
+    // regions that are done make room for new ones
+    int kept = 0;
+    for (int i = 0; i < ctx->num_regions; i++) {
+        if (!slot_done(ctx, ctx->region_slot[i])) {
+            ctx->regions[kept] = ctx->regions[i];
+            ctx->region_slot[kept] = ctx->region_slot[i];
+            kept++;
+        }
+    }
+    ctx->num_regions = kept;
+    for (int i = 0; i < ctx->num_mode_slots; i++) {
+        if (ctx->mode_slots[i].in_use && slot_done(ctx, i + 1)) {
+            ctx->mode_slots[i].in_use = false;
+        }
+    }
+
+    for (int i = 0; i < ctx->num_joined; i++) {
+        int slot = ctx->joined_slot[i];
+        RenderModeSlot* s = &ctx->mode_slots[slot - 1];
+        if (s->start_frame < 0) {
+            s->start_frame = ctx->current_frame;
+            ctx->cycle_frames = max(ctx->cycle_frames, ctx->current_frame + s->frames);
+            ctx->num_mode_slots = max(ctx->num_mode_slots, slot);
+        }
+        add_context_region(ctx, ctx->joined_regions[i], slot);
+    }
+    ctx->num_joined = 0;
+
+    // regions joining during the last frame would never be drawn
+    if (ctx->current_frame + 1 >= ctx->cycle_frames) {
+        ctx->pipelined = false;
+    }
+}
+
+void IRAM_ATTR prepare_context_for_next_frame(RenderContext_t* ctx) {
     ctx->lines_prepared = 0;
     ctx->lines_consumed = 0;
+    lq_reset(&ctx->line_queue);
+
+    // Slots that are not in use may be set up by threads joining the draw,
+    // only active slots are safe to use without the lock.
+    xSemaphoreTake(ctx->join_lock, portMAX_DELAY);
+    if (ctx->pipelined) {
+        apply_joined_regions(ctx);
+    }
+    // with regions joined later, the draw mode may be done before the draw
+    ctx->main_active = ctx->current_frame < ctx->main_frames;
+    for (int i = 0; i < ctx->num_mode_slots; i++) {
+        RenderModeSlot* slot = &ctx->mode_slots[i];
+        int frame = ctx->current_frame - slot->start_frame;
+        slot->active = slot->in_use && slot->start_frame >= 0 && frame < slot->frames;
+    }
+    xSemaphoreGive(ctx->join_lock);
+
+    ctx->frame_time = 0;
+    if (ctx->main_active) {
+        prepare_main_lut(ctx);
+    }
+    prepare_mode_slots(ctx);
+    if (ctx->frame_time == 0) {
+        ctx->frame_time = DEFAULT_FRAME_TIME;
+    }
+}
+
+/**
+ * Build the LUT for `frame` of a mode in `lut_next`, unless `lut` already holds it.
+ */
+static void IRAM_ATTR prepare_next_lut(
+    lut_build_func_t build_func,
+    lut_patch_func_t patch_func,
+    const LutBufferState* state,
+    uint8_t* lut_next,
+    LutBufferState* next_state,
+    const EpdWaveformPhases* phases,
+    int frame
+) {
+    const uint8_t* phase = phases->luts + WAVEFORM_PHASE_SIZE * frame;
+    // the current LUT will be re-used
+    if (lut_next == NULL || lut_matches(build_func, state, phase)) {
+        return;
+    }
+    update_lut(build_func, patch_func, lut_next, next_state, phases, frame);
+}
+
+void IRAM_ATTR prepare_lut_for_following_frame(RenderContext_t* ctx) {
+    int frame = ctx->current_frame + 1;
+    if (frame < ctx->main_frames) {
+        prepare_next_lut(
+            ctx->lut_build_func,
+            ctx->lut_patch_func,
+            &ctx->lut_state,
+            ctx->conversion_lut_next,
+            &ctx->lut_next_state,
+            current_phases(ctx),
+            frame
+        );
+    }
+
+    // slots waiting to join start with the following frame
+    bool waiting[EPD_MAX_DRAW_REGIONS - 1];
+    xSemaphoreTake(ctx->join_lock, portMAX_DELAY);
+    for (int i = 0; i < EPD_MAX_DRAW_REGIONS - 1; i++) {
+        waiting[i] = ctx->mode_slots[i].in_use && ctx->mode_slots[i].start_frame < 0;
+    }
+    xSemaphoreGive(ctx->join_lock);
+
+    for (int i = 0; i < EPD_MAX_DRAW_REGIONS - 1; i++) {
+        RenderModeSlot* slot = &ctx->mode_slots[i];
+        if (waiting[i]) {
+            // the LUT of a waiting slot is not in use yet
+            update_lut(
+                slot->lut_functions.build_func,
+                slot->lut_functions.patch_func,
+                slot->lut,
+                &slot->lut_state,
+                slot->phases,
+                0
+            );
+        } else if (i < ctx->num_mode_slots && slot->active
+                   && frame - slot->start_frame < slot->frames) {
+            prepare_next_lut(
+                slot->lut_functions.build_func,
+                slot->lut_functions.patch_func,
+                &slot->lut_state,
+                slot->lut_next,
+                &slot->lut_next_state,
+                slot->phases,
+                frame - slot->start_frame
+            );
+        }
+    }
+}
+
+/// Alignment of the lookup span of a line in pixels,
+/// so that input data is word aligned for all packing modes.
+#define REGION_LOOKUP_ALIGN 32
+
+/**
+ * Clear the output of pixels `from` (inclusive) to `to` (exclusive) in a line buffer.
+ */
+static inline void clear_output_pixels(uint8_t* buf, int from, int to) {
+    while (from < to && from % 4 != 0) {
+        buf[from / 4] &= ~(0x03 << (2 * (from % 4)));
+        from++;
+    }
+    int aligned_to = to - to % 4;
+    if (from < aligned_to) {
+        memset(buf + from / 4, 0, (aligned_to - from) / 4);
+        from = aligned_to;
+    }
+    while (from < to) {
+        buf[from / 4] &= ~(0x03 << (2 * (from % 4)));
+        from++;
+    }
+}
+
+/**
+ * Get the span of display line `line` that is looked up, aligned to `REGION_LOOKUP_ALIGN`.
+ * Returns false if no pixels of the line are output.
+ */
+static bool IRAM_ATTR line_lookup_span(RenderContext_t* ctx, int line, int* start, int* end) {
+    int width = ctx->display_width;
+    if (ctx->num_regions == 0) {
+        *start = 0;
+        *end = width;
+        return true;
+    }
+
+    int region_start = width;
+    int region_end = 0;
+    for (int i = 0; i < ctx->num_regions; i++) {
+        EpdRect r = ctx->regions[i];
+        if (line >= r.y && line < r.y + r.height) {
+            region_start = min(region_start, r.x);
+            region_end = max(region_end, r.x + r.width);
+        }
+    }
+    if (region_start >= region_end) {
+        return false;
+    }
+
+    *start = region_start - region_start % REGION_LOOKUP_ALIGN;
+    int padding = (REGION_LOOKUP_ALIGN - region_end % REGION_LOOKUP_ALIGN) % REGION_LOOKUP_ALIGN;
+    *end = min(width, region_end + padding);
+    return true;
+}
+
+const uint8_t* IRAM_ATTR line_lookup_data(
+    RenderContext_t* ctx, int line, const uint8_t* line_data, uint8_t* scratch
+) {
+    if (ctx->difference_from == NULL) {
+        return line_data;
+    }
+
+    int start, end;
+    if (!line_lookup_span(ctx, line, &start, &end)) {
+        return scratch;
+    }
+
+    const uint8_t* to = line_data;
+    const uint8_t* from = ctx->difference_from + (line_data - ctx->data_ptr);
+    int width = ctx->display_width;
+    // same byte format as `_epd_interlace_line()`: new value in the high nibble
+    if (!ctx->mirror_x) {
+        for (int x = start; x < end; x += 2) {
+            uint8_t t = to[x / 2];
+            uint8_t f = from[x / 2];
+            scratch[x] = (t << 4) | (f & 0x0F);
+            scratch[x + 1] = (t & 0xF0) | (f >> 4);
+        }
+    } else {
+        for (int x = start; x < end; x += 2) {
+            uint8_t t = to[(width - 2 - x) / 2];
+            uint8_t f = from[(width - 2 - x) / 2];
+            scratch[x] = (t & 0xF0) | (f >> 4);
+            scratch[x + 1] = (t << 4) | (f & 0x0F);
+        }
+    }
+    return scratch;
+}
+
+/**
+ * Look up every region covering a line with the LUT of its mode.
+ * Lookups are aligned to `REGION_LOOKUP_ALIGN`, so output pixels of earlier regions
+ * in the first block of a region are saved and restored around its lookup.
+ */
+static void IRAM_ATTR lookup_line_per_mode(
+    RenderContext_t* ctx, int line, const uint8_t* line_data, int pixels_per_byte, uint8_t* buf
+) {
+    int width = ctx->display_width;
+    memset(buf, 0, width / 4);
+
+    for (int i = 0; i < ctx->num_regions; i++) {
+        EpdRect r = ctx->regions[i];
+        if (line < r.y || line >= r.y + r.height) {
+            continue;
+        }
+
+        lut_func_t lookup_func = ctx->lut_lookup_func;
+        const uint8_t* lut = ctx->conversion_lut;
+        if (ctx->region_slot[i] == 0 && !ctx->main_active) {
+            continue;
+        } else if (ctx->region_slot[i] > 0) {
+            const RenderModeSlot* slot = &ctx->mode_slots[ctx->region_slot[i] - 1];
+            if (!slot->active) {
+                continue;
+            }
+            lookup_func = slot->lut_functions.lookup_func;
+            lut = slot->lut;
+        }
+
+        int start = r.x - r.x % REGION_LOOKUP_ALIGN;
+        int end = r.x + r.width;
+        end += (REGION_LOOKUP_ALIGN - end % REGION_LOOKUP_ALIGN) % REGION_LOOKUP_ALIGN;
+        end = min(width, end);
+
+        uint8_t saved[REGION_LOOKUP_ALIGN / 4];
+        memcpy(saved, buf + start / 4, (r.x - start + 3) / 4);
+        lookup_func(
+            (const uint32_t*)(line_data + start / pixels_per_byte),
+            buf + start / 4,
+            lut,
+            end - start
+        );
+        for (int x = start; x < r.x; x++) {
+            uint8_t mask = 0x03 << (2 * (x % 4));
+            buf[x / 4] = (buf[x / 4] & ~mask) | (saved[(x - start) / 4] & mask);
+        }
+        clear_output_pixels(buf, r.x + r.width, end);
+    }
+}
+
+void IRAM_ATTR lookup_line_in_regions(
+    RenderContext_t* ctx, int line, const uint8_t* line_data, int pixels_per_byte, uint8_t* buf
+) {
+    int width = ctx->display_width;
+    if (ctx->num_mode_slots > 0) {
+        lookup_line_per_mode(ctx, line, line_data, pixels_per_byte, buf);
+        return;
+    }
+    if (ctx->num_regions == 0) {
+        ctx->lut_lookup_func((const uint32_t*)line_data, buf, ctx->conversion_lut, width);
+        return;
+    }
+
+    memset(buf, 0, width / 4);
+    int lookup_start, lookup_end;
+    if (!line_lookup_span(ctx, line, &lookup_start, &lookup_end)) {
+        return;
+    }
+
+    ctx->lut_lookup_func(
+        (const uint32_t*)(line_data + lookup_start / pixels_per_byte),
+        buf + lookup_start / 4,
+        ctx->conversion_lut,
+        lookup_end - lookup_start
+    );
+
+    // clear the output between regions
+    int x = lookup_start;
+    for (int i = 0; i < ctx->num_regions; i++) {
+        EpdRect r = ctx->regions[i];
+        if (line >= r.y && line < r.y + r.height) {
+            clear_output_pixels(buf, x, r.x);
+            x = r.x + r.width;
+        }
+    }
+    clear_output_pixels(buf, x, lookup_end);
 }
 
 void epd_populate_line_mask(uint8_t* line_mask, const uint8_t* dirty_columns, int mask_len) {
@@ -10,13 +10,66 @@
 #include "line_queue.h"
 #include "lut.h"
 
-#define NUM_RENDER_THREADS 2
+/// Maximum number of render threads.
+#define MAX_RENDER_THREADS 8
+/// Number of render threads if not configured otherwise.
+#define DEFAULT_RENDER_THREADS 2
+
+/// Number of queued lines the output of an LCD frame is started after.
+#define FRAME_START_LINES 64
+
+/// Size of the packed output data for one waveform phase.
+#define WAVEFORM_PHASE_SIZE (16 * 4)
+
+/**
+ * Contents of a LUT buffer, to avoid rebuilding it when
+ * consecutive waveform phases are identical.
+ */
+typedef struct {
+    /// Function the LUT was built with, NULL if the contents are unknown.
+    lut_build_func_t build_func;
+    /// Waveform phase the LUT was built from.
+    uint8_t phase[WAVEFORM_PHASE_SIZE];
+} LutBufferState;
+
+/**
+ * An additional waveform mode of a multi-mode draw, with its own LUT.
+ */
+typedef struct {
+    enum EpdDrawMode mode;
+    /// Waveform phases of the mode, drawn in the first `frames` frames.
+    const EpdWaveformPhases* phases;
+    int frames;
+    LutFunctionPair lut_functions;
+    /// LUT buffer, allocated on first use and kept until deinitialization.
+    uint8_t* lut;
+    /// Contents of `lut`.
+    LutBufferState lut_state;
+    /// Second LUT buffer, where the LUT for the next frame is built
+    /// while the current frame is output. NULL if not allocated.
+    uint8_t* lut_next;
+    /// Contents of `lut_next`.
+    LutBufferState lut_next_state;
+    /// Whether the mode has a phase in the current frame.
+    /// Regions of inactive modes are not driven, slots of active modes are in use.
+    bool active;
+    /// Frame the first phase is drawn in. -1 while waiting to join a draw.
+    int start_frame;
+    /// Whether the slot is used by the current draw.
+    bool in_use;
+} RenderModeSlot;
 
 typedef struct {
     EpdRect area;
     EpdRect crop_to;
     const bool* drawn_lines;
     const uint8_t* data_ptr;
+    /// When drawing the difference of two 4bpp framebuffers, the framebuffer of the
+    /// current display contents. `data_ptr` then points to the new contents.
+    /// NULL when drawing a prepared image.
+    const uint8_t* difference_from;
+    /// Horizontally mirror the framebuffers of a difference on the display.
+    bool mirror_x;
 
     /// The display width for quick access.
     int display_width;
@@ -33,11 +86,25 @@ typedef struct {
     /// number of frames in the current update cycle
     int cycle_frames;
 
-    TaskHandle_t feed_tasks[NUM_RENDER_THREADS];
-    SemaphoreHandle_t feed_done_smphr[NUM_RENDER_THREADS];
+    /// Number of render threads in use.
+    int num_render_threads;
+    TaskHandle_t feed_tasks[MAX_RENDER_THREADS];
+    SemaphoreHandle_t feed_done_smphr[MAX_RENDER_THREADS];
     SemaphoreHandle_t frame_done;
+    /// Available while no draw is in progress.
+    SemaphoreHandle_t draw_idle;
+    /// Task running asynchronous draws.
+    TaskHandle_t draw_task;
+    /// Called when the asynchronous draw in progress is done, may be NULL.
+    EpdDrawCallback draw_done_cb;
+    void* draw_done_data;
+    /// Result of the last draw.
+    enum EpdDrawError draw_result;
+    /// Whether `draw_result` was reported by `epd_draw_wait()`.
+    /// Until then, pipelined draws add their errors to it.
+    bool draw_result_read;
     /// Line buffers for feed tasks
-    uint8_t* feed_line_buffers[NUM_RENDER_THREADS];
+    uint8_t* feed_line_buffers[MAX_RENDER_THREADS];
 
     /// index of the waveform mode when using vendor waveforms.
     /// This is not necessarily the mode number if the waveform header
@@ -63,15 +130,60 @@ typedef struct {
     lut_func_t lut_lookup_func;
     /// LUT building function. Must not be NULL
     lut_build_func_t lut_build_func;
+    /// LUT patching function, may be NULL.
+    lut_patch_func_t lut_patch_func;
+    /// Contents of `conversion_lut`.
+    LutBufferState lut_state;
+
+    /// Second LUT buffer, where the LUT for the next frame is built
+    /// while the current frame is output. NULL if not allocated.
+    uint8_t* conversion_lut_next;
+    /// Contents of `conversion_lut_next`.
+    LutBufferState lut_next_state;
 
     /// Queue of lines prepared for output to the display,
-    /// one for each thread.
-    LineQueue_t line_queues[NUM_RENDER_THREADS];
-    uint8_t* line_threads;
+    /// shared by all threads.
+    LineQueue_t line_queue;
 
     // Output line mask
     uint8_t* line_mask;
 
+    /// Column dirtyness of a band of lines when finding the dirty regions
+    /// of a difference, for framebuffers up to the display width.
+    uint8_t* band_dirtyness;
+    /// Line framebuffers are interlaced to when only their differences are needed,
+    /// for framebuffers up to the display width.
+    uint8_t* difference_scratch_line;
+
+    /// Regions output is limited to, in display coordinates and sorted by x.
+    /// If `num_regions` is 0, output is not limited to regions.
+    EpdRect regions[EPD_MAX_DIRTY_REGIONS];
+    int num_regions;
+    /// Waveform mode of every region: 0 for the draw mode and the main LUT,
+    /// `i` for `mode_slots[i - 1]`.
+    uint8_t region_slot[EPD_MAX_DIRTY_REGIONS];
+
+    /// Additional waveform modes of a multi-mode draw.
+    /// `num_mode_slots` is 0 when drawing with a single mode,
+    /// otherwise slots up to it may be in use.
+    RenderModeSlot mode_slots[EPD_MAX_DRAW_REGIONS - 1];
+    int num_mode_slots;
+
+    /// Number of frames of the draw mode.
+    /// Only a draw with joined regions has more frames in total.
+    int main_frames;
+    /// Whether the draw mode has a phase in the current frame.
+    bool main_active;
+
+    /// Protects the fields below, which are shared with threads joining the draw.
+    SemaphoreHandle_t join_lock;
+    /// Whether regions can join the draw in progress, see `epd_draw_pipelined()`.
+    bool pipelined;
+    /// Regions waiting to join the draw with the next frame, and their mode slots.
+    EpdRect joined_regions[EPD_MAX_DIRTY_REGIONS];
+    uint8_t joined_slot[EPD_MAX_DIRTY_REGIONS];
+    int num_joined;
+
     /// track line skipping when working in old i2s mode
     int skipping;
 
@@ -81,7 +193,8 @@ typedef struct {
 
 /**
  * Based on the render context, assign the bytes per line,
- * framebuffer start pointer, min and max vertical positions and the pixels per byte.
+ * framebuffer start pointer, min and max vertical positions
+ * and the pixels per byte of the lookup input.
  */
 void get_buffer_params(
     RenderContext_t* ctx,
@@ -92,6 +205,13 @@ void get_buffer_params(
     int* pixels_per_byte
 );
 
+/**
+ * Number of lines in the line queue for `render_threads` threads and the queue length
+ * selected in `options`. The queue holds at least `FRAME_START_LINES` lines,
+ * so feed threads can not block on a full queue before frame output starts.
+ */
+int render_queue_lines(enum EpdInitOptions options, int render_threads);
+
 /**
  * Prepare the render context for drawing the next frame.
  *
@@ -99,6 +219,37 @@ void get_buffer_params(
  */
 void prepare_context_for_next_frame(RenderContext_t* ctx);
 
+/**
+ * Add a region drawn with mode slot `slot`, keeping the regions sorted by horizontal position.
+ */
+void add_context_region(RenderContext_t* ctx, EpdRect r, int slot);
+
+/**
+ * Build the LUTs for the frame after the current one in the second LUT buffers,
+ * if there are any, and the LUTs of modes waiting to join the draw with that frame.
+ * Called while the current frame is output.
+ */
+void prepare_lut_for_following_frame(RenderContext_t* ctx);
+
+/**
+ * Get the lookup input for display line `line` from its data in `line_data`.
+ * When drawing a difference, this is the line interlaced with the corresponding line
+ * of `difference_from` into `scratch`, which must hold `display_width` bytes.
+ * Otherwise, it is `line_data` itself.
+ */
+const uint8_t* line_lookup_data(
+    RenderContext_t* ctx, int line, const uint8_t* line_data, uint8_t* scratch
+);
+
+/**
+ * Look up the output for display line `line` from its data in `line_data`.
+ * If the context has regions, lookup is limited to the columns
+ * of the regions covering the line, and the output is cleared elsewhere.
+ */
+void lookup_line_in_regions(
+    RenderContext_t* ctx, int line, const uint8_t* line_data, int pixels_per_byte, uint8_t* buf
+);
+
 /**
  * Populate an output line mask from line dirtyness with two bits per pixel.
  * If the dirtyness data is NULL, set the mask to neutral.
@@ -5,6 +5,8 @@
 const enum EpdRenderMethod EPD_CURRENT_RENDER_METHOD = RENDER_METHOD_I2S;
 #elif defined(CONFIG_IDF_TARGET_ESP32S3)
 const enum EpdRenderMethod EPD_CURRENT_RENDER_METHOD = RENDER_METHOD_LCD;
+#elif defined(CONFIG_IDF_TARGET_LINUX)
+const enum EpdRenderMethod EPD_CURRENT_RENDER_METHOD = RENDER_METHOD_HOST;
 #else
 #error "unknown chip, cannot choose render method!"
 #endif
\ No newline at end of file
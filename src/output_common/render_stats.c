@@ -0,0 +1,84 @@
+#include "render_stats.h"
+
+#include <esp_attr.h>
+#include <string.h>
+
+#include "render_context.h"
+
+_Static_assert(
+    MAX_RENDER_THREADS <= EPD_STATS_MAX_THREADS, "statistics must cover all render threads"
+);
+
+#if EPD_RENDER_STATS
+
+/// Statistics recorded so far. Per-thread statistics are only written by their thread,
+/// all others by the thread controlling the update.
+static EpdRenderStats stats;
+
+void IRAM_ATTR render_stats_line_done(int thread_id, uint32_t start) {
+    uint32_t duration = render_stats_timestamp() - start;
+    if (duration >= EPD_STATS_LOOKUP_BUCKETS) {
+        duration = EPD_STATS_LOOKUP_BUCKETS - 1;
+    }
+    EpdThreadStats* thread = &stats.threads[thread_id];
+    thread->lines++;
+    thread->lookup_us[duration]++;
+}
+
+void IRAM_ATTR render_stats_line_skipped(int thread_id) {
+    stats.threads[thread_id].skipped_lines++;
+}
+
+void IRAM_ATTR render_stats_lut_done(enum RenderStatsLut outcome, uint32_t start) {
+    uint32_t duration = render_stats_timestamp() - start;
+    stats.lut_time_us += duration;
+    if (duration > stats.max_lut_us) {
+        stats.max_lut_us = duration;
+    }
+    switch (outcome) {
+        case RENDER_STATS_LUT_BUILT:
+            stats.lut_builds++;
+            break;
+        case RENDER_STATS_LUT_PATCHED:
+            stats.lut_patches++;
+            break;
+        case RENDER_STATS_LUT_REUSED:
+            stats.lut_reuses++;
+            break;
+    }
+}
+
+void IRAM_ATTR render_stats_frame_done(uint32_t start) {
+    uint32_t duration = render_stats_timestamp() - start;
+    stats.frames++;
+    stats.scan_time_us += duration;
+    if (duration > stats.max_frame_us) {
+        stats.max_frame_us = duration;
+    }
+}
+
+void render_stats_get(EpdRenderStats* out) {
+    memcpy(out, &stats, sizeof(EpdRenderStats));
+}
+
+void render_stats_reset() {
+    memset(&stats, 0, sizeof(EpdRenderStats));
+}
+
+#endif
+
+int epd_render_stats_lookup_percentile(const EpdThreadStats* thread, int percentile) {
+    if (thread->lines == 0) {
+        return -1;
+    }
+    // number of lines at or below the percentile, rounded up
+    uint64_t rank = ((uint64_t)thread->lines * percentile + 99) / 100;
+    uint64_t count = 0;
+    for (int i = 0; i < EPD_STATS_LOOKUP_BUCKETS; i++) {
+        count += thread->lookup_us[i];
+        if (count >= rank) {
+            return i + 1;
+        }
+    }
+    return EPD_STATS_LOOKUP_BUCKETS;
+}
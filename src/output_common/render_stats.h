@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "../epdiy.h"
+
+/**
+ * Recording of render statistics, see `epd_get_render_stats()`.
+ * With `EPD_RENDER_STATS` set to 0, all of these compile to nothing.
+ */
+
+/// Outcome of preparing the LUT for a frame.
+enum RenderStatsLut {
+    RENDER_STATS_LUT_BUILT,
+    RENDER_STATS_LUT_PATCHED,
+    RENDER_STATS_LUT_REUSED,
+};
+
+#if EPD_RENDER_STATS
+
+#include <esp_timer.h>
+
+/// Get a timestamp for measuring a duration in us.
+static inline uint32_t render_stats_timestamp() {
+    return (uint32_t)esp_timer_get_time();
+}
+
+/// Record a line lookup of `thread_id` that started at `start`.
+void render_stats_line_done(int thread_id, uint32_t start);
+
+/// Record a line that `thread_id` skipped.
+void render_stats_line_skipped(int thread_id);
+
+/// Record the LUT preparation for a frame that started at `start`.
+void render_stats_lut_done(enum RenderStatsLut outcome, uint32_t start);
+
+/// Record a frame that started at `start`.
+void render_stats_frame_done(uint32_t start);
+
+/// Copy the recorded statistics, without line queue statistics.
+void render_stats_get(EpdRenderStats* out);
+
+/// Reset the recorded statistics.
+void render_stats_reset();
+
+#else
+
+static inline uint32_t render_stats_timestamp() {
+    return 0;
+}
+
+static inline void render_stats_line_done(int thread_id, uint32_t start) {}
+
+static inline void render_stats_line_skipped(int thread_id) {}
+
+static inline void render_stats_lut_done(enum RenderStatsLut outcome, uint32_t start) {}
+
+static inline void render_stats_frame_done(uint32_t start) {}
+
+#endif
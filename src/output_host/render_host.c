@@ -0,0 +1,269 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "../output_common/render_method.h"
+
+#ifdef RENDER_METHOD_HOST
+
+#include <assert.h>
+#include <esp_log.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#include "../output_common/line_queue.h"
+#include "../output_common/lut.h"
+#include "../output_common/render_context.h"
+#include "../output_common/render_stats.h"
+#include "epdiy.h"
+#include "render_host.h"
+
+/// Synchronization of the feed threads with the frame loop.
+typedef struct {
+    pthread_t threads[MAX_RENDER_THREADS];
+    bool running[MAX_RENDER_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t frame_start;
+    pthread_cond_t frame_done;
+    /// Incremented for every frame to start.
+    int generation;
+    /// Number of threads done with the current frame.
+    int threads_done;
+    bool shutdown;
+    RenderContext_t* ctx;
+} HostFeedState;
+
+static HostFeedState feed_state = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .frame_start = PTHREAD_COND_INITIALIZER,
+    .frame_done = PTHREAD_COND_INITIALIZER,
+};
+
+static EpdHostCapture capture = { 0 };
+/// Error flags of the next draw, see `epd_host_fail_next_draw()`.
+static enum EpdDrawError next_draw_error = EPD_DRAW_SUCCESS;
+
+const EpdHostCapture* epd_host_capture() {
+    return &capture;
+}
+
+const uint8_t* epd_host_capture_line(const EpdHostCapture* capture, int frame, int line) {
+    assert(frame >= 0 && frame < capture->frame_count);
+    assert(line >= 0 && line < capture->height);
+    return capture->frames + ((size_t)frame * capture->height + line) * capture->line_bytes;
+}
+
+void epd_host_capture_reset() {
+    free(capture.frames);
+    free(capture.frame_times);
+    capture.frames = NULL;
+    capture.frame_times = NULL;
+    capture.frame_count = 0;
+}
+
+void epd_host_fail_next_draw(enum EpdDrawError err) {
+    next_draw_error = err;
+}
+
+/**
+ * Append a zeroed frame to the capture and return a pointer to its first line.
+ */
+static uint8_t* capture_next_frame(RenderContext_t* ctx, int frame_time) {
+    capture.width = ctx->display_width;
+    capture.height = ctx->display_height;
+    capture.line_bytes = ctx->display_width / 4;
+
+    size_t frame_size = (size_t)capture.height * capture.line_bytes;
+    uint8_t* frames = realloc(capture.frames, frame_size * (capture.frame_count + 1));
+    int* frame_times = realloc(capture.frame_times, sizeof(int) * (capture.frame_count + 1));
+    if (frames == NULL || frame_times == NULL) {
+        ESP_LOGE("epd_host", "could not allocate capture frame!");
+        abort();
+    }
+    capture.frames = frames;
+    capture.frame_times = frame_times;
+
+    uint8_t* frame = capture.frames + frame_size * capture.frame_count;
+    memset(frame, 0x00, frame_size);
+    capture.frame_times[capture.frame_count] = frame_time;
+    capture.frame_count++;
+    return frame;
+}
+
+static void* feed_thread(void* arg) {
+    int thread_id = (int)(intptr_t)arg;
+    int seen_generation = 0;
+
+    pthread_mutex_lock(&feed_state.lock);
+    while (true) {
+        while (feed_state.generation == seen_generation && !feed_state.shutdown) {
+            pthread_cond_wait(&feed_state.frame_start, &feed_state.lock);
+        }
+        if (feed_state.shutdown) {
+            break;
+        }
+        seen_generation = feed_state.generation;
+        pthread_mutex_unlock(&feed_state.lock);
+
+        host_calculate_frame(feed_state.ctx, thread_id);
+
+        pthread_mutex_lock(&feed_state.lock);
+        feed_state.threads_done++;
+        pthread_cond_broadcast(&feed_state.frame_done);
+    }
+    pthread_mutex_unlock(&feed_state.lock);
+    return NULL;
+}
+
+void host_start_feed_thread(RenderContext_t* ctx, int thread_id) {
+    assert(thread_id < MAX_RENDER_THREADS);
+    pthread_mutex_lock(&feed_state.lock);
+    feed_state.ctx = ctx;
+    feed_state.shutdown = false;
+    pthread_mutex_unlock(&feed_state.lock);
+
+    if (pthread_create(
+            &feed_state.threads[thread_id], NULL, feed_thread, (void*)(intptr_t)thread_id
+        )
+        != 0) {
+        ESP_LOGE("epd_host", "could not create feed thread!");
+        abort();
+    }
+    feed_state.running[thread_id] = true;
+}
+
+void host_stop_feed_threads() {
+    pthread_mutex_lock(&feed_state.lock);
+    feed_state.shutdown = true;
+    pthread_cond_broadcast(&feed_state.frame_start);
+    pthread_mutex_unlock(&feed_state.lock);
+
+    for (int i = 0; i < MAX_RENDER_THREADS; i++) {
+        if (feed_state.running[i]) {
+            pthread_join(feed_state.threads[i], NULL);
+            feed_state.running[i] = false;
+        }
+    }
+    feed_state.generation = 0;
+}
+
+/**
+ * Output stage: Consume the prepared lines in display order,
+ * like the LCD peripheral would, and record them into `frame`.
+ */
+static void output_frame(RenderContext_t* ctx, uint8_t* frame) {
+    int line_bytes = ctx->display_width / 4;
+    for (int l = 0; l < ctx->lines_total; l++) {
+        uint8_t* src = NULL;
+        while ((src = lq_read(&ctx->line_queue, l)) == NULL) {
+            sched_yield();
+        }
+        if (l < ctx->display_height) {
+            memcpy(frame + l * line_bytes, src, line_bytes);
+        }
+        lq_release(&ctx->line_queue, l);
+        ctx->lines_consumed += 1;
+    }
+}
+
+void host_do_update(RenderContext_t* ctx) {
+    ctx->error |= next_draw_error;
+    next_draw_error = EPD_DRAW_SUCCESS;
+
+    for (int k = 0; k < ctx->cycle_frames; k++) {
+        uint32_t frame_start = render_stats_timestamp();
+        prepare_context_for_next_frame(ctx);
+        uint8_t* frame = capture_next_frame(ctx, ctx->frame_time);
+
+        // start all feeder threads
+        pthread_mutex_lock(&feed_state.lock);
+        feed_state.ctx = ctx;
+        feed_state.threads_done = 0;
+        feed_state.generation++;
+        pthread_cond_broadcast(&feed_state.frame_start);
+        pthread_mutex_unlock(&feed_state.lock);
+
+        prepare_lut_for_following_frame(ctx);
+        output_frame(ctx, frame);
+
+        pthread_mutex_lock(&feed_state.lock);
+        while (feed_state.threads_done < ctx->num_render_threads) {
+            pthread_cond_wait(&feed_state.frame_done, &feed_state.lock);
+        }
+        pthread_mutex_unlock(&feed_state.lock);
+        render_stats_frame_done(frame_start);
+
+        ctx->current_frame++;
+    }
+}
+
+void epd_push_pixels_host(RenderContext_t* ctx, short time, int color) {
+    int line_bytes = ctx->display_width / 4;
+    const uint8_t color_choice[4] = { DARK_BYTE, CLEAR_BYTE, 0x00, 0xFF };
+
+    // output line for rows inside the drawn area
+    uint8_t* row = calloc(line_bytes, 1);
+    assert(row != NULL);
+    for (int x = ctx->area.x; x < ctx->area.x + ctx->area.width; x++) {
+        if (x < 0 || x >= ctx->display_width) {
+            continue;
+        }
+        row[x / 4] |= color_choice[color] & (0b00000011 << (2 * (x % 4)));
+    }
+
+    uint8_t* frame = capture_next_frame(ctx, time * 10);
+    for (int l = 0; l < ctx->display_height; l++) {
+        if (l >= ctx->area.y && l < ctx->area.y + ctx->area.height) {
+            memcpy(frame + l * line_bytes, row, line_bytes);
+        }
+    }
+    free(row);
+}
+
+/**
+ * Wait for the slot of `line` in a line queue to become free.
+ */
+static uint8_t* wait_for_queue_slot(LineQueue_t* lq, int line) {
+    uint8_t* buf = NULL;
+    while ((buf = lq_current(lq, line)) == NULL) {
+        sched_yield();
+    }
+    return buf;
+}
+
+void host_calculate_frame(RenderContext_t* ctx, int thread_id) {
+    assert(ctx->lut_lookup_func != NULL);
+    LineQueue_t* lq = &ctx->line_queue;
+
+    EpdRect area = ctx->area;
+    int min_y, max_y, bytes_per_line, _ppB;
+    const uint8_t* ptr_start;
+    get_buffer_params(ctx, &bytes_per_line, &ptr_start, &min_y, &max_y, &_ppB);
+
+    // as with the LCD driver, only full-width buffers are supported.
+    if (area.width != ctx->display_width || area.x != 0) {
+        ctx->error |= EPD_DRAW_INVALID_CROP;
+    }
+
+    int l = 0;
+    while (l = atomic_fetch_add(&ctx->lines_prepared, 1), l < ctx->lines_total) {
+        uint8_t* buf = wait_for_queue_slot(lq, l);
+
+        if (ctx->error || l < min_y || l >= max_y
+            || (ctx->drawn_lines != NULL && !ctx->drawn_lines[l - area.y])) {
+            memset(buf, 0x00, lq->element_size);
+            render_stats_line_skipped(thread_id);
+        } else {
+            const uint8_t* ptr = ptr_start + bytes_per_line * (l - min_y);
+            ptr = line_lookup_data(ctx, l, ptr, ctx->feed_line_buffers[thread_id]);
+            uint32_t lookup_start = render_stats_timestamp();
+            lookup_line_in_regions(ctx, l, ptr, _ppB, buf);
+            epd_apply_line_mask(buf, ctx->line_mask, ctx->display_width / 4);
+            render_stats_line_done(thread_id, lookup_start);
+        }
+
+        lq_commit(lq, l);
+    }
+}
+
+#endif
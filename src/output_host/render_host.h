@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "../output_common/render_context.h"
+
+/**
+ * Display output recorded by the host render method.
+ *
+ * Every line emitted to the (virtual) display is stored with
+ * two bits per pixel, in the same order as on the LCD bus:
+ * Pixel `x` of a line is found in byte `x / 4`, bits `2 * (x % 4)`.
+ * `0b01` darkens, `0b10` lightens, `0b00` and `0b11` leave a pixel as it is.
+ */
+typedef struct {
+    /// Display width in pixels.
+    int width;
+    /// Display height in lines.
+    int height;
+    /// Size of a recorded line in bytes.
+    int line_bytes;
+    /// Number of recorded frames.
+    int frame_count;
+    /// Line hold time of each recorded frame in 1/10 us.
+    int* frame_times;
+    /// Recorded frames, `frame_count * height * line_bytes` bytes.
+    uint8_t* frames;
+} EpdHostCapture;
+
+/**
+ * Get the display output recorded since initialization or the last
+ * call to `epd_host_capture_reset()`.
+ */
+const EpdHostCapture* epd_host_capture();
+
+/**
+ * Get a recorded display line.
+ */
+const uint8_t* epd_host_capture_line(const EpdHostCapture* capture, int frame, int line);
+
+/**
+ * Discard all recorded frames.
+ */
+void epd_host_capture_reset();
+
+/**
+ * Let the next draw fail with `err`, as an output error would on the device.
+ */
+void epd_host_fail_next_draw(enum EpdDrawError err);
+
+/**
+ * Lighten / darken pixels, recording a single frame.
+ */
+void epd_push_pixels_host(RenderContext_t* ctx, short time, int color);
+
+/**
+ * Do a full update cycle with a configured context.
+ */
+void host_do_update(RenderContext_t* ctx);
+
+/**
+ * Worker for output calculation, called by the feed threads.
+ * As with the LCD method, all threads do the same thing.
+ */
+void host_calculate_frame(RenderContext_t* ctx, int thread_id);
+
+/**
+ * Start the feed thread `thread_id`, replacing the render task
+ * used on the ESP32 targets.
+ */
+void host_start_feed_thread(RenderContext_t* ctx, int thread_id);
+
+/**
+ * Stop and join all feed threads.
+ */
+void host_stop_feed_threads();
@@ -0,0 +1,170 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "../output_common/render_method.h"
+
+#ifdef RENDER_METHOD_HOST
+
+#include <assert.h>
+#include <esp_log.h>
+#include <stdlib.h>
+
+#include "../render.h"
+#include "simulate.h"
+
+/// Frame time used by the render context for waveforms without timing information.
+#define DEFAULT_PHASE_TIME 120
+
+/// Output codes of the 2-bit display line format.
+#define ACTION_DARKEN 0x1
+#define ACTION_LIGHTEN 0x2
+
+static inline int32_t clamp(int32_t x, int32_t lo, int32_t hi) {
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+/**
+ * Get the waveform action for the transition `from` -> `to` in `phase`.
+ */
+static uint8_t waveform_action(const EpdWaveformPhases* phases, int phase, int from, int to) {
+    uint8_t packed = phases->luts[16 * 4 * phase + to * 4 + from / 4];
+    return (packed >> (2 * (3 - from % 4))) & 0x3;
+}
+
+int epd_host_full_drive_time(const EpdWaveform* waveform, enum EpdDrawMode mode, int temperature) {
+    if (mode & MODE_EPDIY_MONOCHROME) {
+        return MONOCHROME_FRAME_TIME;
+    }
+
+    int range = waveform_temp_range_index(waveform, temperature);
+    if (range < 0) {
+        return -1;
+    }
+
+    const EpdWaveformPhases* phases = NULL;
+    for (int i = 0; i < waveform->num_modes; i++) {
+        if (waveform->mode_data[i]->type == (mode & 0x3F)) {
+            phases = waveform->mode_data[i]->range_data[range];
+            break;
+        }
+    }
+    if (phases == NULL) {
+        return -1;
+    }
+
+    int drive_time = 0;
+    for (int p = 0; p < phases->phases; p++) {
+        if (waveform_action(phases, p, 15, 0) == ACTION_DARKEN) {
+            drive_time += phases->phase_times != NULL ? phases->phase_times[p] : DEFAULT_PHASE_TIME;
+        }
+    }
+    return drive_time;
+}
+
+EpdHostSimulation epd_host_simulation_init(
+    int width, int height, int full_drive_time, const uint8_t* initial_fb
+) {
+    assert(full_drive_time > 0);
+    size_t pixels = (size_t)width * height;
+
+    EpdHostSimulation sim = {
+        .width = width,
+        .height = height,
+        .full_drive_time = full_drive_time,
+        .state = malloc(pixels * sizeof(int32_t)),
+        .energy = calloc(pixels, sizeof(uint32_t)),
+        .dc_balance = calloc(pixels, sizeof(int32_t)),
+    };
+    if (sim.state == NULL || sim.energy == NULL || sim.dc_balance == NULL) {
+        ESP_LOGE("epd_host", "could not allocate simulation state!");
+        abort();
+    }
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int level = 15;
+            if (initial_fb != NULL) {
+                uint8_t b = initial_fb[y * width / 2 + x / 2];
+                level = x % 2 ? b >> 4 : b & 0x0F;
+            }
+            sim.state[y * width + x] = level * full_drive_time / 15;
+        }
+    }
+    return sim;
+}
+
+void epd_host_simulate(EpdHostSimulation* sim, const EpdHostCapture* capture) {
+    assert(capture->width == sim->width);
+    assert(capture->height == sim->height);
+
+    for (int f = 0; f < capture->frame_count; f++) {
+        int32_t frame_time = capture->frame_times[f];
+        for (int y = 0; y < sim->height; y++) {
+            const uint8_t* line = epd_host_capture_line(capture, f, y);
+            int32_t* state = sim->state + y * sim->width;
+            uint32_t* energy = sim->energy + y * sim->width;
+            int32_t* dc_balance = sim->dc_balance + y * sim->width;
+
+            for (int x = 0; x < sim->width; x++) {
+                uint8_t action = (line[x / 4] >> (2 * (x % 4))) & 0x3;
+                if (action != ACTION_DARKEN && action != ACTION_LIGHTEN) {
+                    continue;
+                }
+                int32_t drive = action == ACTION_DARKEN ? -frame_time : frame_time;
+                state[x] = clamp(state[x] + drive, 0, sim->full_drive_time);
+                energy[x] += frame_time;
+                dc_balance[x] += drive;
+            }
+        }
+    }
+}
+
+/**
+ * Get the gray level a pixel state is closest to.
+ */
+static inline uint8_t state_level(const EpdHostSimulation* sim, int32_t state) {
+    return (state * 15 + sim->full_drive_time / 2) / sim->full_drive_time;
+}
+
+void epd_host_simulation_image(const EpdHostSimulation* sim, uint8_t* framebuffer) {
+    int line_bytes = sim->width / 2;
+    for (int y = 0; y < sim->height; y++) {
+        const int32_t* state = sim->state + y * sim->width;
+        uint8_t* line = framebuffer + y * line_bytes;
+        for (int x = 0; x < line_bytes; x++) {
+            line[x] = state_level(sim, state[2 * x + 1]) << 4 | state_level(sim, state[2 * x]);
+        }
+    }
+}
+
+int epd_host_simulation_max_error(const EpdHostSimulation* sim, const uint8_t* target) {
+    int max_error = 0;
+    for (int y = 0; y < sim->height; y++) {
+        for (int x = 0; x < sim->width; x++) {
+            uint8_t b = target[y * sim->width / 2 + x / 2];
+            int expected = x % 2 ? b >> 4 : b & 0x0F;
+            int error = abs(state_level(sim, sim->state[y * sim->width + x]) - expected);
+            if (error > max_error) {
+                max_error = error;
+            }
+        }
+    }
+    return max_error;
+}
+
+void epd_host_simulation_reset_energy(EpdHostSimulation* sim) {
+    size_t pixels = (size_t)sim->width * sim->height;
+    memset(sim->energy, 0, pixels * sizeof(uint32_t));
+    memset(sim->dc_balance, 0, pixels * sizeof(int32_t));
+}
+
+void epd_host_simulation_deinit(EpdHostSimulation* sim) {
+    free(sim->state);
+    free(sim->energy);
+    free(sim->dc_balance);
+    sim->state = NULL;
+    sim->energy = NULL;
+    sim->dc_balance = NULL;
+}
+
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "epdiy.h"
+#include "render_host.h"
+
+/**
+ * Simple optical model of an EPD, driven by recorded display output.
+ *
+ * Each pixel has an optical state in units of drive time (1/10 us),
+ * from 0 (black) to `full_drive_time` (white). Darkening for a frame
+ * lowers the state by the frame time, lightening raises it, both
+ * saturating at the limits. This is linear and ignores particle inertia,
+ * but is good enough to compare waveforms and refresh modes with each other.
+ */
+typedef struct {
+    /// Display width in pixels.
+    int width;
+    /// Display height in lines.
+    int height;
+    /// Drive time needed to move a pixel from white to black, in 1/10 us.
+    int full_drive_time;
+    /// Optical state of each pixel in 1/10 us, 0 is black.
+    int32_t* state;
+    /// Total time each pixel was driven in either direction, in 1/10 us.
+    uint32_t* energy;
+    /// Net drive time of each pixel in 1/10 us, lightening counted positive.
+    /// Pixels far from zero after an update have been driven unevenly,
+    /// which is a common cause of ghosting.
+    int32_t* dc_balance;
+} EpdHostSimulation;
+
+/**
+ * Get the time needed to drive a pixel from white to black with `mode`,
+ * to be used as `full_drive_time` of a simulation.
+ *
+ * Returns -1 if the waveform has no data for the mode and temperature.
+ */
+int epd_host_full_drive_time(const EpdWaveform* waveform, enum EpdDrawMode mode, int temperature);
+
+/**
+ * Initialize a simulation with the display contents in `initial_fb`,
+ * a 4bpp framebuffer as used by the high-level API.
+ * If `initial_fb` is NULL, the display starts out white.
+ */
+EpdHostSimulation epd_host_simulation_init(
+    int width, int height, int full_drive_time, const uint8_t* initial_fb
+);
+
+/**
+ * Apply all frames of a capture to the simulated display.
+ * Can be called repeatedly to simulate successive updates.
+ */
+void epd_host_simulate(EpdHostSimulation* sim, const EpdHostCapture* capture);
+
+/**
+ * Write the predicted display contents to `framebuffer`,
+ * a 4bpp framebuffer as used by the high-level API.
+ */
+void epd_host_simulation_image(const EpdHostSimulation* sim, uint8_t* framebuffer);
+
+/**
+ * Get the largest difference in gray levels between the predicted
+ * display contents and the 4bpp framebuffer `target`.
+ */
+int epd_host_simulation_max_error(const EpdHostSimulation* sim, const uint8_t* target);
+
+/**
+ * Reset the energy and DC balance maps, keeping the optical state.
+ */
+void epd_host_simulation_reset_energy(EpdHostSimulation* sim);
+
+/**
+ * Free the memory held by a simulation.
+ */
+void epd_host_simulation_deinit(EpdHostSimulation* sim);
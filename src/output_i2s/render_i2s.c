@@ -14,6 +14,7 @@
 // output a row to the display.
 #include "../output_common/lut.h"
 #include "../output_common/render_context.h"
+#include "../output_common/render_stats.h"
 #include "i2s_data_bus.h"
 #include "rmt_pulse.h"
 
@@ -157,19 +158,25 @@ static void i2s_end_frame() {
 }
 
 void i2s_do_update(RenderContext_t* ctx) {
-    for (uint8_t k = 0; k < ctx->cycle_frames; k++) {
+    for (int k = 0; k < ctx->cycle_frames; k++) {
+        uint32_t frame_start = render_stats_timestamp();
         prepare_context_for_next_frame(ctx);
 
-        // start both feeder tasks
-        xTaskNotifyGive(ctx->feed_tasks[!xPortGetCoreID()]);
-        xTaskNotifyGive(ctx->feed_tasks[xPortGetCoreID()]);
+        // start all feeder tasks
+        for (int i = 0; i < ctx->num_render_threads; i++) {
+            xTaskNotifyGive(ctx->feed_tasks[i]);
+        }
+
+        // use the time until the frame is done to prepare the next LUT
+        prepare_lut_for_following_frame(ctx);
 
         // transmission is started in renderer threads, now wait util it's done
         xSemaphoreTake(ctx->frame_done, portMAX_DELAY);
 
-        for (int i = 0; i < NUM_RENDER_THREADS; i++) {
+        for (int i = 0; i < ctx->num_render_threads; i++) {
             xSemaphoreTake(ctx->feed_done_smphr[i], portMAX_DELAY);
         }
+        render_stats_frame_done(frame_start);
 
         ctx->current_frame++;
 
@@ -222,37 +229,41 @@ void IRAM_ATTR epd_push_pixels_i2s(RenderContext_t* ctx, EpdRect area, short tim
 }
 
 void IRAM_ATTR i2s_output_frame(RenderContext_t* ctx, int thread_id) {
-    uint8_t* line_buf = ctx->feed_line_buffers[thread_id];
-
     ctx->skipping = 0;
     EpdRect area = ctx->area;
     int frame_time = ctx->frame_time;
 
+    int min_y, max_y, bytes_per_line, pixels_per_byte;
+    const uint8_t* ptr_start;
+    get_buffer_params(ctx, &bytes_per_line, &ptr_start, &min_y, &max_y, &pixels_per_byte);
+
     i2s_start_frame();
     for (int i = 0; i < ctx->display_height; i++) {
-        LineQueue_t* lq = &ctx->line_queues[0];
+        LineQueue_t* lq = &ctx->line_queue;
 
-        memset(line_buf, 0, ctx->display_width);
-        while (lq_read(lq, line_buf) < 0) {
+        // the line is looked up in place, without copying it from the queue
+        uint8_t* line_buf = NULL;
+        while ((line_buf = lq_read(lq, i)) == NULL) {
         };
 
         ctx->lines_consumed += 1;
 
         if (ctx->drawn_lines != NULL && !ctx->drawn_lines[i - area.y]) {
+            lq_release(lq, i);
             i2s_skip_row(ctx, frame_time);
             continue;
         }
 
         // lookup pixel actions in the waveform LUT
-        ctx->lut_lookup_func(
-            (uint32_t*)line_buf,
-            (uint8_t*)i2s_get_current_buffer(),
-            ctx->conversion_lut,
-            ctx->display_width
+        uint32_t lookup_start = render_stats_timestamp();
+        lookup_line_in_regions(
+            ctx, i, line_buf, pixels_per_byte, (uint8_t*)i2s_get_current_buffer()
         );
+        lq_release(lq, i);
 
         // apply the line mask
         epd_apply_line_mask(i2s_get_current_buffer(), ctx->line_mask, ctx->display_width / 4);
+        render_stats_line_done(thread_id, lookup_start);
 
         reorder_line_buffer((uint32_t*)i2s_get_current_buffer(), ctx->display_width / 4);
         i2s_write_row(ctx, frame_time);
@@ -281,7 +292,7 @@ void IRAM_ATTR i2s_fetch_frame_data(RenderContext_t* ctx, int thread_id) {
     // line must be able to hold 2-pixel-per-byte or 1-pixel-per-byte data
     memset(input_line, 0x00, ctx->display_width);
 
-    LineQueue_t* lq = &ctx->line_queues[thread_id];
+    LineQueue_t* lq = &ctx->line_queue;
 
     EpdRect area = ctx->area;
 
@@ -304,15 +315,15 @@ void IRAM_ATTR i2s_fetch_frame_data(RenderContext_t* ctx, int thread_id) {
     int l = 0;
     while (l = atomic_fetch_add(&ctx->lines_prepared, 1), l < ctx->display_height) {
         // if (thread_id) gpio_set_level(15, 0);
-        ctx->line_threads[l] = thread_id;
+        uint8_t* buf = NULL;
+        while (buf == NULL)
+            buf = lq_current(lq, l);
 
         if (l < min_y || l >= max_y
             || (ctx->drawn_lines != NULL && !ctx->drawn_lines[l - area.y])) {
-            uint8_t* buf = NULL;
-            while (buf == NULL)
-                buf = lq_current(lq);
             memset(buf, 0x00, lq->element_size);
-            lq_commit(lq);
+            lq_commit(lq, l);
+            render_stats_line_skipped(thread_id);
             continue;
         }
 
@@ -321,7 +332,8 @@ void IRAM_ATTR i2s_fetch_frame_data(RenderContext_t* ctx, int thread_id) {
         const uint8_t* ptr = ptr_start + bytes_per_line * (l - min_y);
 
         if (area.width == ctx->display_width && area.x == 0 && !ctx->error) {
-            lp = (uint32_t*)ptr;
+            // differences are interlaced directly into the queue
+            lp = (uint32_t*)line_lookup_data(ctx, l, ptr, buf);
         } else if (!ctx->error) {
             uint8_t* buf_start = (uint8_t*)input_line;
             uint32_t line_bytes = bytes_per_line;
@@ -380,13 +392,11 @@ void IRAM_ATTR i2s_fetch_frame_data(RenderContext_t* ctx, int thread_id) {
             lp = (uint32_t*)input_line;
         }
 
-        uint8_t* buf = NULL;
-        while (buf == NULL)
-            buf = lq_current(lq);
-
-        memcpy(buf, lp, lq->element_size);
+        if ((uint8_t*)lp != buf) {
+            memcpy(buf, lp, lq->element_size);
+        }
 
-        lq_commit(lq);
+        lq_commit(lq, l);
 
         if (shifted) {
             memset(input_line, 255, ctx->display_width / pixels_per_byte);
@@ -21,6 +21,7 @@
 #include "../output_common/line_queue.h"
 #include "../output_common/lut.h"
 #include "../output_common/render_context.h"
+#include "../output_common/render_stats.h"
 #include "epd_board.h"
 #include "epdiy.h"
 #include "lcd_driver.h"
@@ -31,24 +32,27 @@ void epd_apply_line_mask_VE(uint8_t* line, const uint8_t* mask, int mask_len);
 
 __attribute__((optimize("O3"))) static bool IRAM_ATTR
 retrieve_line_isr(RenderContext_t* ctx, uint8_t* buf) {
-    if (ctx->lines_consumed >= ctx->lines_total) {
+    int line = ctx->lines_consumed;
+    if (line >= ctx->lines_total) {
         return false;
     }
-    int thread = ctx->line_threads[ctx->lines_consumed];
-    assert(thread < NUM_RENDER_THREADS);
-
-    LineQueue_t* lq = &ctx->line_queues[thread];
 
     BaseType_t awoken = pdFALSE;
 
-    if (lq_read(lq, buf) != 0) {
+    // the bounce buffer is owned by the LCD driver, so this is the only copy of the line
+    uint8_t* src = lq_read(&ctx->line_queue, line);
+    if (src == NULL) {
         ctx->error |= EPD_DRAW_EMPTY_LINE_QUEUE;
         memset(buf, 0x00, ctx->display_width / 4);
+    } else {
+        if (line >= ctx->display_height) {
+            memset(buf, 0x00, ctx->display_width / 4);
+        } else {
+            memcpy(buf, src, ctx->display_width / 4);
+        }
+        lq_release(&ctx->line_queue, line);
     }
 
-    if (ctx->lines_consumed >= ctx->display_height) {
-        memset(buf, 0x00, ctx->display_width / 4);
-    }
     ctx->lines_consumed += 1;
     return awoken;
 }
@@ -67,20 +71,26 @@ static void IRAM_ATTR handle_lcd_frame_done(RenderContext_t* ctx) {
 void lcd_do_update(RenderContext_t* ctx) {
     epd_set_mode(1);
 
-    for (uint8_t k = 0; k < ctx->cycle_frames; k++) {
+    for (int k = 0; k < ctx->cycle_frames; k++) {
+        uint32_t frame_start = render_stats_timestamp();
         epd_lcd_frame_done_cb((frame_done_func_t)handle_lcd_frame_done, ctx);
         prepare_context_for_next_frame(ctx);
 
-        // start both feeder tasks
-        xTaskNotifyGive(ctx->feed_tasks[!xPortGetCoreID()]);
-        xTaskNotifyGive(ctx->feed_tasks[xPortGetCoreID()]);
+        // start all feeder tasks
+        for (int i = 0; i < ctx->num_render_threads; i++) {
+            xTaskNotifyGive(ctx->feed_tasks[i]);
+        }
+
+        // use the time until the frame is done to prepare the next LUT
+        prepare_lut_for_following_frame(ctx);
 
         // transmission is started in renderer threads, now wait util it's done
         xSemaphoreTake(ctx->frame_done, portMAX_DELAY);
 
-        for (int i = 0; i < NUM_RENDER_THREADS; i++) {
+        for (int i = 0; i < ctx->num_render_threads; i++) {
             xSemaphoreTake(ctx->feed_done_smphr[i], portMAX_DELAY);
         }
+        render_stats_frame_done(frame_start);
 
         ctx->current_frame++;
 
@@ -171,12 +181,11 @@ lcd_calculate_frame(RenderContext_t* ctx, int thread_id) {
     assert(ctx->lut_lookup_func != NULL);
     uint8_t* input_line = ctx->feed_line_buffers[thread_id];
 
-    LineQueue_t* lq = &ctx->line_queues[thread_id];
+    LineQueue_t* lq = &ctx->line_queue;
     int l = 0;
 
     // if there is an error, start the frame but don't feed data.
     if (ctx->error) {
-        memset(ctx->line_threads, 0, ctx->lines_total);
         epd_lcd_line_source_cb((line_cb_func_t)&retrieve_line_isr, ctx);
         epd_lcd_start_frame();
         ESP_LOGW("epd_lcd", "draw frame draw initiated, but an error flag is set: %X", ctx->error);
@@ -193,12 +202,12 @@ lcd_calculate_frame(RenderContext_t* ctx, int thread_id) {
 
     assert(area.width == ctx->display_width && area.x == 0 && !ctx->error);
 
-    // index of the line that triggers the frame output when processed
-    int trigger_line = int_min(63, max_y - min_y);
+    // index of the line that triggers the frame output when processed.
+    // Lines after it can only be queued once output has started.
+    int trigger_line = int_min(FRAME_START_LINES, lq->size) - 1;
+    trigger_line = int_min(trigger_line, max_y - min_y);
 
     while (l = atomic_fetch_add(&ctx->lines_prepared, 1), l < ctx->lines_total) {
-        ctx->line_threads[l] = thread_id;
-
         // queue is sufficiently filled to fill both bounce buffers, frame
         // can begin
         if (l - min_y == trigger_line) {
@@ -212,16 +221,16 @@ lcd_calculate_frame(RenderContext_t* ctx, int thread_id) {
             while (buf == NULL) {
                 // break in case of errors
                 if (ctx->error & EPD_DRAW_EMPTY_LINE_QUEUE) {
-                    lq_reset(lq);
                     return;
                 };
 
-                buf = lq_current(lq);
+                buf = lq_current(lq, l);
                 if (buf == NULL)
                     vTaskDelay(0);
             }
             memset(buf, 0x00, lq->element_size);
-            lq_commit(lq);
+            lq_commit(lq, l);
+            render_stats_line_skipped(thread_id);
             continue;
         }
 
@@ -230,27 +239,28 @@ lcd_calculate_frame(RenderContext_t* ctx, int thread_id) {
 
         Cache_Start_DCache_Preload((uint32_t)ptr, ctx->display_width, 0);
 
-        lp = (uint32_t*)ptr;
+        lp = (uint32_t*)line_lookup_data(ctx, l, ptr, input_line);
 
         uint8_t* buf = NULL;
         while (buf == NULL) {
             // break in case of errors
             if (ctx->error & EPD_DRAW_EMPTY_LINE_QUEUE) {
-                lq_reset(lq);
                 return;
             };
 
-            buf = lq_current(lq);
+            buf = lq_current(lq, l);
             if (buf == NULL)
                 vTaskDelay(0);
         }
 
-        ctx->lut_lookup_func(lp, buf, ctx->conversion_lut, ctx->display_width);
+        uint32_t lookup_start = render_stats_timestamp();
+        lookup_line_in_regions(ctx, l, (const uint8_t*)lp, _ppB, buf);
 
         // apply the line mask
         epd_apply_line_mask_VE(buf, ctx->line_mask, ctx->display_width / 4);
+        render_stats_line_done(thread_id, lookup_start);
 
-        lq_commit(lq);
+        lq_commit(lq, l);
     }
 }
 
@@ -5,6 +5,7 @@
 #include "epdiy.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <esp_log.h>
 #include <esp_timer.h>
 #include <esp_types.h>
@@ -22,8 +23,12 @@
 #include "output_common/lut.h"
 #include "output_common/render_context.h"
 #include "output_common/render_method.h"
-#include "output_i2s/render_i2s.h"
+#include "output_common/render_stats.h"
+#include "output_host/render_host.h"
 #include "output_lcd/render_lcd.h"
+#ifdef RENDER_METHOD_I2S
+#include "output_i2s/render_i2s.h"
+#endif
 
 static inline int min(int x, int y) {
     return x < y ? x : y;
@@ -32,6 +37,16 @@ static inline int max(int x, int y) {
     return x > y ? x : y;
 }
 
+static inline bool rects_overlap(EpdRect a, EpdRect b) {
+    return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height
+           && b.y < a.y + a.height;
+}
+
+/// The framebuffer format and packing bits of a draw mode.
+static inline enum EpdDrawMode mode_packing(enum EpdDrawMode mode) {
+    return mode & ~(0x3F | PREVIOUSLY_WHITE | PREVIOUSLY_BLACK);
+}
+
 const int clear_cycle_time = 12;
 
 #define RTOS_ERROR_CHECK(x)       \
@@ -45,12 +60,16 @@ const int clear_cycle_time = 12;
 static RenderContext_t render_context;
 
 void epd_push_pixels(EpdRect area, short time, int color) {
+    xSemaphoreTake(render_context.draw_idle, portMAX_DELAY);
     render_context.area = area;
 #ifdef RENDER_METHOD_LCD
     epd_push_pixels_lcd(&render_context, time, color);
+#elif defined(RENDER_METHOD_HOST)
+    epd_push_pixels_host(&render_context, time, color);
 #else
     epd_push_pixels_i2s(&render_context, area, time, color);
 #endif
+    xSemaphoreGive(render_context.draw_idle);
 }
 
 ///////////////////////////// Coordination ///////////////////////////////
@@ -100,6 +119,43 @@ enum EpdDrawError IRAM_ATTR epd_draw_base(
     const bool* drawn_lines,
     const uint8_t* drawn_columns,
     const EpdWaveform* waveform
+) {
+    return epd_draw_regions(
+        area, data, crop_to, mode, temperature, drawn_lines, drawn_columns, waveform, NULL
+    );
+}
+
+/**
+ * Copy regions to the render context, sorted by horizontal position.
+ */
+static void set_context_regions(RenderContext_t* ctx, const EpdDirtyRegions* regions) {
+    ctx->num_regions = 0;
+    if (regions == NULL) {
+        return;
+    }
+    for (int i = 0; i < regions->count; i++) {
+        add_context_region(ctx, regions->rects[i], 0);
+    }
+}
+
+/**
+ * Set up the render context for a draw, common to all draw functions.
+ * If `difference_from` is not NULL, `data` and `difference_from` are 4bpp framebuffers
+ * that are interlaced to a difference image line by line while drawing.
+ * Must only be called with `draw_idle` taken.
+ */
+static enum EpdDrawError IRAM_ATTR setup_draw(
+    EpdRect area,
+    const uint8_t* data,
+    EpdRect crop_to,
+    enum EpdDrawMode mode,
+    int temperature,
+    const bool* drawn_lines,
+    const uint8_t* drawn_columns,
+    const EpdWaveform* waveform,
+    const EpdDirtyRegions* regions,
+    const uint8_t* difference_from,
+    bool mirror_x
 ) {
     if (waveform == NULL) {
         return EPD_DRAW_NO_PHASES_AVAILABLE;
@@ -162,27 +218,40 @@ enum EpdDrawError IRAM_ATTR epd_draw_base(
     render_context.error = EPD_DRAW_SUCCESS;
     render_context.drawn_lines = drawn_lines;
     render_context.data_ptr = data;
+    render_context.difference_from = difference_from;
+    render_context.mirror_x = mirror_x;
+    set_context_regions(&render_context, regions);
+    render_context.num_mode_slots = 0;
+    for (int i = 0; i < EPD_MAX_DRAW_REGIONS - 1; i++) {
+        render_context.mode_slots[i].in_use = false;
+    }
+    render_context.main_frames = frame_count;
     render_context.lut_build_func = lut_functions.build_func;
     render_context.lut_lookup_func = lut_functions.lookup_func;
+    render_context.lut_patch_func = lut_functions.patch_func;
 
     render_context.lines_prepared = 0;
     render_context.lines_consumed = 0;
     render_context.lines_total = rounded_display_height();
     render_context.current_frame = 0;
     render_context.cycle_frames = frame_count;
-    render_context.phase_times = NULL;
-    if (waveform_phases != NULL && waveform_phases->phase_times != NULL) {
-        render_context.phase_times = waveform_phases->phase_times;
-    }
 
     epd_populate_line_mask(
         render_context.line_mask, drawn_columns, render_context.display_width / 4
     );
+    return EPD_DRAW_SUCCESS;
+}
 
+/**
+ * Output all frames of the draw set up in the render context.
+ */
+static enum EpdDrawError IRAM_ATTR run_draw() {
 #ifdef RENDER_METHOD_I2S
     i2s_do_update(&render_context);
 #elif defined(RENDER_METHOD_LCD)
     lcd_do_update(&render_context);
+#elif defined(RENDER_METHOD_HOST)
+    host_do_update(&render_context);
 #endif
 
     if (render_context.error & EPD_DRAW_EMPTY_LINE_QUEUE) {
@@ -195,6 +264,532 @@ enum EpdDrawError IRAM_ATTR epd_draw_base(
     return EPD_DRAW_SUCCESS;
 }
 
+/**
+ * Common implementation of the blocking draw functions.
+ * Waits for an asynchronous draw in progress to finish first.
+ */
+static enum EpdDrawError IRAM_ATTR draw_regions(
+    EpdRect area,
+    const uint8_t* data,
+    EpdRect crop_to,
+    enum EpdDrawMode mode,
+    int temperature,
+    const bool* drawn_lines,
+    const uint8_t* drawn_columns,
+    const EpdWaveform* waveform,
+    const EpdDirtyRegions* regions,
+    const uint8_t* difference_from,
+    bool mirror_x
+) {
+    xSemaphoreTake(render_context.draw_idle, portMAX_DELAY);
+    enum EpdDrawError err = setup_draw(
+        area,
+        data,
+        crop_to,
+        mode,
+        temperature,
+        drawn_lines,
+        drawn_columns,
+        waveform,
+        regions,
+        difference_from,
+        mirror_x
+    );
+    if (err == EPD_DRAW_SUCCESS) {
+        err = run_draw();
+    }
+    render_context.draw_result = err;
+    xSemaphoreGive(render_context.draw_idle);
+    return err;
+}
+
+enum EpdDrawError IRAM_ATTR epd_draw_base_async(
+    EpdRect area,
+    const uint8_t* data,
+    EpdRect crop_to,
+    enum EpdDrawMode mode,
+    int temperature,
+    const bool* drawn_lines,
+    const uint8_t* drawn_columns,
+    const EpdWaveform* waveform,
+    EpdDrawCallback on_done,
+    void* user_data
+) {
+    xSemaphoreTake(render_context.draw_idle, portMAX_DELAY);
+    enum EpdDrawError err = setup_draw(
+        area,
+        data,
+        crop_to,
+        mode,
+        temperature,
+        drawn_lines,
+        drawn_columns,
+        waveform,
+        NULL,
+        NULL,
+        false
+    );
+    if (err != EPD_DRAW_SUCCESS) {
+        render_context.draw_result = err;
+        xSemaphoreGive(render_context.draw_idle);
+        return err;
+    }
+
+    render_context.draw_result = EPD_DRAW_SUCCESS;
+    render_context.draw_done_cb = on_done;
+    render_context.draw_done_data = user_data;
+    xTaskNotifyGive(render_context.draw_task);
+    return EPD_DRAW_SUCCESS;
+}
+
+enum EpdDrawError epd_draw_wait() {
+    xSemaphoreTake(render_context.draw_idle, portMAX_DELAY);
+    enum EpdDrawError result = render_context.draw_result;
+    render_context.draw_result_read = true;
+    xSemaphoreGive(render_context.draw_idle);
+    return result;
+}
+
+bool epd_draw_in_progress() {
+    if (xSemaphoreTake(render_context.draw_idle, 0) != pdTRUE) {
+        return true;
+    }
+    xSemaphoreGive(render_context.draw_idle);
+    return false;
+}
+
+/**
+ * Runs the asynchronous draws started by `epd_draw_base_async()`.
+ */
+static void draw_thread(void* arg) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        enum EpdDrawError err = run_draw();
+        render_context.draw_result |= err;
+        if (render_context.draw_done_cb != NULL) {
+            render_context.draw_done_cb(err, render_context.draw_done_data);
+        }
+        xSemaphoreGive(render_context.draw_idle);
+    }
+}
+
+enum EpdDrawError IRAM_ATTR epd_draw_regions(
+    EpdRect area,
+    const uint8_t* data,
+    EpdRect crop_to,
+    enum EpdDrawMode mode,
+    int temperature,
+    const bool* drawn_lines,
+    const uint8_t* drawn_columns,
+    const EpdWaveform* waveform,
+    const EpdDirtyRegions* regions
+) {
+    return draw_regions(
+        area,
+        data,
+        crop_to,
+        mode,
+        temperature,
+        drawn_lines,
+        drawn_columns,
+        waveform,
+        regions,
+        NULL,
+        false
+    );
+}
+
+enum EpdDrawError IRAM_ATTR epd_draw_difference(
+    const uint8_t* to,
+    const uint8_t* from,
+    enum EpdDrawMode mode,
+    int temperature,
+    const bool* drawn_lines,
+    const uint8_t* drawn_columns,
+    const EpdWaveform* waveform,
+    const EpdDirtyRegions* regions,
+    bool mirror_x
+) {
+    // both buffers are read at the same offsets, so they must be equally aligned
+    assert((uintptr_t)to % 16 == (uintptr_t)from % 16);
+    return draw_regions(
+        epd_full_screen(),
+        to,
+        epd_full_screen(),
+        MODE_PACKING_1PPB_DIFFERENCE | mode,
+        temperature,
+        drawn_lines,
+        drawn_columns,
+        waveform,
+        regions,
+        from,
+        mirror_x
+    );
+}
+
+/**
+ * Find the waveform phases drawn for a mode, like `setup_draw()` does.
+ */
+static enum EpdDrawError find_mode_phases(
+    const EpdWaveform* waveform,
+    enum EpdDrawMode mode,
+    int temperature,
+    const EpdWaveformPhases** phases,
+    int* frames
+) {
+    if (waveform == NULL) {
+        return EPD_DRAW_NO_PHASES_AVAILABLE;
+    }
+    int waveform_range = waveform_temp_range_index(waveform, temperature);
+    if (waveform_range < 0) {
+        return EPD_DRAW_NO_PHASES_AVAILABLE;
+    }
+
+    // monochrome draws use the phases of the first mode, but only one frame
+    int waveform_index = 0;
+    if (!(mode & MODE_EPDIY_MONOCHROME)) {
+        waveform_index = get_waveform_index(waveform, mode);
+        if (waveform_index < 0) {
+            return EPD_DRAW_MODE_NOT_FOUND;
+        }
+    }
+    *phases = waveform->mode_data[waveform_index]->range_data[waveform_range];
+    *frames = (mode & MODE_EPDIY_MONOCHROME) ? 1 : (*phases)->phases;
+    return EPD_DRAW_SUCCESS;
+}
+
+/**
+ * Set up an additional mode slot of a multi-mode draw, allocating its LUT if needed.
+ */
+static enum EpdDrawError setup_mode_slot(
+    RenderModeSlot* slot, const EpdDrawRegion* region, int temperature
+) {
+    enum EpdDrawError err = find_mode_phases(
+        region->waveform, region->mode, temperature, &slot->phases, &slot->frames
+    );
+    if (err != EPD_DRAW_SUCCESS) {
+        return err;
+    }
+
+    slot->mode = region->mode;
+    slot->lut_functions = find_lut_functions(region->mode, render_context.conversion_lut_size);
+    if (slot->lut_functions.build_func == NULL || slot->lut_functions.lookup_func == NULL) {
+        ESP_LOGE("epdiy", "no output lookup method found for your mode and LUT size!");
+        return EPD_DRAW_LOOKUP_NOT_IMPLEMENTED;
+    }
+
+    if (slot->lut == NULL) {
+        slot->lut = (uint8_t*)heap_caps_malloc(
+            render_context.conversion_lut_size, MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL
+        );
+        if (slot->lut == NULL) {
+            ESP_LOGE("epdiy", "could not allocate LUT for a draw region!");
+            return EPD_DRAW_FAILED_ALLOC;
+        }
+        slot->lut_state.build_func = NULL;
+    }
+    if (slot->lut_next == NULL && render_context.conversion_lut_next != NULL) {
+        slot->lut_next = (uint8_t*)heap_caps_malloc(
+            render_context.conversion_lut_size, MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL
+        );
+        if (slot->lut_next == NULL) {
+            ESP_LOGW("epdiy", "could not allocate second LUT for a draw region.");
+        }
+        slot->lut_next_state.build_func = NULL;
+    }
+    return EPD_DRAW_SUCCESS;
+}
+
+/**
+ * Set up the render context for a multi-mode draw.
+ * The mode with the most frames becomes the draw mode with the main LUT,
+ * all other modes get mode slots.
+ */
+static enum EpdDrawError setup_multi_draw(
+    const uint8_t* data, const EpdDrawRegion* regions, int num_regions, int temperature
+) {
+    if (num_regions <= 0 || num_regions > EPD_MAX_DRAW_REGIONS) {
+        return EPD_DRAW_INVALID_CROP;
+    }
+
+    int primary = 0;
+    int primary_frames = 0;
+    enum EpdDrawMode packing = mode_packing(regions[0].mode);
+    for (int i = 0; i < num_regions; i++) {
+        const EpdWaveformPhases* phases;
+        int frames;
+        enum EpdDrawError err = find_mode_phases(
+            regions[i].waveform, regions[i].mode, temperature, &phases, &frames
+        );
+        if (err != EPD_DRAW_SUCCESS) {
+            return err;
+        }
+        if (frames > primary_frames) {
+            primary = i;
+            primary_frames = frames;
+        }
+
+        // all regions share one framebuffer
+        if (mode_packing(regions[i].mode) != packing) {
+            return EPD_DRAW_INVALID_PACKING_MODE;
+        }
+        for (int j = 0; j < i; j++) {
+            if (rects_overlap(regions[i].area, regions[j].area)) {
+                return EPD_DRAW_INVALID_CROP;
+            }
+        }
+    }
+
+    enum EpdDrawError err = setup_draw(
+        epd_full_screen(),
+        data,
+        epd_full_screen(),
+        regions[primary].mode,
+        temperature,
+        NULL,
+        NULL,
+        regions[primary].waveform,
+        NULL,
+        NULL,
+        false
+    );
+    if (err != EPD_DRAW_SUCCESS) {
+        return err;
+    }
+
+    // regions with the same mode and waveform share a slot
+    const EpdDrawRegion* slot_regions[EPD_MAX_DRAW_REGIONS];
+    slot_regions[0] = &regions[primary];
+    int num_slots = 1;
+    for (int i = 0; i < num_regions; i++) {
+        EpdRect area = regions[i].area;
+        int x_end = min(area.x + area.width, epd_width());
+        int y_end = min(area.y + area.height, epd_height());
+        area.x = max(area.x, 0);
+        area.y = max(area.y, 0);
+        area.width = x_end - area.x;
+        area.height = y_end - area.y;
+        if (area.width <= 0 || area.height <= 0) {
+            continue;
+        }
+
+        int slot = 0;
+        while (slot < num_slots
+               && (slot_regions[slot]->mode != regions[i].mode
+                   || slot_regions[slot]->waveform != regions[i].waveform)) {
+            slot++;
+        }
+        if (slot == num_slots) {
+            err = setup_mode_slot(&render_context.mode_slots[slot - 1], &regions[i], temperature);
+            if (err != EPD_DRAW_SUCCESS) {
+                return err;
+            }
+            render_context.mode_slots[slot - 1].start_frame = 0;
+            render_context.mode_slots[slot - 1].in_use = true;
+            slot_regions[num_slots++] = &regions[i];
+        }
+        add_context_region(&render_context, area, slot);
+    }
+    render_context.num_mode_slots = num_slots - 1;
+
+    // an empty region list would draw the full screen
+    if (render_context.num_regions == 0) {
+        render_context.cycle_frames = 0;
+    }
+    return EPD_DRAW_SUCCESS;
+}
+
+enum EpdDrawError epd_draw_multi(
+    const uint8_t* data, const EpdDrawRegion* regions, int num_regions, int temperature
+) {
+    xSemaphoreTake(render_context.draw_idle, portMAX_DELAY);
+    enum EpdDrawError err = setup_multi_draw(data, regions, num_regions, temperature);
+    if (err == EPD_DRAW_SUCCESS) {
+        err = run_draw();
+    }
+    render_context.draw_result = err;
+    xSemaphoreGive(render_context.draw_idle);
+    return err;
+}
+
+/**
+ * Check if `area` overlaps a region of the pipelined draw or one waiting to join it.
+ * Must be called with `join_lock` taken.
+ */
+static bool overlaps_pipelined_regions(EpdRect area) {
+    for (int i = 0; i < render_context.num_regions; i++) {
+        if (rects_overlap(area, render_context.regions[i])) {
+            return true;
+        }
+    }
+    for (int i = 0; i < render_context.num_joined; i++) {
+        if (rects_overlap(area, render_context.joined_regions[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Check if `regions` of a draw of `data` fit into the pipelined draw in progress.
+ * Must be called with `join_lock` taken.
+ */
+static bool can_join_pipelined_draw(
+    const uint8_t* data, enum EpdDrawMode mode, const EpdDirtyRegions* regions
+) {
+    if (!render_context.pipelined || render_context.data_ptr != data
+        || mode_packing(render_context.mode) != mode_packing(mode)
+        || render_context.num_regions + render_context.num_joined + regions->count
+               > EPD_MAX_DIRTY_REGIONS) {
+        return false;
+    }
+    for (int i = 0; i < regions->count; i++) {
+        if (overlaps_pipelined_regions(regions->rects[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Find the mode slot of regions joining the pipelined draw with the same frame and mode,
+ * which they share. Otherwise, returns -1 and sets `free_slot` to a slot that is
+ * not in use, or NULL if none is left. Must be called with `join_lock` taken.
+ */
+static int find_join_slot(
+    enum EpdDrawMode mode, const EpdWaveformPhases* phases, RenderModeSlot** free_slot
+) {
+    *free_slot = NULL;
+    for (int i = 0; i < EPD_MAX_DRAW_REGIONS - 1; i++) {
+        RenderModeSlot* s = &render_context.mode_slots[i];
+        if (s->in_use && s->start_frame < 0 && s->mode == mode && s->phases == phases) {
+            return i + 1;
+        }
+        if (!s->in_use && *free_slot == NULL) {
+            *free_slot = s;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Let `regions` join the pipelined draw in progress with its next frame.
+ * Sets `joined` to false if they can't, because no pipelined draw of the same
+ * framebuffer is in progress, they overlap regions of it or there is no room left.
+ */
+static enum EpdDrawError join_pipelined_draw(
+    const uint8_t* data,
+    enum EpdDrawMode mode,
+    int temperature,
+    const EpdWaveform* waveform,
+    const EpdDirtyRegions* regions,
+    bool* joined
+) {
+    const EpdWaveformPhases* phases;
+    int frames;
+    enum EpdDrawError err = find_mode_phases(waveform, mode, temperature, &phases, &frames);
+    if (err != EPD_DRAW_SUCCESS) {
+        return err;
+    }
+
+    int slot = -1;
+    RenderModeSlot* free_slot = NULL;
+    xSemaphoreTake(render_context.join_lock, portMAX_DELAY);
+    if (can_join_pipelined_draw(data, mode, regions)) {
+        slot = find_join_slot(mode, phases, &free_slot);
+    }
+    if (slot < 0 && free_slot != NULL) {
+        // The draw task takes the lock between frames, so the free slot is set up
+        // without it. Slots are only taken into use here, so it stays free.
+        xSemaphoreGive(render_context.join_lock);
+        EpdDrawRegion region = { .mode = mode, .waveform = waveform };
+        err = setup_mode_slot(free_slot, &region, temperature);
+        xSemaphoreTake(render_context.join_lock, portMAX_DELAY);
+
+        // the draw may have advanced or finished meanwhile
+        if (err == EPD_DRAW_SUCCESS && can_join_pipelined_draw(data, mode, regions)) {
+            free_slot->start_frame = -1;
+            free_slot->in_use = true;
+            slot = free_slot - render_context.mode_slots + 1;
+        }
+    }
+    for (int i = 0; slot > 0 && i < regions->count; i++) {
+        render_context.joined_regions[render_context.num_joined] = regions->rects[i];
+        render_context.joined_slot[render_context.num_joined] = slot;
+        render_context.num_joined++;
+    }
+    xSemaphoreGive(render_context.join_lock);
+
+    *joined = slot > 0;
+    return err;
+}
+
+enum EpdDrawError epd_draw_pipelined(
+    const uint8_t* data,
+    enum EpdDrawMode mode,
+    int temperature,
+    const EpdWaveform* waveform,
+    const EpdDirtyRegions* regions
+) {
+    if (regions == NULL || regions->count == 0) {
+        return EPD_DRAW_SUCCESS;
+    }
+
+    bool joined = false;
+    enum EpdDrawError err
+        = join_pipelined_draw(data, mode, temperature, waveform, regions, &joined);
+    if (err != EPD_DRAW_SUCCESS || joined) {
+        return err;
+    }
+
+    xSemaphoreTake(render_context.draw_idle, portMAX_DELAY);
+    // errors of the last draw are kept until epd_draw_wait() reports them
+    if (render_context.draw_result_read) {
+        render_context.draw_result = EPD_DRAW_SUCCESS;
+    }
+    render_context.draw_result_read = false;
+    err = setup_draw(
+        epd_full_screen(),
+        data,
+        epd_full_screen(),
+        mode,
+        temperature,
+        NULL,
+        NULL,
+        waveform,
+        regions,
+        NULL,
+        false
+    );
+    if (err != EPD_DRAW_SUCCESS) {
+        render_context.draw_result |= err;
+        xSemaphoreGive(render_context.draw_idle);
+        return err;
+    }
+
+    xSemaphoreTake(render_context.join_lock, portMAX_DELAY);
+    render_context.num_joined = 0;
+    render_context.pipelined = render_context.cycle_frames > 1;
+    xSemaphoreGive(render_context.join_lock);
+
+    render_context.draw_done_cb = NULL;
+    xTaskNotifyGive(render_context.draw_task);
+    return EPD_DRAW_SUCCESS;
+}
+
+bool epd_draw_is_driving(EpdRect area) {
+    if (!epd_draw_in_progress()) {
+        return false;
+    }
+    xSemaphoreTake(render_context.join_lock, portMAX_DELAY);
+    // other draws may drive any pixel
+    bool driving = !render_context.pipelined || overlaps_pipelined_regions(area);
+    xSemaphoreGive(render_context.join_lock);
+    return driving;
+}
+
+#ifndef RENDER_METHOD_HOST
 static void IRAM_ATTR render_thread(void* arg) {
     int thread_id = (int)arg;
 
@@ -204,7 +799,8 @@ static void IRAM_ATTR render_thread(void* arg) {
 #ifdef RENDER_METHOD_LCD
         lcd_calculate_frame(&render_context, thread_id);
 #elif defined(RENDER_METHOD_I2S)
-        if (thread_id == 0) {
+        // the last thread outputs the lines fetched by all others
+        if (thread_id < render_context.num_render_threads - 1) {
             i2s_fetch_frame_data(&render_context, thread_id);
         } else {
             i2s_output_frame(&render_context, thread_id);
@@ -214,6 +810,7 @@ static void IRAM_ATTR render_thread(void* arg) {
         xSemaphoreGive(render_context.feed_done_smphr[thread_id]);
     }
 }
+#endif
 
 void epd_clear_area(EpdRect area) {
     epd_clear_area_cycles(area, 3, clear_cycle_time);
@@ -247,6 +844,22 @@ void epd_renderer_init(enum EpdInitOptions options, const EpdInitConfig* config)
     render_context.display_width = epd_width();
     render_context.display_height = epd_height();
 
+    int render_threads = DEFAULT_RENDER_THREADS;
+    if (config != NULL && config->render_threads > 0) {
+        render_threads = config->render_threads;
+    }
+#ifdef RENDER_METHOD_I2S
+    if (render_threads < 2) {
+        ESP_LOGW("epd", "the I2S render method needs at least 2 render threads.");
+        render_threads = 2;
+    }
+#endif
+    if (render_threads > MAX_RENDER_THREADS) {
+        ESP_LOGW("epd", "limiting render threads to %d.", MAX_RENDER_THREADS);
+        render_threads = MAX_RENDER_THREADS;
+    }
+    render_context.num_render_threads = render_threads;
+
     size_t lut_size = 0;
     if (options & EPD_LUT_1K) {
         lut_size = 1 << 10;
@@ -271,27 +884,31 @@ void epd_renderer_init(enum EpdInitOptions options, const EpdInitConfig* config)
         abort();
     }
     render_context.conversion_lut_size = lut_size;
+    render_context.lut_state.build_func = NULL;
+
+    render_context.conversion_lut_next = NULL;
+    render_context.lut_next_state.build_func = NULL;
+    if (options & EPD_LUT_DOUBLE_BUFFERED) {
+        render_context.conversion_lut_next
+            = (uint8_t*)heap_caps_malloc(lut_size, MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+        if (render_context.conversion_lut_next == NULL) {
+            ESP_LOGW("epd", "could not allocate second LUT, building LUTs between frames.");
+        }
+    }
     render_context.static_line_buffer = NULL;
 
     render_context.frame_done = xSemaphoreCreateBinary();
-
-    for (int i = 0; i < NUM_RENDER_THREADS; i++) {
+    render_context.draw_idle = xSemaphoreCreateBinary();
+    render_context.draw_result = EPD_DRAW_SUCCESS;
+    render_context.draw_result_read = true;
+    xSemaphoreGive(render_context.draw_idle);
+    render_context.join_lock = xSemaphoreCreateMutex();
+    render_context.pipelined = false;
+
+    for (int i = 0; i < render_threads; i++) {
         render_context.feed_done_smphr[i] = xSemaphoreCreateBinary();
     }
 
-    // When using the LCD peripheral, we may need padding lines to
-    // satisfy the bounce buffer size requirements
-    render_context.line_threads = (uint8_t*)heap_caps_malloc(
-        rounded_display_height(), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL
-    );
-
-    int queue_len = 32;
-    if (options & EPD_FEED_QUEUE_32) {
-        queue_len = 32;
-    } else if (options & EPD_FEED_QUEUE_8) {
-        queue_len = 8;
-    }
-
     if (render_context.conversion_lut == NULL) {
         ESP_LOGE("epd", "could not allocate line mask!");
         abort();
@@ -301,18 +918,30 @@ void epd_renderer_init(enum EpdInitOptions options, const EpdInitConfig* config)
         = heap_caps_aligned_alloc(16, epd_width() / 4, MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
     assert(render_context.line_mask != NULL);
 
-#ifdef RENDER_METHOD_LCD
+    render_context.band_dirtyness
+        = heap_caps_aligned_alloc(16, epd_width() / 2, MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    assert(render_context.band_dirtyness != NULL);
+    render_context.difference_scratch_line
+        = heap_caps_aligned_alloc(16, epd_width(), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    assert(render_context.difference_scratch_line != NULL);
+
+#if defined(RENDER_METHOD_LCD) || defined(RENDER_METHOD_HOST)
     size_t queue_elem_size = render_context.display_width / 4;
 #elif defined(RENDER_METHOD_I2S)
     size_t queue_elem_size = render_context.display_width;
 #endif
 
-    for (int i = 0; i < NUM_RENDER_THREADS; i++) {
-        render_context.line_queues[i] = lq_init(queue_len, queue_elem_size);
-        render_context.feed_line_buffers[i] = (uint8_t*)heap_caps_malloc(
-            render_context.display_width, MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL
+    render_context.line_queue
+        = lq_init(render_queue_lines(options, render_threads), queue_elem_size);
+
+    for (int i = 0; i < render_threads; i++) {
+        render_context.feed_line_buffers[i] = (uint8_t*)heap_caps_aligned_alloc(
+            16, render_context.display_width, MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL
         );
         assert(render_context.feed_line_buffers[i] != NULL);
+#ifdef RENDER_METHOD_HOST
+        host_start_feed_thread(&render_context, i);
+#else
         RTOS_ERROR_CHECK(xTaskCreatePinnedToCore(
             render_thread,
             "epd_prep",
@@ -320,19 +949,41 @@ void epd_renderer_init(enum EpdInitOptions options, const EpdInitConfig* config)
             (void*)i,
             configMAX_PRIORITIES - 1,
             &render_context.feed_tasks[i],
-            i
+            i % portNUM_PROCESSORS
         ));
+#endif
     }
+
+    // draws run on the core the output interrupts are allocated on, like blocking draws
+    // from the initializing task did.
+    RTOS_ERROR_CHECK(xTaskCreatePinnedToCore(
+        draw_thread,
+        "epd_draw",
+        1 << 12,
+        NULL,
+        configMAX_PRIORITIES - 1,
+        &render_context.draw_task,
+        xPortGetCoreID()
+    ));
 }
 
 void epd_renderer_deinit() {
     const EpdBoardDefinition* epd_board = epd_current_board();
 
+    // finish an asynchronous draw before tearing down
+    epd_draw_wait();
+    vTaskDelete(render_context.draw_task);
+
     epd_board->poweroff(epd_ctrl_state());
 
-    for (int i = 0; i < NUM_RENDER_THREADS; i++) {
+#ifdef RENDER_METHOD_HOST
+    host_stop_feed_threads();
+#endif
+
+    for (int i = 0; i < render_context.num_render_threads; i++) {
+#ifndef RENDER_METHOD_HOST
         vTaskDelete(render_context.feed_tasks[i]);
-        lq_free(&render_context.line_queues[i]);
+#endif
         heap_caps_free(render_context.feed_line_buffers[i]);
         vSemaphoreDelete(render_context.feed_done_smphr[i]);
     }
@@ -347,10 +998,44 @@ void epd_renderer_deinit() {
         epd_board->deinit();
     }
 
+    lq_free(&render_context.line_queue);
     heap_caps_free(render_context.conversion_lut);
-    heap_caps_free(render_context.line_threads);
+    heap_caps_free(render_context.conversion_lut_next);
+    for (int i = 0; i < EPD_MAX_DRAW_REGIONS - 1; i++) {
+        heap_caps_free(render_context.mode_slots[i].lut);
+        render_context.mode_slots[i].lut = NULL;
+        heap_caps_free(render_context.mode_slots[i].lut_next);
+        render_context.mode_slots[i].lut_next = NULL;
+    }
     heap_caps_free(render_context.line_mask);
+    heap_caps_free(render_context.band_dirtyness);
+    render_context.band_dirtyness = NULL;
+    heap_caps_free(render_context.difference_scratch_line);
+    render_context.difference_scratch_line = NULL;
     vSemaphoreDelete(render_context.frame_done);
+    vSemaphoreDelete(render_context.draw_idle);
+    vSemaphoreDelete(render_context.join_lock);
+}
+
+bool epd_get_render_stats(EpdRenderStats* stats) {
+#if EPD_RENDER_STATS
+    render_stats_get(stats);
+    LineQueue_t* lq = &render_context.line_queue;
+    stats->queue_low_water = lq->low_water == INT_MAX ? -1 : lq->low_water;
+    stats->queue_high_water = lq->high_water;
+    stats->underruns = lq->underruns;
+    stats->num_threads = render_context.num_render_threads;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void epd_reset_render_stats() {
+#if EPD_RENDER_STATS
+    render_stats_reset();
+#endif
+    lq_reset_stats(&render_context.line_queue);
 }
 
 #ifdef RENDER_METHOD_LCD
@@ -367,22 +1052,69 @@ uint32_t epd_interlace_4bpp_line_VE(
  * Interlaces `len` nibbles from the buffers `to` and `from` into `interlaced`.
  * In the process, tracks which nibbles differ in `col_dirtyness`.
  * Returns `1` if there are differences, `0` otherwise.
- * Does not require special alignment of the buffers beyond 32 bit alignment.
+ * Does not require special alignment of the buffers.
  */
 __attribute__((optimize("O3"))) static inline int _interlace_line_unaligned(
     const uint8_t* to, const uint8_t* from, uint8_t* interlaced, uint8_t* col_dirtyness, int len
 ) {
-    int dirty = 0;
-    for (int x = 0; x < len; x++) {
-        uint8_t t = *(to + x / 2);
-        uint8_t f = *(from + x / 2);
-        t = (x % 2) ? (t >> 4) : (t & 0x0f);
-        f = (x % 2) ? (f >> 4) : (f & 0x0f);
-        col_dirtyness[x / 2] |= (t ^ f) << (4 * (x % 2));
-        dirty |= (t ^ f);
-        interlaced[x] = (t << 4) | f;
+    // both pixels of a byte differ from each other in the same bits
+    uint8_t dirty = 0;
+    for (int x = 0; x < len / 2; x++) {
+        uint8_t t = to[x];
+        uint8_t f = from[x];
+        col_dirtyness[x] |= t ^ f;
+        dirty |= t ^ f;
+        interlaced[2 * x] = (t << 4) | (f & 0x0F);
+        interlaced[2 * x + 1] = (t & 0xF0) | (f >> 4);
     }
-    return dirty;
+    if (len % 2) {
+        uint8_t t = to[len / 2] & 0x0F;
+        uint8_t f = from[len / 2] & 0x0F;
+        col_dirtyness[len / 2] |= t ^ f;
+        dirty |= t ^ f;
+        interlaced[len - 1] = (t << 4) | f;
+    }
+    return dirty != 0;
+}
+
+/**
+ * Move the two low bytes of `x` to the even bytes of a word.
+ */
+static inline uint32_t spread_bytes(uint32_t x) {
+    return (x | (x << 8)) & 0x00FF00FF;
+}
+
+/**
+ * Like `_interlace_line_unaligned()`, but processes 8 pixels per step in 32-bit words.
+ * All buffers must be 32-bit aligned. Assumes a little-endian CPU, as all targets are.
+ */
+__attribute__((optimize("O3"))) static inline int _interlace_line_words(
+    const uint8_t* to, const uint8_t* from, uint8_t* interlaced, uint8_t* col_dirtyness, int len
+) {
+    const uint32_t* to32 = (const uint32_t*)to;
+    const uint32_t* from32 = (const uint32_t*)from;
+    uint32_t* interlaced32 = (uint32_t*)interlaced;
+    uint32_t* col_dirtyness32 = (uint32_t*)col_dirtyness;
+
+    uint32_t dirty = 0;
+    for (int i = 0; i < len / 8; i++) {
+        uint32_t t = to32[i];
+        uint32_t f = from32[i];
+        col_dirtyness32[i] |= t ^ f;
+        dirty |= t ^ f;
+
+        // output bytes of the even and of the odd pixels
+        uint32_t even = ((t & 0x0F0F0F0F) << 4) | (f & 0x0F0F0F0F);
+        uint32_t odd = (t & 0xF0F0F0F0) | ((f >> 4) & 0x0F0F0F0F);
+        interlaced32[2 * i] = spread_bytes(even & 0xFFFF) | (spread_bytes(odd & 0xFFFF) << 8);
+        interlaced32[2 * i + 1] = spread_bytes(even >> 16) | (spread_bytes(odd >> 16) << 8);
+    }
+
+    int done = len / 8 * 8;
+    dirty |= _interlace_line_unaligned(
+        to + done / 2, from + done / 2, interlaced + done, col_dirtyness + done / 2, len - done
+    );
+    return dirty != 0;
 }
 
 /**
@@ -396,8 +1128,12 @@ __attribute__((optimize("O3"))) bool _epd_interlace_line(
     uint8_t* col_dirtyness,
     int fb_width
 ) {
-#ifdef RENDER_METHOD_I2S
-    return _interlace_line_unaligned(to, from, interlaced, col_dirtyness, fb_width) > 0;
+#if defined(RENDER_METHOD_I2S) || defined(RENDER_METHOD_HOST)
+    if (((uintptr_t)to | (uintptr_t)from | (uintptr_t)interlaced | (uintptr_t)col_dirtyness) % 4
+        == 0) {
+        return _interlace_line_words(to, from, interlaced, col_dirtyness, fb_width);
+    }
+    return _interlace_line_unaligned(to, from, interlaced, col_dirtyness, fb_width);
 #elif defined(RENDER_METHOD_LCD)
     // Use Vector Extensions with the ESP32-S3.
     // Both input buffers should have the same alignment w.r.t. 16 bytes,
@@ -410,6 +1146,11 @@ __attribute__((optimize("O3"))) bool _epd_interlace_line(
     int unaligned_back_start_px = fb_width - unaligned_len_back_px;
     int aligned_len_px = fb_width - unaligned_len_front_px - unaligned_len_back_px;
 
+    // short spans of a line may not reach an aligned block
+    if (aligned_len_px <= 0) {
+        return _interlace_line_unaligned(to, from, interlaced, col_dirtyness, fb_width);
+    }
+
     dirty |= _interlace_line_unaligned(to, from, interlaced, col_dirtyness, unaligned_len_front_px);
     dirty |= epd_interlace_4bpp_line_VE(
         to + unaligned_len_front_px / 2,
@@ -429,6 +1170,290 @@ __attribute__((optimize("O3"))) bool _epd_interlace_line(
 #endif
 }
 
+/// Height of the bands of lines in which dirty regions are detected.
+#define DIRTY_REGION_BAND_HEIGHT 16
+/// Gaps between changed pixels in a band narrower than this are included in a region.
+#define DIRTY_REGION_MIN_GAP 32
+/// Estimated output cost of a region, in addition to its pixels, in pixels.
+#define DIRTY_REGION_OVERHEAD 4096
+/// Estimated output cost of each line of a region, in addition to its pixels, in pixels.
+#define DIRTY_REGION_LINE_OVERHEAD 64
+
+static inline int region_cost(EpdRect r) {
+    return DIRTY_REGION_OVERHEAD + r.height * (r.width + DIRTY_REGION_LINE_OVERHEAD);
+}
+
+static inline EpdRect rect_union(EpdRect a, EpdRect b) {
+    int x = min(a.x, b.x);
+    int y = min(a.y, b.y);
+    EpdRect u = {
+        .x = x,
+        .y = y,
+        .width = max(a.x + a.width, b.x + b.width) - x,
+        .height = max(a.y + a.height, b.y + b.height) - y,
+    };
+    return u;
+}
+
+/**
+ * Add a rectangle to a region list. It is merged with existing regions
+ * when that lowers the estimated output cost, to keep the regions disjoint,
+ * and to stay within `EPD_MAX_DIRTY_REGIONS`.
+ */
+static void dirty_regions_add(EpdDirtyRegions* regions, EpdRect rect) {
+    while (true) {
+        int best = -1;
+        int best_gain = INT_MIN;
+        for (int i = 0; i < regions->count; i++) {
+            EpdRect other = regions->rects[i];
+            int gain = INT_MAX;
+            if (!rects_overlap(rect, other)) {
+                gain = region_cost(rect) + region_cost(other)
+                       - region_cost(rect_union(rect, other));
+            }
+            if (gain > best_gain) {
+                best = i;
+                best_gain = gain;
+            }
+        }
+
+        if (best < 0 || (best_gain < 0 && regions->count < EPD_MAX_DIRTY_REGIONS)) {
+            break;
+        }
+        rect = rect_union(rect, regions->rects[best]);
+        regions->rects[best] = regions->rects[--regions->count];
+    }
+    regions->rects[regions->count++] = rect;
+}
+
+/**
+ * Add the spans of changed pixels in a band of lines to a region list.
+ */
+static void dirty_regions_add_band(
+    EpdDirtyRegions* regions,
+    const uint8_t* band_dirtyness,
+    int x_start,
+    int x_end,
+    int y_start,
+    int y_end
+) {
+    int span_start = -1;
+    int span_end = -1;
+    for (int x = x_start; x < x_end; x++) {
+        uint8_t mask = x % 2 ? 0xF0 : 0x0F;
+        if ((band_dirtyness[x / 2] & mask) == 0) {
+            continue;
+        }
+        if (span_start >= 0 && x - span_end > DIRTY_REGION_MIN_GAP) {
+            EpdRect span = { span_start, y_start, span_end - span_start, y_end - y_start };
+            dirty_regions_add(regions, span);
+            span_start = -1;
+        }
+        if (span_start < 0) {
+            span_start = x;
+        }
+        span_end = x + 1;
+    }
+    if (span_start >= 0) {
+        EpdRect span = { span_start, y_start, span_end - span_start, y_end - y_start };
+        dirty_regions_add(regions, span);
+    }
+}
+
+/**
+ * Reverse the order of the 1-byte pixels of an interlaced line.
+ */
+static void mirror_interlaced_line(uint8_t* line, int len) {
+    for (int i = 0, j = len - 1; i < j; i++, j--) {
+        uint8_t t = line[i];
+        line[i] = line[j];
+        line[j] = t;
+    }
+}
+
+/**
+ * Move the 1-byte pixels `x_start` to `x_end` (exclusive) of an interlaced line
+ * of `len` pixels to their horizontally mirrored position.
+ * The other pixels of the line are not preserved.
+ */
+static void mirror_interlaced_columns(uint8_t* line, int len, int x_start, int x_end) {
+    mirror_interlaced_line(line + x_start, x_end - x_start);
+    memmove(line + len - x_end, line + x_start, x_end - x_start);
+}
+
+/**
+ * Write the pixels `x_start` to `x_end` (exclusive) of the line `to` to an interlaced line
+ * as unchanged. Both are multiples of 8.
+ */
+static void interlace_unchanged(
+    const uint8_t* to, uint8_t* interlaced, uint8_t* col_dirtyness, int x_start, int x_end
+) {
+    if (x_start < x_end) {
+        _epd_interlace_line(
+            to + x_start / 2,
+            to + x_start / 2,
+            interlaced + x_start,
+            col_dirtyness + x_start / 2,
+            x_end - x_start
+        );
+    }
+}
+
+/**
+ * Reverse the order of the 4-bit columns of a column dirtyness buffer.
+ */
+static void mirror_col_dirtyness(uint8_t* col_dirtyness, int len) {
+    for (int i = 0, j = len - 1; i <= j; i++, j--) {
+        uint8_t t = col_dirtyness[i];
+        col_dirtyness[i] = (col_dirtyness[j] >> 4) | (col_dirtyness[j] << 4);
+        col_dirtyness[j] = (t >> 4) | (t << 4);
+    }
+}
+
+/**
+ * Copy the 4bpp pixels `x_start` to `x_end` (exclusive) of a line from `src` to `dst`.
+ */
+static void copy_line_pixels(uint8_t* dst, const uint8_t* src, int x_start, int x_end) {
+    if (x_start >= x_end) {
+        return;
+    }
+    if (x_start % 2) {
+        dst[x_start / 2] = (src[x_start / 2] & 0xF0) | (dst[x_start / 2] & 0x0F);
+        x_start += 1;
+    }
+    if (x_end % 2) {
+        x_end -= 1;
+        dst[x_end / 2] = (src[x_end / 2] & 0x0F) | (dst[x_end / 2] & 0xF0);
+    }
+    memcpy(dst + x_start / 2, src + x_start / 2, (x_end - x_start) / 2);
+}
+
+/**
+ * Get the columns of the framebuffer that are displayed in the columns of `crop_to`.
+ */
+static void framebuffer_columns(
+    EpdRect crop_to, int fb_width, bool mirror_x, int* x_start, int* x_end
+) {
+    int end = min(fb_width, crop_to.x + crop_to.width);
+    *x_start = mirror_x ? fb_width - end : crop_to.x;
+    *x_end = mirror_x ? fb_width - crop_to.x : end;
+}
+
+void epd_sync_dirty_lines(
+    uint8_t* dst,
+    const uint8_t* src,
+    EpdRect crop_to,
+    int fb_width,
+    int fb_height,
+    const bool* dirty_lines,
+    bool mirror_x
+) {
+    int x_start, x_end;
+    framebuffer_columns(crop_to, fb_width, mirror_x, &x_start, &x_end);
+    int y_end = min(fb_height, crop_to.y + crop_to.height);
+    for (int y = max(crop_to.y, 0); y < y_end; y++) {
+        if (dirty_lines[y]) {
+            uint32_t offset = y * fb_width / 2;
+            copy_line_pixels(dst + offset, src + offset, x_start, x_end);
+        }
+    }
+}
+
+void epd_interlace_dirty_lines(
+    const uint8_t* to,
+    const uint8_t* from,
+    uint8_t* interlaced,
+    EpdRect crop_to,
+    int fb_width,
+    int fb_height,
+    const bool* dirty_lines,
+    bool mirror_x
+) {
+    int x_start, x_end;
+    framebuffer_columns(crop_to, fb_width, mirror_x, &x_start, &x_end);
+    int y_end = min(fb_height, crop_to.y + crop_to.height);
+    for (int y = max(crop_to.y, 0); y < y_end; y++) {
+        if (!dirty_lines[y]) {
+            continue;
+        }
+        const uint8_t* to_line = to + y * fb_width / 2;
+        const uint8_t* from_line = from + y * fb_width / 2;
+        uint8_t* line = interlaced + y * fb_width;
+        for (int x = x_start; x < x_end; x++) {
+            int shift = (x % 2) * 4;
+            uint8_t t = (to_line[x / 2] >> shift) & 0x0F;
+            uint8_t f = (from_line[x / 2] >> shift) & 0x0F;
+            line[mirror_x ? fb_width - 1 - x : x] = (t << 4) | f;
+        }
+    }
+}
+
+/**
+ * Check if the recorded changes of a row intersect the framebuffer columns
+ * `[x_start, x_end)`, and remove these columns from them.
+ * Changes on both sides of the columns are kept as a whole.
+ */
+static bool take_row_changes(EpdRowChanges* row, int x_start, int x_end) {
+    if (row->start >= row->end || row->end <= x_start || row->start >= x_end) {
+        return false;
+    }
+    if (row->start >= x_start && row->end <= x_end) {
+        row->end = row->start;
+    } else if (row->start >= x_start) {
+        row->start = x_end;
+    } else if (row->end <= x_end) {
+        row->end = x_start;
+    }
+    return true;
+}
+
+/**
+ * Get the columns to compare in rows `y_start` to `y_end` (exclusive), the smallest
+ * multiple-of-8 aligned range covering their recorded changes within `[x_start, x_end)`.
+ * The range is empty if there are no such changes.
+ */
+static void changed_columns(
+    const EpdRowChanges* row_changes,
+    int y_start,
+    int y_end,
+    int x_start,
+    int x_end,
+    int* cols_start,
+    int* cols_end
+) {
+    int start = x_end;
+    int end = x_start;
+    for (int y = y_start; y < y_end; y++) {
+        const EpdRowChanges* row = &row_changes[y];
+        if (row->start < row->end) {
+            start = min(start, max(row->start, x_start));
+            end = max(end, min(row->end, x_end));
+        }
+    }
+    *cols_start = start / 8 * 8;
+    *cols_end = start < end ? (end + 7) / 8 * 8 : *cols_start;
+}
+
+/**
+ * Get a 16 byte aligned scratch buffer of `size` bytes for a framebuffer `fb_width` pixels wide.
+ * This is `preallocated`, a buffer of the render context, unless the framebuffer is wider
+ * than the display. Otherwise it is allocated, and freed by `release_scratch()`.
+ */
+static uint8_t* get_scratch(uint8_t* preallocated, int fb_width, size_t size) {
+    if (preallocated != NULL && fb_width <= render_context.display_width) {
+        return preallocated;
+    }
+    uint8_t* scratch = heap_caps_aligned_alloc(16, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    assert(scratch != NULL);
+    return scratch;
+}
+
+static void release_scratch(uint8_t* preallocated, uint8_t* scratch) {
+    if (scratch != preallocated) {
+        heap_caps_free(scratch);
+    }
+}
+
 EpdRect epd_difference_image_base(
     const uint8_t* to,
     const uint8_t* from,
@@ -437,31 +1462,154 @@ EpdRect epd_difference_image_base(
     int fb_height,
     uint8_t* interlaced,
     bool* dirty_lines,
-    uint8_t* col_dirtyness
+    uint8_t* col_dirtyness,
+    EpdDirtyRegions* regions,
+    uint8_t* sync_to,
+    EpdRowChanges* row_changes,
+    bool mirror_x
 ) {
     assert(fb_width % 8 == 0);
     assert(col_dirtyness != NULL);
 
     // these buffers should be allocated 16 byte aligned
-    assert((uint32_t)to % 16 == 0);
-    assert((uint32_t)from % 16 == 0);
-    assert((uint32_t)col_dirtyness % 16 == 0);
-    assert((uint32_t)interlaced % 16 == 0);
+    assert((uintptr_t)to % 16 == 0);
+    assert((uintptr_t)from % 16 == 0);
+    assert((uintptr_t)col_dirtyness % 16 == 0);
+    assert((uintptr_t)interlaced % 16 == 0);
 
     memset(col_dirtyness, 0, fb_width / 2);
     memset(dirty_lines, 0, sizeof(bool) * fb_height);
 
+    // without a difference image, lines are interlaced to a scratch line
+    // only to find the changes.
+    uint8_t* scratch_line = NULL;
+    if (interlaced == NULL) {
+        scratch_line = get_scratch(render_context.difference_scratch_line, fb_width, fb_width);
+    }
+
     int x_end = min(fb_width, crop_to.x + crop_to.width);
     int y_end = min(fb_height, crop_to.y + crop_to.height);
 
-    for (int y = crop_to.y; y < y_end; y++) {
-        uint32_t offset = y * fb_width / 2;
-        int dirty = _epd_interlace_line(
-            to + offset, from + offset, interlaced + offset * 2, col_dirtyness, fb_width
-        );
-        dirty_lines[y] = dirty;
+    int sync_x_start, sync_x_end;
+    framebuffer_columns(crop_to, fb_width, mirror_x, &sync_x_start, &sync_x_end);
+
+    if (regions != NULL) {
+        regions->count = 0;
+        // Column dirtyness is tracked per band to find the horizontal
+        // extent of changes in it, then added to the overall dirtyness.
+        uint8_t* band_dirtyness
+            = get_scratch(render_context.band_dirtyness, fb_width, fb_width / 2);
+
+        // Columns of changed lines written to the difference image.
+        // Regions may be merged across bands, so with recorded changes, this includes
+        // the columns of `crop_to` that are not compared.
+        int fill_start = 0;
+        int fill_end = fb_width;
+        if (row_changes != NULL) {
+            fill_start = max(sync_x_start, 0) / 8 * 8;
+            fill_end = min(fb_width, (sync_x_end + 7) / 8 * 8);
+        }
+
+        for (int band = crop_to.y; band < y_end; band += DIRTY_REGION_BAND_HEIGHT) {
+            int band_end = min(band + DIRTY_REGION_BAND_HEIGHT, y_end);
+            int first_dirty = -1;
+            int last_dirty = -1;
+
+            // With recorded changes, only the changed columns of a band are compared.
+            int cols_start = 0;
+            int cols_end = fb_width;
+            if (row_changes != NULL) {
+                changed_columns(
+                    row_changes,
+                    band,
+                    band_end,
+                    sync_x_start,
+                    sync_x_end,
+                    &cols_start,
+                    &cols_end
+                );
+                if (cols_start >= cols_end) {
+                    continue;
+                }
+            }
+            memset(band_dirtyness, 0, fb_width / 2);
+
+            for (int y = band; y < band_end; y++) {
+                if (row_changes != NULL
+                    && !take_row_changes(&row_changes[y], sync_x_start, sync_x_end)) {
+                    continue;
+                }
+                uint32_t offset = y * fb_width / 2;
+                uint8_t* line = interlaced != NULL ? interlaced + offset * 2 : scratch_line;
+                dirty_lines[y] = _epd_interlace_line(
+                    to + offset + cols_start / 2,
+                    from + offset + cols_start / 2,
+                    line + cols_start,
+                    band_dirtyness + cols_start / 2,
+                    cols_end - cols_start
+                );
+                if (!dirty_lines[y]) {
+                    continue;
+                }
+                first_dirty = first_dirty < 0 ? y : first_dirty;
+                last_dirty = y;
+                if (interlaced != NULL) {
+                    interlace_unchanged(to + offset, line, band_dirtyness, fill_start, cols_start);
+                    interlace_unchanged(to + offset, line, band_dirtyness, cols_end, fill_end);
+                }
+                // the mirrored columns cover all of `crop_to`, so no columns
+                // left behind are drawn.
+                if (mirror_x && interlaced != NULL) {
+                    mirror_interlaced_columns(line, fb_width, fill_start, fill_end);
+                }
+                if (sync_to != NULL) {
+                    copy_line_pixels(
+                        sync_to + offset,
+                        to + offset,
+                        max(sync_x_start, cols_start),
+                        min(sync_x_end, cols_end)
+                    );
+                }
+            }
+
+            if (first_dirty >= 0) {
+                if (mirror_x) {
+                    mirror_col_dirtyness(band_dirtyness, fb_width / 2);
+                }
+                for (int i = 0; i < fb_width / 8; i++) {
+                    ((uint32_t*)col_dirtyness)[i] |= ((uint32_t*)band_dirtyness)[i];
+                }
+                dirty_regions_add_band(
+                    regions, band_dirtyness, crop_to.x, x_end, first_dirty, last_dirty + 1
+                );
+            }
+        }
+        release_scratch(render_context.band_dirtyness, band_dirtyness);
+    } else {
+        for (int y = crop_to.y; y < y_end; y++) {
+            if (row_changes != NULL
+                && !take_row_changes(&row_changes[y], sync_x_start, sync_x_end)) {
+                continue;
+            }
+            uint32_t offset = y * fb_width / 2;
+            uint8_t* line = interlaced != NULL ? interlaced + offset * 2 : scratch_line;
+            int dirty
+                = _epd_interlace_line(to + offset, from + offset, line, col_dirtyness, fb_width);
+            dirty_lines[y] = dirty;
+            if (dirty && mirror_x && interlaced != NULL) {
+                mirror_interlaced_line(line, fb_width);
+            }
+            if (dirty && sync_to != NULL) {
+                copy_line_pixels(sync_to + offset, to + offset, sync_x_start, sync_x_end);
+            }
+        }
+        if (mirror_x) {
+            mirror_col_dirtyness(col_dirtyness, fb_width / 2);
+        }
     }
 
+    release_scratch(render_context.difference_scratch_line, scratch_line);
+
     int min_x, min_y, max_x, max_y;
     for (min_x = crop_to.x; min_x < x_end; min_x++) {
         uint8_t mask = min_x % 2 ? 0xF0 : 0x0F;
@@ -469,7 +1617,7 @@ EpdRect epd_difference_image_base(
             break;
     }
     for (max_x = x_end - 1; max_x >= crop_to.x; max_x--) {
-        uint8_t mask = min_x % 2 ? 0xF0 : 0x0F;
+        uint8_t mask = max_x % 2 ? 0xF0 : 0x0F;
         if ((col_dirtyness[max_x / 2] & mask) != 0)
             break;
     }
@@ -507,7 +1655,11 @@ EpdRect epd_difference_image(
         epd_height(),
         interlaced,
         dirty_lines,
-        col_dirtyness
+        col_dirtyness,
+        NULL,
+        NULL,
+        NULL,
+        false
     );
 }
 
@@ -520,7 +1672,43 @@ EpdRect epd_difference_image_cropped(
     uint8_t* col_dirtyness
 ) {
     EpdRect result = epd_difference_image_base(
-        to, from, crop_to, epd_width(), epd_height(), interlaced, dirty_lines, col_dirtyness
+        to,
+        from,
+        crop_to,
+        epd_width(),
+        epd_height(),
+        interlaced,
+        dirty_lines,
+        col_dirtyness,
+        NULL,
+        NULL,
+        NULL,
+        false
     );
     return result;
 }
+
+EpdRect epd_difference_image_regions(
+    const uint8_t* to,
+    const uint8_t* from,
+    EpdRect crop_to,
+    uint8_t* interlaced,
+    bool* dirty_lines,
+    uint8_t* col_dirtyness,
+    EpdDirtyRegions* regions
+) {
+    return epd_difference_image_base(
+        to,
+        from,
+        crop_to,
+        epd_width(),
+        epd_height(),
+        interlaced,
+        dirty_lines,
+        col_dirtyness,
+        regions,
+        NULL,
+        NULL,
+        false
+    );
+}
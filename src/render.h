@@ -10,3 +10,92 @@ void epd_renderer_init(enum EpdInitOptions options, const EpdInitConfig* config)
  * Deinitialize the EPD renderer and free up its resources.
  */
 void epd_renderer_deinit();
+
+/**
+ * Find the waveform temperature range index for a given temperature in °C.
+ * Returns -1 if the waveform does not contain any temperature range.
+ */
+int waveform_temp_range_index(const EpdWaveform* waveform, int temperature);
+
+/**
+ * Calculate a `MODE_PACKING_1PPB_DIFFERENCE` difference image of two framebuffers
+ * of `fb_width` x `fb_height` pixels, as for `epd_difference_image_regions()`.
+ * `regions` may be NULL if only the bounding box of the changes is needed.
+ *
+ * If `sync_to` is not NULL, the changed lines of `to` within `crop_to` are copied
+ * to it while they are processed. It may be `from`, to bring a back buffer up to date
+ * without another pass over both framebuffers.
+ *
+ * With `mirror_x`, the difference image, column dirtyness, crop area and regions
+ * are horizontally mirrored with respect to the framebuffers.
+ *
+ * `interlaced` may be NULL to only find the changes, e.g. for `epd_draw_difference()`.
+ *
+ * If `row_changes` is not NULL, it holds the columns of `to` changed per row since
+ * `from` was last synced, as recorded by `epd_mark_row_changes()`. Rows without
+ * changes in `crop_to` are treated as unchanged without reading them,
+ * and the columns of `crop_to` are removed from the changes of all other rows.
+ * With `regions`, only the changed columns of each band of rows are compared,
+ * and `sync_to` is only written there. On changed lines, `interlaced` is written
+ * in all columns of `crop_to`, the others as unchanged, as regions may span several bands.
+ */
+EpdRect epd_difference_image_base(
+    const uint8_t* to,
+    const uint8_t* from,
+    EpdRect crop_to,
+    int fb_width,
+    int fb_height,
+    uint8_t* interlaced,
+    bool* dirty_lines,
+    uint8_t* col_dirtyness,
+    EpdDirtyRegions* regions,
+    uint8_t* sync_to,
+    EpdRowChanges* row_changes,
+    bool mirror_x
+);
+
+/**
+ * Write the difference image pixels shown in `crop_to` on all lines marked in `dirty_lines`,
+ * leaving all other pixels of `interlaced` untouched.
+ * Arguments are as for `epd_difference_image_base()`.
+ * Unlike it, this is safe while a pipelined draw reads other regions of `interlaced`.
+ */
+void epd_interlace_dirty_lines(
+    const uint8_t* to,
+    const uint8_t* from,
+    uint8_t* interlaced,
+    EpdRect crop_to,
+    int fb_width,
+    int fb_height,
+    const bool* dirty_lines,
+    bool mirror_x
+);
+
+/**
+ * Copy the pixels of `src` shown in `crop_to` to `dst` on all lines marked in `dirty_lines`.
+ * Both are 4bpp framebuffers of `fb_width` x `fb_height` pixels,
+ * `crop_to` and `mirror_x` are as for `epd_difference_image_base()`.
+ */
+void epd_sync_dirty_lines(
+    uint8_t* dst,
+    const uint8_t* src,
+    EpdRect crop_to,
+    int fb_width,
+    int fb_height,
+    const bool* dirty_lines,
+    bool mirror_x
+);
+
+/**
+ * Record the changed columns per row of `framebuffer` in `rows`,
+ * which has an entry for each of its `epd_height()` rows.
+ * The drawing functions of `epdiy.h` extend these when drawing to `framebuffer`.
+ * Only one framebuffer is tracked at a time, NULL stops tracking.
+ */
+void epd_track_row_changes(const uint8_t* framebuffer, EpdRowChanges* rows);
+
+/**
+ * Mark the framebuffer columns `[x_start, x_end)` of row `y` as changed,
+ * if `framebuffer` is tracked by `epd_track_row_changes()`.
+ */
+void epd_mark_row_changes(const uint8_t* framebuffer, int y, int x_start, int x_end);
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <unity.h>
+#include "epdiy.h"
 #include "esp_timer.h"
 
 #define DEFAULT_EXAMPLE_LEN 704
@@ -17,6 +18,21 @@ bool _epd_interlace_line(
     int fb_width
 );
 
+EpdRect epd_difference_image_base(
+    const uint8_t* to,
+    const uint8_t* from,
+    EpdRect crop_to,
+    int fb_width,
+    int fb_height,
+    uint8_t* interlaced,
+    bool* dirty_lines,
+    uint8_t* col_dirtyness,
+    EpdDirtyRegions* regions,
+    uint8_t* sync_to,
+    EpdRowChanges* row_changes,
+    bool mirror_x
+);
+
 static const uint8_t from_pattern[8] = { 0xFF, 0xF0, 0x0F, 0x01, 0x55, 0xAA, 0xFF, 0x80 };
 static const uint8_t to_pattern[8] = { 0xFF, 0xFF, 0x0F, 0x10, 0xAA, 0x55, 0xFF, 0x00 };
 
@@ -181,4 +197,340 @@ TEST_CASE("different 4-byte alignments work", "[epdiy,unit]") {
     }
 
     diff_test_buffers_free(&bufs);
-}
\ No newline at end of file
+}
+
+TEST_CASE("line ends not divisible by 8 pixels work", "[epdiy,unit]") {
+    const int example_len = DEFAULT_EXAMPLE_LEN;
+    DiffTestBuffers bufs;
+
+    diff_test_buffers_init(&bufs, example_len);
+
+    for (int missing_px = 1; missing_px < 8; missing_px++) {
+        int len_px = 2 * example_len - missing_px;
+        diff_test_buffers_fill(&bufs, example_len);
+
+        bool dirty = _epd_interlace_line(
+            bufs.to, bufs.from, bufs.interlaced, bufs.col_dirtyness, len_px
+        );
+        TEST_ASSERT(dirty == true);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(bufs.expected_interlaced, bufs.interlaced, len_px);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(bufs.expected_col_dirtyness, bufs.col_dirtyness, len_px / 2);
+        // pixels after the line end are untouched
+        TEST_ASSERT_EQUAL_UINT8(0, bufs.interlaced[len_px]);
+        if (len_px % 2) {
+            TEST_ASSERT_EQUAL_UINT8(
+                bufs.expected_col_dirtyness[len_px / 2] & 0x0F, bufs.col_dirtyness[len_px / 2]
+            );
+        }
+    }
+
+    diff_test_buffers_free(&bufs);
+}
+
+#define REGIONS_FB_WIDTH 512
+#define REGIONS_FB_HEIGHT 256
+
+/**
+ * Set a rectangle of pixels in a 4bpp framebuffer to black.
+ */
+static void diff_test_fill_rect(uint8_t* fb, EpdRect rect) {
+    for (int y = rect.y; y < rect.y + rect.height; y++) {
+        for (int x = rect.x; x < rect.x + rect.width; x++) {
+            uint8_t* byte = fb + y * REGIONS_FB_WIDTH / 2 + x / 2;
+            *byte &= x % 2 ? 0x0F : 0xF0;
+        }
+    }
+}
+
+/**
+ * Calculate the dirty regions between a white framebuffer
+ * and one with the rectangles `rects` filled.
+ */
+static EpdRect diff_test_regions(const EpdRect* rects, int num_rects, EpdDirtyRegions* regions) {
+    int fb_size = REGIONS_FB_WIDTH / 2 * REGIONS_FB_HEIGHT;
+    uint8_t* from = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    uint8_t* to = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    uint8_t* interlaced = heap_caps_aligned_alloc(16, 2 * fb_size, MALLOC_CAP_DEFAULT);
+    uint8_t* col_dirtyness = heap_caps_aligned_alloc(16, REGIONS_FB_WIDTH / 2, MALLOC_CAP_DEFAULT);
+    bool dirty_lines[REGIONS_FB_HEIGHT];
+
+    memset(from, 0xFF, fb_size);
+    memset(to, 0xFF, fb_size);
+    for (int i = 0; i < num_rects; i++) {
+        diff_test_fill_rect(to, rects[i]);
+    }
+
+    EpdRect full = { 0, 0, REGIONS_FB_WIDTH, REGIONS_FB_HEIGHT };
+    EpdRect bounds = epd_difference_image_base(
+        to,
+        from,
+        full,
+        REGIONS_FB_WIDTH,
+        REGIONS_FB_HEIGHT,
+        interlaced,
+        dirty_lines,
+        col_dirtyness,
+        regions,
+        NULL,
+        NULL,
+        false
+    );
+
+    heap_caps_free(from);
+    heap_caps_free(to);
+    heap_caps_free(interlaced);
+    heap_caps_free(col_dirtyness);
+    return bounds;
+}
+
+TEST_CASE("distant changes result in separate regions", "[epdiy,unit]") {
+    const EpdRect rects[2] = {
+        { .x = 8, .y = 4, .width = 40, .height = 20 },
+        { .x = 400, .y = 200, .width = 64, .height = 30 },
+    };
+    EpdDirtyRegions regions;
+    EpdRect bounds = diff_test_regions(rects, 2, &regions);
+
+    TEST_ASSERT_EQUAL(2, regions.count);
+    bool found[2] = { false, false };
+    for (int r = 0; r < regions.count; r++) {
+        for (int i = 0; i < 2; i++) {
+            found[i] |= memcmp(&regions.rects[r], &rects[i], sizeof(EpdRect)) == 0;
+        }
+    }
+    TEST_ASSERT(found[0] && found[1]);
+
+    TEST_ASSERT_EQUAL(8, bounds.x);
+    TEST_ASSERT_EQUAL(4, bounds.y);
+    TEST_ASSERT_EQUAL(464 - 8, bounds.width);
+    TEST_ASSERT_EQUAL(230 - 4, bounds.height);
+}
+
+TEST_CASE("nearby changes are merged into one region", "[epdiy,unit]") {
+    const EpdRect rects[3] = {
+        { .x = 100, .y = 100, .width = 20, .height = 10 },
+        { .x = 130, .y = 100, .width = 20, .height = 10 },
+        { .x = 100, .y = 112, .width = 50, .height = 40 },
+    };
+    EpdDirtyRegions regions;
+    diff_test_regions(rects, 3, &regions);
+
+    TEST_ASSERT_EQUAL(1, regions.count);
+    TEST_ASSERT_EQUAL(100, regions.rects[0].x);
+    TEST_ASSERT_EQUAL(100, regions.rects[0].y);
+    TEST_ASSERT_EQUAL(50, regions.rects[0].width);
+    TEST_ASSERT_EQUAL(52, regions.rects[0].height);
+}
+
+TEST_CASE("number of dirty regions is limited", "[epdiy,unit]") {
+    EpdRect rects[2 * EPD_MAX_DIRTY_REGIONS];
+    for (int i = 0; i < 2 * EPD_MAX_DIRTY_REGIONS; i++) {
+        rects[i] = (EpdRect){ .x = (i % 4) * 128, .y = (i / 4) * 64, .width = 8, .height = 8 };
+    }
+    EpdDirtyRegions regions;
+    diff_test_regions(rects, 2 * EPD_MAX_DIRTY_REGIONS, &regions);
+
+    TEST_ASSERT(regions.count > 0 && regions.count <= EPD_MAX_DIRTY_REGIONS);
+    // all changes are covered by exactly one region
+    for (int i = 0; i < 2 * EPD_MAX_DIRTY_REGIONS; i++) {
+        int covering = 0;
+        for (int r = 0; r < regions.count; r++) {
+            EpdRect c = regions.rects[r];
+            covering += rects[i].x >= c.x && rects[i].y >= c.y
+                        && rects[i].x + rects[i].width <= c.x + c.width
+                        && rects[i].y + rects[i].height <= c.y + c.height;
+        }
+        TEST_ASSERT_EQUAL(1, covering);
+    }
+}
+
+TEST_CASE("mirrored difference syncs the back buffer", "[epdiy,unit]") {
+    int fb_size = REGIONS_FB_WIDTH / 2 * REGIONS_FB_HEIGHT;
+    uint8_t* from = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    uint8_t* to = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    uint8_t* interlaced = heap_caps_aligned_alloc(16, 2 * fb_size, MALLOC_CAP_DEFAULT);
+    uint8_t* col_dirtyness = heap_caps_aligned_alloc(16, REGIONS_FB_WIDTH / 2, MALLOC_CAP_DEFAULT);
+    bool dirty_lines[REGIONS_FB_HEIGHT];
+
+    memset(from, 0xFF, fb_size);
+    memset(to, 0xFF, fb_size);
+    EpdRect rect = { .x = 21, .y = 10, .width = 35, .height = 6 };
+    diff_test_fill_rect(to, rect);
+
+    EpdDirtyRegions regions;
+    EpdRect full = { 0, 0, REGIONS_FB_WIDTH, REGIONS_FB_HEIGHT };
+    EpdRect bounds = epd_difference_image_base(
+        to,
+        from,
+        full,
+        REGIONS_FB_WIDTH,
+        REGIONS_FB_HEIGHT,
+        interlaced,
+        dirty_lines,
+        col_dirtyness,
+        &regions,
+        from,
+        NULL,
+        true
+    );
+
+    int mirrored_x = REGIONS_FB_WIDTH - rect.x - rect.width;
+    TEST_ASSERT_EQUAL(mirrored_x, bounds.x);
+    TEST_ASSERT_EQUAL(rect.width, bounds.width);
+    TEST_ASSERT_EQUAL(1, regions.count);
+    TEST_ASSERT_EQUAL(mirrored_x, regions.rects[0].x);
+    TEST_ASSERT_EQUAL(rect.width, regions.rects[0].width);
+
+    uint8_t* line = interlaced + rect.y * REGIONS_FB_WIDTH;
+    TEST_ASSERT_EQUAL_UINT8(0x0F, line[mirrored_x]);
+    TEST_ASSERT_EQUAL_UINT8(0x0F, line[mirrored_x + rect.width - 1]);
+    TEST_ASSERT_EQUAL_UINT8(0xFF, line[mirrored_x - 1]);
+    TEST_ASSERT_EQUAL_UINT8(0xFF, line[mirrored_x + rect.width]);
+
+    // the back buffer now matches the front buffer
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(to, from, fb_size);
+
+    heap_caps_free(from);
+    heap_caps_free(to);
+    heap_caps_free(interlaced);
+    heap_caps_free(col_dirtyness);
+}
+
+TEST_CASE("only recorded changes are compared", "[epdiy,unit]") {
+    int fb_size = REGIONS_FB_WIDTH / 2 * REGIONS_FB_HEIGHT;
+    uint8_t* from = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    uint8_t* to = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    uint8_t* interlaced = heap_caps_aligned_alloc(16, 2 * fb_size, MALLOC_CAP_DEFAULT);
+    uint8_t* col_dirtyness = heap_caps_aligned_alloc(16, REGIONS_FB_WIDTH / 2, MALLOC_CAP_DEFAULT);
+    bool dirty_lines[REGIONS_FB_HEIGHT];
+    EpdRowChanges row_changes[REGIONS_FB_HEIGHT] = { 0 };
+
+    memset(from, 0xFF, fb_size);
+    memset(to, 0xFF, fb_size);
+    EpdRect marked = { .x = 21, .y = 10, .width = 35, .height = 6 };
+    diff_test_fill_rect(to, marked);
+    for (int y = marked.y; y < marked.y + marked.height; y++) {
+        row_changes[y] = (EpdRowChanges){ marked.x, marked.x + marked.width };
+    }
+    // not recorded, so it is not found
+    EpdRect unmarked = { .x = 21, .y = 100, .width = 35, .height = 6 };
+    diff_test_fill_rect(to, unmarked);
+    // recorded, but mostly outside of the crop area
+    row_changes[20] = (EpdRowChanges){ 200, 400 };
+
+    // only the changed lines of the difference image are written
+    memset(interlaced, 0xAA, 2 * fb_size);
+
+    EpdRect left_half = { 0, 0, REGIONS_FB_WIDTH / 2, REGIONS_FB_HEIGHT };
+    EpdDirtyRegions regions;
+    EpdRect bounds = epd_difference_image_base(
+        to,
+        from,
+        left_half,
+        REGIONS_FB_WIDTH,
+        REGIONS_FB_HEIGHT,
+        interlaced,
+        dirty_lines,
+        col_dirtyness,
+        &regions,
+        from,
+        row_changes,
+        false
+    );
+
+    TEST_ASSERT_EQUAL(marked.y, bounds.y);
+    TEST_ASSERT_EQUAL(marked.height, bounds.height);
+    TEST_ASSERT_EQUAL(1, regions.count);
+    TEST_ASSERT_FALSE(dirty_lines[unmarked.y]);
+    TEST_ASSERT_FALSE(dirty_lines[20]);
+
+    // changes within the crop area are taken, the rest is kept
+    TEST_ASSERT_TRUE(row_changes[marked.y].start >= row_changes[marked.y].end);
+    TEST_ASSERT_EQUAL(REGIONS_FB_WIDTH / 2, row_changes[20].start);
+    TEST_ASSERT_EQUAL(400, row_changes[20].end);
+    TEST_ASSERT_EQUAL_UINT8(0xFF, from[unmarked.y * REGIONS_FB_WIDTH / 2 + unmarked.x / 2 + 1]);
+
+    uint8_t* line = interlaced + marked.y * REGIONS_FB_WIDTH;
+    TEST_ASSERT_EQUAL_UINT8(0xFF, line[16]);
+    TEST_ASSERT_EQUAL_UINT8(0x0F, line[marked.x]);
+    TEST_ASSERT_EQUAL_UINT8(0x0F, line[marked.x + marked.width - 1]);
+    // columns that are not compared are written as unchanged within the crop area
+    TEST_ASSERT_EQUAL_UINT8(0xFF, line[0]);
+    TEST_ASSERT_EQUAL_UINT8(0xFF, line[marked.x + marked.width]);
+    TEST_ASSERT_EQUAL_UINT8(0xFF, line[REGIONS_FB_WIDTH / 2 - 1]);
+    TEST_ASSERT_EQUAL_UINT8(0xAA, line[REGIONS_FB_WIDTH / 2]);
+    TEST_ASSERT_EQUAL_UINT8(0xAA, interlaced[unmarked.y * REGIONS_FB_WIDTH + unmarked.x]);
+    TEST_ASSERT_EQUAL(marked.x, regions.rects[0].x);
+    TEST_ASSERT_EQUAL(marked.width, regions.rects[0].width);
+
+    heap_caps_free(from);
+    heap_caps_free(to);
+    heap_caps_free(interlaced);
+    heap_caps_free(col_dirtyness);
+}
+
+TEST_CASE("regions merged across bands cover valid differences", "[epdiy,unit]") {
+    int fb_size = REGIONS_FB_WIDTH / 2 * REGIONS_FB_HEIGHT;
+    uint8_t* from = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    uint8_t* to = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    uint8_t* interlaced = heap_caps_aligned_alloc(16, 2 * fb_size, MALLOC_CAP_DEFAULT);
+    uint8_t* col_dirtyness = heap_caps_aligned_alloc(16, REGIONS_FB_WIDTH / 2, MALLOC_CAP_DEFAULT);
+    bool dirty_lines[REGIONS_FB_HEIGHT];
+    EpdRowChanges row_changes[REGIONS_FB_HEIGHT];
+
+    // changes in disjoint columns of two adjacent bands, which are cheaper to draw together
+    const EpdRect rects[2] = {
+        { .x = 0, .y = 14, .width = 100, .height = 2 },
+        { .x = 400, .y = 16, .width = 100, .height = 2 },
+    };
+    EpdRect crop = { .x = 4, .y = 0, .width = 500, .height = REGIONS_FB_HEIGHT };
+
+    for (int mirror = 0; mirror < 2; mirror++) {
+        memset(from, 0xFF, fb_size);
+        memset(to, 0xFF, fb_size);
+        memset(row_changes, 0, sizeof(row_changes));
+        for (int i = 0; i < 2; i++) {
+            diff_test_fill_rect(to, rects[i]);
+            for (int y = rects[i].y; y < rects[i].y + rects[i].height; y++) {
+                row_changes[y] = (EpdRowChanges){ rects[i].x, rects[i].x + rects[i].width };
+            }
+        }
+        // stale contents of an earlier update
+        memset(interlaced, 0x0F, 2 * fb_size);
+
+        EpdDirtyRegions regions;
+        epd_difference_image_base(
+            to,
+            from,
+            crop,
+            REGIONS_FB_WIDTH,
+            REGIONS_FB_HEIGHT,
+            interlaced,
+            dirty_lines,
+            col_dirtyness,
+            &regions,
+            from,
+            row_changes,
+            mirror
+        );
+        TEST_ASSERT_EQUAL(1, regions.count);
+
+        // every pixel drawn is the difference to the (all white) previous image
+        EpdRect r = regions.rects[0];
+        for (int y = r.y; y < r.y + r.height; y++) {
+            if (!dirty_lines[y]) {
+                continue;
+            }
+            for (int x = r.x; x < r.x + r.width; x++) {
+                int fb_x = mirror ? REGIONS_FB_WIDTH - 1 - x : x;
+                uint8_t t = (to[y * REGIONS_FB_WIDTH / 2 + fb_x / 2] >> (fb_x % 2 * 4)) & 0x0F;
+                TEST_ASSERT_EQUAL_UINT8((t << 4) | 0x0F, interlaced[y * REGIONS_FB_WIDTH + x]);
+            }
+        }
+    }
+
+    heap_caps_free(from);
+    heap_caps_free(to);
+    heap_caps_free(interlaced);
+    heap_caps_free(col_dirtyness);
+}
@@ -0,0 +1,217 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "epdiy.h"
+#include "output_common/render_method.h"
+
+#ifdef RENDER_METHOD_HOST
+
+static const EpdRect test_rects[] = {
+    { .x = 0, .y = 0, .width = 1, .height = 1 },
+    { .x = 11, .y = 7, .width = 30, .height = 3 },
+    { .x = 12, .y = 20, .width = 31, .height = 2 },
+    { .x = -5, .y = -3, .width = 10, .height = 8 },
+    { .x = 590, .y = 790, .width = 300, .height = 300 },
+    { .x = 100, .y = 100, .width = 0, .height = 10 },
+    { .x = 100, .y = 100, .width = -4, .height = 10 },
+};
+
+#define NUM_TEST_RECTS (sizeof(test_rects) / sizeof(EpdRect))
+
+static uint8_t* test_framebuffer() {
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* fb = malloc(fb_size);
+    TEST_ASSERT_NOT_NULL(fb);
+    memset(fb, 0x5A, fb_size);
+    return fb;
+}
+
+TEST_CASE("rectangle fills match pixel-wise drawing", "[epdiy,unit]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    uint8_t* spans = test_framebuffer();
+    uint8_t* pixels = test_framebuffer();
+
+    for (int rotation = EPD_ROT_LANDSCAPE; rotation <= EPD_ROT_INVERTED_PORTRAIT; rotation++) {
+        epd_set_rotation(rotation);
+        for (int i = 0; i < NUM_TEST_RECTS; i++) {
+            EpdRect r = test_rects[i];
+            uint8_t color = 0x10 * (i + 3 * rotation);
+            epd_fill_rect(r, color, spans);
+            epd_draw_hline(r.x + 1, r.y + r.height, r.width, ~color, spans);
+            epd_draw_vline(r.x + r.width, r.y + 1, r.height, ~color, spans);
+
+            for (int y = r.y; y < r.y + r.height; y++) {
+                for (int x = r.x; x < r.x + r.width; x++) {
+                    epd_draw_pixel(x, y, color, pixels);
+                }
+            }
+            for (int x = r.x + 1; x < r.x + 1 + r.width; x++) {
+                epd_draw_pixel(x, r.y + r.height, ~color, pixels);
+            }
+            for (int y = r.y + 1; y < r.y + 1 + r.height; y++) {
+                epd_draw_pixel(r.x + r.width, y, ~color, pixels);
+            }
+        }
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(pixels, spans, epd_width() / 2 * epd_height());
+    }
+
+    epd_set_rotation(EPD_ROT_LANDSCAPE);
+    free(spans);
+    free(pixels);
+    epd_deinit();
+}
+
+TEST_CASE("image copies match pixel-wise drawing", "[epdiy,unit]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    uint8_t* copied = test_framebuffer();
+    uint8_t* pixels = test_framebuffer();
+
+    uint8_t image[64];
+    for (int i = 0; i < sizeof(image); i++) {
+        image[i] = i * 37 + 11;
+    }
+
+    for (int i = 0; i < NUM_TEST_RECTS; i++) {
+        // images of up to 8 pixels per row, with padding for uneven widths
+        EpdRect area = test_rects[i];
+        area.width = area.width > 8 ? 7 + i % 2 : area.width;
+        area.height = area.height > 8 ? 8 : area.height;
+        epd_copy_to_framebuffer(area, image, copied);
+
+        int stride = (area.width + 1) / 2;
+        for (int y = 0; y < area.height; y++) {
+            for (int x = 0; x < area.width; x++) {
+                uint8_t byte = image[y * stride + x / 2];
+                uint8_t val = x % 2 ? byte >> 4 : byte & 0x0F;
+                epd_draw_pixel(area.x + x, area.y + y, val << 4, pixels);
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(pixels, copied, epd_width() / 2 * epd_height());
+
+    free(copied);
+    free(pixels);
+    epd_deinit();
+}
+
+/**
+ * Draw `src_rect` of `image` at `(x, y)` pixel by pixel, as `epd_blit()` should.
+ */
+static void blit_reference(
+    const EpdImage* image,
+    EpdRect src_rect,
+    int x,
+    int y,
+    const EpdBlitOptions* options,
+    uint8_t* framebuffer
+) {
+    const int pixels_per_byte[] = { 2, 8, 4 };
+    int per_byte = pixels_per_byte[image->format];
+    int stride = (image->width + per_byte - 1) / per_byte;
+    for (int v = 0; v < src_rect.height; v++) {
+        for (int u = 0; u < src_rect.width; u++) {
+            int ix = src_rect.x + u;
+            int iy = src_rect.y + v;
+            if (ix < 0 || iy < 0 || ix >= image->width || iy >= image->height) {
+                continue;
+            }
+            uint8_t color;
+            if (image->format == EPD_IMAGE_1BPP) {
+                bool set = (image->data[iy * stride + ix / 8] >> (ix % 8)) & 1;
+                color = set ? options->fg_color : options->bg_color;
+            } else if (image->format == EPD_IMAGE_2BPP) {
+                color = ((image->data[iy * stride + ix / 4] >> (ix % 4 * 2)) & 0x03) * 0x50;
+            } else {
+                color = epd_get_pixel(ix, iy, image->width, image->height, image->data);
+            }
+            if ((options->flags & EPD_BLIT_COLOR_KEY) && color >> 4 == options->color_key >> 4) {
+                continue;
+            }
+            if (options->alpha != NULL) {
+                int a = epd_get_pixel(ix, iy, image->width, image->height, options->alpha) >> 4;
+                int rotation = epd_get_rotation();
+                // the framebuffer pixel behind, read in framebuffer coordinates
+                int fx = x + u, fy = y + v;
+                if (rotation == EPD_ROT_PORTRAIT) {
+                    fx = epd_width() - 1 - (y + v);
+                    fy = x + u;
+                } else if (rotation == EPD_ROT_INVERTED_LANDSCAPE) {
+                    fx = epd_width() - 1 - (x + u);
+                    fy = epd_height() - 1 - (y + v);
+                } else if (rotation == EPD_ROT_INVERTED_PORTRAIT) {
+                    fx = y + v;
+                    fy = epd_height() - 1 - (x + u);
+                }
+                if (fx < 0 || fy < 0 || fx >= epd_width() || fy >= epd_height()) {
+                    continue;
+                }
+                int d = epd_get_pixel(fx, fy, epd_width(), epd_height(), framebuffer) >> 4;
+                color = ((color >> 4) * a + d * (15 - a) + 7) / 15 << 4;
+            }
+            epd_draw_pixel(x + u, y + v, color, framebuffer);
+        }
+    }
+}
+
+TEST_CASE("blits match pixel-wise drawing", "[epdiy,unit]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    uint8_t* blitted = test_framebuffer();
+    uint8_t* pixels = test_framebuffer();
+
+    // a 4bpp image of 13 x 9 pixels, 1bpp and 2bpp images and an alpha mask of the same size
+    uint8_t image_4bpp[7 * 9];
+    uint8_t image_1bpp[2 * 9];
+    uint8_t image_2bpp[4 * 9];
+    uint8_t alpha[7 * 9];
+    for (int i = 0; i < sizeof(image_4bpp); i++) {
+        image_4bpp[i] = i * 37 + 11;
+        alpha[i] = i * 53 + 5;
+    }
+    for (int i = 0; i < sizeof(image_1bpp); i++) {
+        image_1bpp[i] = i * 71 + 3;
+    }
+    for (int i = 0; i < sizeof(image_2bpp); i++) {
+        image_2bpp[i] = i * 43 + 29;
+    }
+    const EpdImage images[3] = {
+        { .data = image_4bpp, .width = 13, .height = 9, .format = EPD_IMAGE_4BPP },
+        { .data = image_1bpp, .width = 13, .height = 9, .format = EPD_IMAGE_1BPP },
+        { .data = image_2bpp, .width = 13, .height = 9, .format = EPD_IMAGE_2BPP },
+    };
+    const EpdBlitOptions options[4] = {
+        { .fg_color = 0xF0, .bg_color = 0x00 },
+        { .flags = EPD_BLIT_COLOR_KEY, .color_key = 0x30, .fg_color = 0x30, .bg_color = 0xA0 },
+        { .alpha = alpha, .fg_color = 0x50, .bg_color = 0xC0 },
+        { .flags = EPD_BLIT_COLOR_KEY, .color_key = 0x70, .alpha = alpha },
+    };
+    const EpdRect src_rects[3] = {
+        { 0, 0, 13, 9 },
+        { 3, 2, 7, 5 },
+        { -2, -1, 20, 20 },
+    };
+    const int positions[4][2] = { { 10, 20 }, { 11, 3 }, { -5, -4 }, { 590, 795 } };
+
+    for (int rotation = EPD_ROT_LANDSCAPE; rotation <= EPD_ROT_INVERTED_PORTRAIT; rotation++) {
+        epd_set_rotation(rotation);
+        for (int i = 0; i < 3 * 4 * 3 * 4; i++) {
+            const EpdImage* image = &images[i % 3];
+            const EpdBlitOptions* opts = &options[i / 3 % 4];
+            EpdRect src_rect = src_rects[i / 12 % 3];
+            int x = positions[i / 36][0] + 40 * (i % 8);
+            int y = positions[i / 36][1];
+            epd_blit(image, src_rect, x, y, opts, blitted);
+            blit_reference(image, src_rect, x, y, opts, pixels);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(pixels, blitted, epd_width() / 2 * epd_height());
+        }
+    }
+
+    epd_set_rotation(EPD_ROT_LANDSCAPE);
+    free(blitted);
+    free(pixels);
+    epd_deinit();
+}
+
+#endif
@@ -0,0 +1,697 @@
+#include <esp_heap_caps.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "epdiy.h"
+#include "output_common/render_method.h"
+
+#ifdef RENDER_METHOD_HOST
+
+// Two glyphs of 6 x 4 pixels, as plain and zlib-compressed bitmaps.
+static const uint8_t test_bitmaps[] = {
+    0x0b, 0x30, 0x55, 0x7a, 0x9f, 0xc4, 0xe9, 0x0e, 0x33, 0x58, 0x7d, 0xa2,
+    0x05, 0x3a, 0x6f, 0xa4, 0xd9, 0x0e, 0x43, 0x78, 0xad, 0xe2, 0x17, 0x4c,
+};
+
+static const uint8_t test_compressed_bitmaps[] = {
+    0x78, 0xda, 0xe3, 0x36, 0x08, 0xad, 0x9a, 0x7f, 0xe4, 0x25, 0x9f, 0x71, 0x44, 0xed,
+    0x22, 0x00, 0x1d, 0xbc, 0x05, 0x0f, 0x78, 0xda, 0x63, 0xb5, 0xca, 0x5f, 0x72, 0x93,
+    0xcf, 0xb9, 0x62, 0xed, 0x23, 0x71, 0x1f, 0x00, 0x1d, 0xc8, 0x04, 0xe7,
+};
+
+static const EpdGlyph test_glyphs[] = {
+    { .width = 6, .height = 4, .advance_x = 7, .top = 4, .data_offset = 0 },
+    { .width = 6, .height = 4, .advance_x = 7, .top = 4, .data_offset = 12 },
+};
+
+static const EpdGlyph test_compressed_glyphs[] = {
+    { .width = 6, .height = 4, .advance_x = 7, .top = 4, .compressed_size = 20 },
+    { .width = 6, .height = 4, .advance_x = 7, .top = 4, .compressed_size = 20, .data_offset = 20 },
+};
+
+static const EpdUnicodeInterval test_intervals[] = { { 'A', 'B', 0 } };
+
+static const EpdFont test_font = {
+    .bitmap = test_bitmaps,
+    .glyph = test_glyphs,
+    .intervals = test_intervals,
+    .interval_count = 1,
+    .compressed = false,
+    .advance_y = 6,
+    .ascender = 4,
+};
+
+static const EpdFont test_compressed_font = {
+    .bitmap = test_compressed_bitmaps,
+    .glyph = test_compressed_glyphs,
+    .intervals = test_intervals,
+    .interval_count = 1,
+    .compressed = true,
+    .advance_y = 6,
+    .ascender = 4,
+};
+
+static const char* test_text = "ABBAAB\nBAAB";
+
+/**
+ * Write `test_text` in `font` to a new white framebuffer.
+ */
+static uint8_t* write_test_text(const EpdFont* font) {
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* fb = malloc(fb_size);
+    TEST_ASSERT_NOT_NULL(fb);
+    memset(fb, 0xFF, fb_size);
+
+    EpdFontProperties props = epd_font_properties_default();
+    props.flags |= EPD_DRAW_BACKGROUND;
+    int x = 9;
+    int y = 20;
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_write_string(font, test_text, &x, &y, fb, &props));
+    return fb;
+}
+
+TEST_CASE("cached glyphs are drawn like uncompressed glyphs", "[epdiy,unit]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* expected = write_test_text(&test_font);
+
+    uint8_t* uncached = write_test_text(&test_compressed_font);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, uncached, fb_size);
+    free(uncached);
+
+    // budgets for no glyph, a single glyph with evictions, and all glyphs
+    const size_t budgets[] = { 0, 80, 4096 };
+    for (int i = 0; i < sizeof(budgets) / sizeof(size_t); i++) {
+        epd_glyph_cache_init(budgets[i], MALLOC_CAP_DEFAULT);
+        for (int pass = 0; pass < 2; pass++) {
+            uint8_t* cached = write_test_text(&test_compressed_font);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, cached, fb_size);
+            free(cached);
+        }
+        epd_glyph_cache_deinit();
+    }
+
+    free(expected);
+    epd_deinit();
+}
+
+TEST_CASE("corrupt compressed glyphs are reported and not cached", "[epdiy,unit]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* fb = malloc(fb_size);
+    TEST_ASSERT_NOT_NULL(fb);
+
+    // the second glyph is truncated
+    EpdGlyph glyphs[2] = { test_compressed_glyphs[0], test_compressed_glyphs[1] };
+    glyphs[1].compressed_size = 10;
+    EpdFont font = test_compressed_font;
+    font.glyph = glyphs;
+
+    EpdFontProperties props = epd_font_properties_default();
+    for (int cached = 0; cached < 2; cached++) {
+        if (cached) {
+            epd_glyph_cache_init(4096, MALLOC_CAP_DEFAULT);
+        }
+        for (int pass = 0; pass < 2; pass++) {
+            int x = 9;
+            int y = 20;
+            TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_write_string(&font, "A", &x, &y, fb, &props));
+            x = 9;
+            TEST_ASSERT_EQUAL(
+                EPD_DRAW_GLYPH_CORRUPT, epd_write_string(&font, "AB", &x, &y, fb, &props)
+            );
+        }
+        if (cached) {
+            epd_glyph_cache_deinit();
+        }
+    }
+
+    free(fb);
+    epd_deinit();
+}
+
+/**
+ * Draw a line of `text` in `test_font` pixel by pixel, as `epd_write_string()` should.
+ */
+static void write_reference(
+    const char* text, int x, int y, const EpdFontProperties* props, uint8_t* fb
+) {
+    if (props->flags & EPD_DRAW_BACKGROUND) {
+        int width = strlen(text) * test_glyphs[0].advance_x;
+        for (int yy = y - test_font.ascender; yy < y - test_font.descender; yy++) {
+            for (int xx = x; xx < x + width; xx++) {
+                epd_draw_pixel(xx, yy, props->bg_color << 4, fb);
+            }
+        }
+    }
+    for (const char* c = text; *c; c++) {
+        const EpdGlyph* glyph = &test_glyphs[*c - 'A'];
+        const uint8_t* bitmap = &test_bitmaps[glyph->data_offset];
+        for (int gy = 0; gy < glyph->height; gy++) {
+            for (int gx = 0; gx < glyph->width; gx++) {
+                uint8_t v = bitmap[gy * 3 + gx / 2] >> (gx % 2 * 4) & 0x0F;
+                if (v == 0 && !(props->flags & EPD_DRAW_BACKGROUND)) {
+                    continue;
+                }
+                int color = props->bg_color + v * (props->fg_color - props->bg_color) / 15;
+                epd_draw_pixel(x + glyph->left + gx, y - glyph->top + gy, color << 4, fb);
+            }
+        }
+        x += glyph->advance_x;
+    }
+}
+
+TEST_CASE("glyphs are drawn like pixel-wise drawing", "[epdiy,unit]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* written = malloc(fb_size);
+    uint8_t* pixels = malloc(fb_size);
+    TEST_ASSERT_NOT_NULL(written);
+    TEST_ASSERT_NOT_NULL(pixels);
+    memset(written, 0x5A, fb_size);
+    memset(pixels, 0x5A, fb_size);
+
+    const int positions[][2] = { { 9, 20 }, { 10, 30 }, { -3, 2 }, { 795, 598 } };
+    for (int rotation = EPD_ROT_LANDSCAPE; rotation <= EPD_ROT_INVERTED_PORTRAIT; rotation++) {
+        epd_set_rotation(rotation);
+        for (int i = 0; i < 8; i++) {
+            EpdFontProperties props = epd_font_properties_default();
+            props.fg_color = i % 2 ? 3 : 0;
+            props.bg_color = i % 2 ? 12 : 15;
+            if (i / 4) {
+                props.flags |= EPD_DRAW_BACKGROUND;
+            }
+            int x = positions[i % 4][0];
+            int y = positions[i % 4][1];
+            int cursor_x = x;
+            int cursor_y = y;
+            epd_write_string(&test_font, "ABBA", &cursor_x, &cursor_y, written, &props);
+            write_reference("ABBA", x, y, &props, pixels);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(pixels, written, fb_size);
+        }
+    }
+
+    epd_set_rotation(EPD_ROT_LANDSCAPE);
+    free(written);
+    free(pixels);
+    epd_deinit();
+}
+
+TEST_CASE("glyph lookup finds code points of all intervals", "[epdiy,unit]") {
+    // intervals of one to four code points with gaps in between
+    static EpdUnicodeInterval intervals[100];
+    static EpdGlyph glyphs[250];
+    uint32_t code_point = 20;
+    uint32_t offset = 0;
+    for (int i = 0; i < 100; i++) {
+        intervals[i].first = code_point;
+        intervals[i].last = code_point + i % 4;
+        intervals[i].offset = offset;
+        offset += i % 4 + 1;
+        code_point += i % 4 + 1 + i % 3;
+    }
+    EpdFont font = { .glyph = glyphs, .intervals = intervals };
+
+    for (int count = 0; count <= 100; count++) {
+        font.interval_count = count;
+        for (uint32_t cp = 0; cp < code_point + 2; cp++) {
+            const EpdGlyph* expected = NULL;
+            for (int i = 0; i < count; i++) {
+                if (cp >= intervals[i].first && cp <= intervals[i].last) {
+                    expected = &glyphs[intervals[i].offset + cp - intervals[i].first];
+                }
+            }
+            TEST_ASSERT_EQUAL_PTR(expected, epd_get_glyph(&font, cp));
+        }
+    }
+}
+
+TEST_CASE("missing glyphs are drawn with the fallback glyph", "[epdiy,unit]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* expected = malloc(fb_size);
+    uint8_t* written = malloc(fb_size);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(written);
+    memset(expected, 0xFF, fb_size);
+    memset(written, 0xFF, fb_size);
+
+    EpdFontProperties props = epd_font_properties_default();
+    props.flags = EPD_DRAW_ALIGN_CENTER;
+    int x = 100, y = 50;
+    epd_write_string(&test_font, "BAB", &x, &y, expected, &props);
+
+    props.fallback_glyph = 'B';
+    x = 100, y = 50;
+    enum EpdDrawError err = epd_write_string(&test_font, "BAx", &x, &y, written, &props);
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, err);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, written, fb_size);
+
+    props.fallback_glyph = 0;
+    x = 100, y = 50;
+    err = epd_write_string(&test_font, "BAx", &x, &y, written, &props);
+    TEST_ASSERT_EQUAL(EPD_DRAW_GLYPH_FALLBACK_FAILED, err);
+
+    free(expected);
+    free(written);
+    epd_deinit();
+}
+
+// `test_font` with an additional space glyph, for word wrapping
+static const EpdGlyph wrap_glyphs[] = {
+    { .advance_x = 3 },
+    { .width = 6, .height = 4, .advance_x = 7, .top = 4, .data_offset = 0 },
+    { .width = 6, .height = 4, .advance_x = 7, .top = 4, .data_offset = 12 },
+};
+
+static const EpdUnicodeInterval wrap_intervals[] = { { ' ', ' ', 0 }, { 'A', 'B', 1 } };
+
+static const EpdFont wrap_font = {
+    .bitmap = test_bitmaps,
+    .glyph = wrap_glyphs,
+    .intervals = wrap_intervals,
+    .interval_count = 2,
+    .compressed = false,
+    .advance_y = 6,
+    .ascender = 4,
+};
+
+TEST_CASE("text layouts are drawn like written strings", "[epdiy,unit]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* expected = malloc(fb_size);
+    uint8_t* drawn = malloc(fb_size);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(drawn);
+
+    EpdLayoutGlyph glyphs[32];
+    EpdLayoutLine lines[8];
+    EpdTextLayout layout = {
+        .glyphs = glyphs, .glyph_capacity = 32, .lines = lines, .line_capacity = 8
+    };
+
+    const enum EpdFontFlags flags[] = {
+        EPD_DRAW_ALIGN_LEFT,
+        EPD_DRAW_ALIGN_CENTER,
+        EPD_DRAW_ALIGN_RIGHT | EPD_DRAW_BACKGROUND,
+    };
+    for (int i = 0; i < 3; i++) {
+        EpdFontProperties props = epd_font_properties_default();
+        props.flags = flags[i];
+        memset(expected, 0x5A, fb_size);
+        memset(drawn, 0x5A, fb_size);
+
+        int x = 100, y = 20;
+        epd_write_string(&test_font, test_text, &x, &y, expected, &props);
+        TEST_ASSERT_EQUAL(
+            EPD_DRAW_SUCCESS, epd_layout_text(&test_font, test_text, 0, 0, &props, &layout)
+        );
+        TEST_ASSERT_EQUAL(2, layout.line_count);
+        TEST_ASSERT_EQUAL(strlen(test_text), layout.length);
+        epd_draw_text_layout(&layout, 100, 20, drawn, &props);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, drawn, fb_size);
+    }
+
+    free(expected);
+    free(drawn);
+    epd_deinit();
+}
+
+TEST_CASE("text layouts wrap words to fit a box", "[epdiy,unit]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* expected = malloc(fb_size);
+    uint8_t* drawn = malloc(fb_size);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(drawn);
+
+    EpdLayoutGlyph glyphs[32];
+    EpdLayoutLine lines[8];
+    EpdTextLayout layout = {
+        .glyphs = glyphs, .glyph_capacity = 32, .lines = lines, .line_capacity = 8
+    };
+
+    // glyphs are 6 pixels wide with an advance of 7, spaces advance by 3.
+    const char* text = "AB BAB A  ABBA";
+    const int glyph_counts[] = { 2, 3, 1, 3, 1 };
+    const enum EpdFontFlags flags[] = { EPD_DRAW_ALIGN_LEFT, EPD_DRAW_ALIGN_RIGHT };
+    for (int i = 0; i < 2; i++) {
+        EpdFontProperties props = epd_font_properties_default();
+        props.flags = flags[i];
+        enum EpdDrawError err = epd_layout_text(&wrap_font, text, 20, 0, &props, &layout);
+        TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, err);
+        TEST_ASSERT_EQUAL(5, layout.line_count);
+        TEST_ASSERT_EQUAL(30, layout.height);
+        TEST_ASSERT_EQUAL(20, layout.width);
+        for (int l = 0; l < 5; l++) {
+            TEST_ASSERT_EQUAL(glyph_counts[l], lines[l].glyph_count);
+            TEST_ASSERT_EQUAL(0, glyphs[lines[l].first_glyph].x);
+        }
+
+        // the same lines, broken by hand
+        memset(expected, 0x5A, fb_size);
+        memset(drawn, 0x5A, fb_size);
+        int x = i == 0 ? 50 : 70, y = 40;
+        epd_write_string(&wrap_font, "AB\nBAB\nA\nABB\nA", &x, &y, expected, &props);
+        epd_draw_text_layout(&layout, 50, 40, drawn, &props);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, drawn, fb_size);
+    }
+
+    // pages of two lines
+    EpdFontProperties props = epd_font_properties_default();
+    epd_layout_text(&wrap_font, text, 20, 12, &props, &layout);
+    TEST_ASSERT_EQUAL(2, layout.line_count);
+    TEST_ASSERT_EQUAL(5, layout.glyph_count);
+    TEST_ASSERT_EQUAL(7, layout.length);
+    epd_layout_text(&wrap_font, text + 7, 20, 12, &props, &layout);
+    TEST_ASSERT_EQUAL(2, layout.line_count);
+    TEST_ASSERT_EQUAL(6, layout.length);
+    epd_layout_text(&wrap_font, text + 13, 20, 12, &props, &layout);
+    TEST_ASSERT_EQUAL(1, layout.line_count);
+    TEST_ASSERT_EQUAL(1, layout.length);
+
+    // a full glyph storage ends the layout
+    layout.glyph_capacity = 4;
+    epd_layout_text(&wrap_font, "ABBA\nAB", 0, 0, &props, &layout);
+    TEST_ASSERT_EQUAL(1, layout.line_count);
+    TEST_ASSERT_EQUAL(4, layout.length);
+
+    free(expected);
+    free(drawn);
+    epd_deinit();
+}
+
+// A glyph of 41 x 14 pixels with runs, literals and uneven rows, run-length encoded.
+static const uint8_t rle_bitmap[] = {
+    0x49, 0x93, 0xd6, 0xb4, 0x92, 0x70, 0x5e, 0x3c, 0x1a, 0xf8, 0xd6, 0xb4, 0xca, 0x09,
+    0x80, 0x00, 0x49, 0x92, 0x70, 0x5e, 0x3c, 0x1a, 0xf8, 0xd6, 0xb4, 0x92, 0x70, 0x0e,
+    0xca, 0x09, 0x01, 0x49, 0x91, 0x1a, 0xf8, 0xd6, 0xb4, 0x92, 0x70, 0x5e, 0x3c, 0x1a,
+    0xca, 0x09, 0x02, 0x49, 0x90, 0xb4, 0x92, 0x70, 0x5e, 0x3c, 0x1a, 0xf8, 0xd6, 0x04,
+    0xca, 0x09, 0x03, 0x49, 0x8f, 0x5e, 0x3c, 0x1a, 0xf8, 0xd6, 0xb4, 0x92, 0x70, 0xca,
+    0x09, 0x04, 0x49, 0x8e, 0xf8, 0xd6, 0xb4, 0x92, 0x70, 0x5e, 0x3c, 0x0a, 0xca, 0x09,
+    0x05, 0x49, 0x8d, 0x92, 0x70, 0x5e, 0x3c, 0x1a, 0xf8, 0xd6, 0xca, 0x09, 0x06, 0x49,
+    0x8c, 0x3c, 0x1a, 0xf8, 0xd6, 0xb4, 0x92, 0x00, 0xca, 0x09, 0x07, 0x49, 0x8b, 0xd6,
+    0xb4, 0x92, 0x70, 0x5e, 0x3c, 0xca, 0x09, 0x08, 0x49, 0x8a, 0x70, 0x5e, 0x3c, 0x1a,
+    0xf8, 0x06, 0xca, 0x09, 0x09, 0x49, 0x88, 0x1a, 0xf8, 0xd6, 0xb4, 0x02, 0xcb, 0x09,
+    0x0a, 0x49, 0x88, 0xb4, 0x92, 0x70, 0x5e, 0x0c, 0xca, 0x09, 0x3f, 0x11,
+};
+
+/// Pixel values of the run-length encoded glyph.
+static uint8_t rle_glyph_pixel(int x, int y) {
+    if (y >= 12 || x < y) {
+        return 0;
+    }
+    if (x < y + 10) {
+        return 15;
+    }
+    return x < 30 ? (x * 7 + y * 3) % 16 : 9;
+}
+
+static uint8_t rle_plain_bitmap[21 * 14];
+
+static const EpdGlyph rle_glyphs[] = {
+    { .width = 41, .height = 14, .advance_x = 40, .left = -2, .top = 10 },
+};
+
+static const EpdUnicodeInterval rle_intervals[] = { { 'A', 'A', 0 } };
+
+static const EpdFont rle_font = {
+    .bitmap = rle_bitmap,
+    .glyph = rle_glyphs,
+    .intervals = rle_intervals,
+    .interval_count = 1,
+    .compressed = EPD_FONT_COMPRESSED_RLE,
+    .advance_y = 16,
+    .ascender = 10,
+    .descender = -4,
+};
+
+static const EpdFont rle_plain_font = {
+    .bitmap = rle_plain_bitmap,
+    .glyph = rle_glyphs,
+    .intervals = rle_intervals,
+    .interval_count = 1,
+    .compressed = EPD_FONT_UNCOMPRESSED,
+    .advance_y = 16,
+    .ascender = 10,
+    .descender = -4,
+};
+
+TEST_CASE("run-length encoded glyphs are drawn like uncompressed glyphs", "[epdiy,unit]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* expected = malloc(fb_size);
+    uint8_t* decoded = malloc(fb_size);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(decoded);
+    memset(expected, 0x5A, fb_size);
+    memset(decoded, 0x5A, fb_size);
+
+    memset(rle_plain_bitmap, 0, sizeof(rle_plain_bitmap));
+    for (int y = 0; y < 14; y++) {
+        for (int x = 0; x < 41; x++) {
+            rle_plain_bitmap[y * 21 + x / 2] |= rle_glyph_pixel(x, y) << (x % 2 * 4);
+        }
+    }
+
+    const int positions[][2] = { { 9, 20 }, { 10, 40 }, { -3, 2 }, { 700, 595 } };
+    for (int rotation = EPD_ROT_LANDSCAPE; rotation <= EPD_ROT_INVERTED_PORTRAIT; rotation++) {
+        epd_set_rotation(rotation);
+        for (int i = 0; i < 8; i++) {
+            EpdFontProperties props = epd_font_properties_default();
+            props.fg_color = i % 2 ? 3 : 0;
+            if (i / 4) {
+                props.flags |= EPD_DRAW_BACKGROUND;
+            }
+            int x = positions[i % 4][0], y = positions[i % 4][1];
+            epd_write_string(&rle_plain_font, "AAA", &x, &y, expected, &props);
+            x = positions[i % 4][0], y = positions[i % 4][1];
+            epd_write_string(&rle_font, "AAA", &x, &y, decoded, &props);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, decoded, fb_size);
+        }
+    }
+
+    epd_set_rotation(EPD_ROT_LANDSCAPE);
+    free(expected);
+    free(decoded);
+    epd_deinit();
+}
+
+// A glyph of 13 x 5 pixels with 4 gray levels, in 1, 2 and 4 bits per pixel.
+static uint8_t low_depth_pixel(int bits_per_pixel, int x, int y) {
+    if (bits_per_pixel == 1) {
+        return (x * y + x) % 3 == 0;
+    }
+    return (x + 2 * y) % 4;
+}
+
+static uint8_t low_depth_bitmaps[3][7 * 5];
+
+// the 2 bit per pixel glyph, zlib-compressed
+static const uint8_t low_depth_compressed[] = {
+    0x78, 0xda, 0x7b, 0xf2, 0xe4, 0x09, 0x83, 0x9f, 0x9f, 0x1f,
+    0xd3, 0x13, 0x24, 0x1a, 0x00, 0x6c, 0x80, 0x09, 0xdd,
+};
+
+static const EpdGlyph low_depth_glyphs[] = {
+    { .width = 13, .height = 5, .advance_x = 14, .left = 1, .top = 4 },
+};
+
+static const EpdGlyph low_depth_compressed_glyphs[] = {
+    { .width = 13, .height = 5, .advance_x = 14, .left = 1, .top = 4, .compressed_size = 19 },
+};
+
+static const EpdUnicodeInterval low_depth_intervals[] = { { 'A', 'A', 0 } };
+
+/**
+ * Pack the low depth glyph with `bits_per_pixel`, or its 4 bit equivalent for `bits` of 4.
+ */
+static void pack_low_depth_glyph(uint8_t* bitmap, int bits_per_pixel, int bits) {
+    int levels = (1 << bits_per_pixel) - 1;
+    int stride = (13 * bits + 7) / 8;
+    memset(bitmap, 0, stride * 5);
+    for (int y = 0; y < 5; y++) {
+        for (int x = 0; x < 13; x++) {
+            uint8_t value = low_depth_pixel(bits_per_pixel, x, y);
+            if (bits == 4) {
+                value = value * 15 / levels;
+            }
+            bitmap[y * stride + x * bits / 8] |= value << (x * bits % 8);
+        }
+    }
+}
+
+TEST_CASE("glyphs of fewer bits per pixel are drawn like 4 bit glyphs", "[epdiy,unit]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* expected = malloc(fb_size);
+    uint8_t* drawn = malloc(fb_size);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(drawn);
+
+    EpdFont expected_font = {
+        .bitmap = low_depth_bitmaps[0],
+        .glyph = low_depth_glyphs,
+        .intervals = low_depth_intervals,
+        .interval_count = 1,
+        .advance_y = 6,
+        .ascender = 4,
+        .descender = -1,
+    };
+    EpdFont font = expected_font;
+    font.bitmap = low_depth_bitmaps[1];
+
+    const int positions[][2] = { { 9, 20 }, { 10, 40 }, { -3, 2 }, { 790, 595 } };
+    for (int variant = 0; variant < 3; variant++) {
+        int bits_per_pixel = variant == 0 ? 1 : 2;
+        pack_low_depth_glyph(low_depth_bitmaps[0], bits_per_pixel, 4);
+        pack_low_depth_glyph(low_depth_bitmaps[1], bits_per_pixel, bits_per_pixel);
+        font.bits_per_pixel = bits_per_pixel;
+        if (variant == 2) {
+            font.bitmap = low_depth_compressed;
+            font.glyph = low_depth_compressed_glyphs;
+            font.compressed = EPD_FONT_COMPRESSED_ZLIB;
+        }
+
+        memset(expected, 0x5A, fb_size);
+        memset(drawn, 0x5A, fb_size);
+        for (int rotation = EPD_ROT_LANDSCAPE; rotation <= EPD_ROT_INVERTED_PORTRAIT; rotation++) {
+            epd_set_rotation(rotation);
+            for (int i = 0; i < 8; i++) {
+                EpdFontProperties props = epd_font_properties_default();
+                props.fg_color = i % 2 ? 3 : 0;
+                if (i / 4) {
+                    props.flags |= EPD_DRAW_BACKGROUND;
+                }
+                int x = positions[i % 4][0], y = positions[i % 4][1];
+                epd_write_string(&expected_font, "AA", &x, &y, expected, &props);
+                x = positions[i % 4][0], y = positions[i % 4][1];
+                epd_write_string(&font, "AA", &x, &y, drawn, &props);
+                TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, drawn, fb_size);
+            }
+        }
+    }
+
+    epd_set_rotation(EPD_ROT_LANDSCAPE);
+    free(expected);
+    free(drawn);
+    epd_deinit();
+}
+
+/**
+ * Write all combinations of test fonts, strings and properties to `fb`, twice,
+ * and record the returned errors and cursor positions in `results`.
+ */
+static void write_text_cache_lines(uint8_t* fb, int* results) {
+    const EpdFont* fonts[] = { &test_font, &test_compressed_font, &wrap_font, &rle_font };
+    const char* strings[] = { "ABBA\nBA", "AB BA", " A  B ", "A", "ABx" };
+    const enum EpdFontFlags flags[] = {
+        EPD_DRAW_ALIGN_LEFT,
+        EPD_DRAW_ALIGN_CENTER | EPD_DRAW_BACKGROUND,
+        EPD_DRAW_ALIGN_RIGHT,
+        EPD_DRAW_ALIGN_LEFT | EPD_DRAW_BACKGROUND,
+    };
+    const int positions[][2] = { { 9, 20 }, { 10, 40 }, { -3, 2 }, { 790, 595 } };
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < 4 * 5 * 4; i++) {
+            EpdFontProperties props = epd_font_properties_default();
+            props.flags = flags[i / 20];
+            props.fg_color = i % 3;
+            props.bg_color = 15 - i % 2;
+            props.fallback_glyph = i % 2 ? 'A' : 0;
+            int x = positions[i % 4][0], y = positions[i % 4][1];
+            *results++ = epd_write_string(fonts[i % 4], strings[i / 4 % 5], &x, &y, fb, &props);
+            *results++ = x;
+            *results++ = y;
+        }
+    }
+}
+
+TEST_CASE("lines from the text cache are drawn like written lines", "[epdiy,unit]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* expected = malloc(fb_size);
+    uint8_t* cached = malloc(fb_size);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(cached);
+
+    memset(rle_plain_bitmap, 0, sizeof(rle_plain_bitmap));
+    for (int y = 0; y < 14; y++) {
+        for (int x = 0; x < 41; x++) {
+            rle_plain_bitmap[y * 21 + x / 2] |= rle_glyph_pixel(x, y) << (x % 2 * 4);
+        }
+    }
+
+    static int expected_results[2 * 80 * 3];
+    static int cached_results[2 * 80 * 3];
+
+    // budgets for no line, a few lines with evictions, and all lines
+    const size_t budgets[] = { 0, 300, 1 << 16 };
+    for (int rotation = EPD_ROT_LANDSCAPE; rotation <= EPD_ROT_INVERTED_PORTRAIT; rotation++) {
+        epd_set_rotation(rotation);
+        memset(expected, 0x5A, fb_size);
+        write_text_cache_lines(expected, expected_results);
+
+        for (int b = 0; b < sizeof(budgets) / sizeof(size_t); b++) {
+            memset(cached, 0x5A, fb_size);
+            epd_text_cache_init(budgets[b], MALLOC_CAP_DEFAULT);
+            write_text_cache_lines(cached, cached_results);
+            epd_text_cache_deinit();
+            for (int i = 0; i < 2 * 80 * 3; i++) {
+                TEST_ASSERT_EQUAL(expected_results[i], cached_results[i]);
+            }
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, cached, fb_size);
+        }
+    }
+
+    epd_set_rotation(EPD_ROT_LANDSCAPE);
+    free(expected);
+    free(cached);
+    epd_deinit();
+}
+
+TEST_CASE("lines with corrupt glyphs are not cached", "[epdiy,unit]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* expected = malloc(fb_size);
+    uint8_t* cached = malloc(fb_size);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(cached);
+
+    // the second glyph is truncated
+    EpdGlyph glyphs[2] = { test_compressed_glyphs[0], test_compressed_glyphs[1] };
+    glyphs[1].compressed_size = 10;
+    EpdFont font = test_compressed_font;
+    font.glyph = glyphs;
+    EpdFontProperties props = epd_font_properties_default();
+
+    memset(expected, 0xFF, fb_size);
+    int expected_x = 9;
+    int y = 20;
+    TEST_ASSERT_EQUAL(
+        EPD_DRAW_GLYPH_CORRUPT, epd_write_string(&font, "ABA", &expected_x, &y, expected, &props)
+    );
+
+    epd_text_cache_init(1 << 16, MALLOC_CAP_DEFAULT);
+    for (int pass = 0; pass < 2; pass++) {
+        memset(cached, 0xFF, fb_size);
+        int x = 9;
+        y = 20;
+        TEST_ASSERT_EQUAL(
+            EPD_DRAW_GLYPH_CORRUPT, epd_write_string(&font, "ABA", &x, &y, cached, &props)
+        );
+        TEST_ASSERT_EQUAL(expected_x, x);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, cached, fb_size);
+    }
+    epd_text_cache_deinit();
+
+    free(expected);
+    free(cached);
+    epd_deinit();
+}
+
+#endif
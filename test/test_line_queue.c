@@ -0,0 +1,76 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unity.h>
+
+#include "epdiy.h"
+#include "output_common/line_queue.h"
+
+#define TEST_QUEUE_LEN 4
+#define TEST_LINE_BYTES 32
+
+TEST_CASE("line queue hands out lines in order", "[epdiy,unit]") {
+    LineQueue_t lq = lq_init(TEST_QUEUE_LEN, TEST_LINE_BYTES);
+
+    // producers finish lines out of order
+    const int order[TEST_QUEUE_LEN] = { 2, 0, 3, 1 };
+    for (int i = 0; i < TEST_QUEUE_LEN; i++) {
+        uint8_t* buf = lq_current(&lq, order[i]);
+        TEST_ASSERT_NOT_NULL(buf);
+        memset(buf, order[i], TEST_LINE_BYTES);
+        lq_commit(&lq, order[i]);
+    }
+#if EPD_RENDER_STATS
+    TEST_ASSERT_EQUAL(TEST_QUEUE_LEN, lq.high_water);
+#endif
+
+    // the next line needs the slot of line 0
+    TEST_ASSERT_NULL(lq_current(&lq, TEST_QUEUE_LEN));
+
+    for (int l = 0; l < TEST_QUEUE_LEN; l++) {
+        uint8_t* line = lq_read(&lq, l);
+        TEST_ASSERT_NOT_NULL(line);
+        TEST_ASSERT_EQUAL_UINT8(l, line[0]);
+        TEST_ASSERT_EQUAL_UINT8(l, line[TEST_LINE_BYTES - 1]);
+
+        // the same buffer is handed on to the line after the next queue cycle
+        TEST_ASSERT_NULL(lq_current(&lq, l + TEST_QUEUE_LEN));
+        lq_release(&lq, l);
+        TEST_ASSERT_EQUAL_PTR(line, lq_current(&lq, l + TEST_QUEUE_LEN));
+    }
+#if EPD_RENDER_STATS
+    TEST_ASSERT_EQUAL(0, lq.underruns);
+#endif
+
+    lq_free(&lq);
+}
+
+#if EPD_RENDER_STATS
+
+TEST_CASE("line queue counts underruns once per line", "[epdiy,unit]") {
+    LineQueue_t lq = lq_init(TEST_QUEUE_LEN, TEST_LINE_BYTES);
+
+    TEST_ASSERT_NULL(lq_read(&lq, 0));
+    TEST_ASSERT_NULL(lq_read(&lq, 0));
+    TEST_ASSERT_EQUAL(1, lq.underruns);
+
+    lq_current(&lq, 0);
+    lq_commit(&lq, 0);
+    TEST_ASSERT_NOT_NULL(lq_read(&lq, 0));
+    lq_release(&lq, 0);
+    TEST_ASSERT_NULL(lq_read(&lq, 1));
+    TEST_ASSERT_EQUAL(2, lq.underruns);
+
+    // a new frame starts at line 0 again, statistics are kept
+    lq_reset(&lq);
+    TEST_ASSERT_NOT_NULL(lq_current(&lq, 0));
+    TEST_ASSERT_EQUAL(2, lq.underruns);
+    TEST_ASSERT_EQUAL(1, lq.high_water);
+
+    lq_reset_stats(&lq);
+    TEST_ASSERT_EQUAL(0, lq.underruns);
+    TEST_ASSERT_EQUAL(0, lq.high_water);
+
+    lq_free(&lq);
+}
+#endif
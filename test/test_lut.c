@@ -193,7 +193,20 @@ TEST_CASE("1ppB lookup LCD, 64k LUT", "[epdiy,unit,lut]") {
     diff_test_buffers_free(&bufs);
 }
 
-#if !DISABLED_FOR_TARGETS(ESP32)
+TEST_CASE("1ppB lookup, 1k LUT, without PIE", "[epdiy,unit,lut]") {
+    LutTestBuffers bufs;
+    lut_test_buffers_init(&bufs, DEFAULT_EXAMPLE_LEN, result_pattern_1ppB, 4);
+
+    enum EpdDrawMode mode = MODE_GL16 | MODE_PACKING_1PPB_DIFFERENCE | MODE_FORCE_NO_PIE;
+    LutFunctionPair func_pair = find_lut_functions(mode, 1 << 10);
+    TEST_ASSERT_NOT_NULL(func_pair.lookup_func);
+    func_pair.build_func(bufs.lut, &test_waveform, 0);
+    test_with_alignments(&bufs, func_pair.lookup_func);
+
+    diff_test_buffers_free(&bufs);
+}
+
+#ifdef RENDER_METHOD_LCD
 TEST_CASE("1ppB lookup LCD, 1k LUT, PIE", "[epdiy,unit,lut]") {
     LutTestBuffers bufs;
     lut_test_buffers_init(&bufs, DEFAULT_EXAMPLE_LEN, result_pattern_1ppB, 4);
@@ -280,4 +293,52 @@ TEST_CASE("8ppB lookup LCD, 1k LUT, previously black", "[epdiy,unit,lut]") {
     test_with_alignments(&bufs, func_pair.lookup_func);
 
     diff_test_buffers_free(&bufs);
-}
\ No newline at end of file
+}
+/**
+ * Check that patching a LUT from one waveform phase to another
+ * gives the same result as building it from scratch.
+ */
+static void test_lut_patching(enum EpdDrawMode mode, int num_changes) {
+    LutFunctionPair func_pair = find_lut_functions(mode, 1 << 16);
+    TEST_ASSERT_NOT_NULL(func_pair.patch_func);
+
+    uint8_t phase_data[2][16][4];
+    fill_test_waveform();
+    memcpy(phase_data[0], waveform_phases, sizeof(waveform_phases));
+    memcpy(phase_data[1], waveform_phases, sizeof(waveform_phases));
+    // Invert some transitions from and to white and black,
+    // so they are seen by all LUT types.
+    for (int i = 0; i < num_changes; i++) {
+        phase_data[1][i][0] ^= 0xC0;
+        phase_data[1][15 - i][3] ^= 0x03;
+    }
+    EpdWaveformPhases phases = {
+        .phase_times = NULL,
+        .phases = 2,
+        .luts = (uint8_t*)phase_data,
+    };
+
+    uint8_t* patched = heap_caps_malloc(1 << 16, MALLOC_CAP_DEFAULT);
+    uint8_t* built = heap_caps_malloc(1 << 16, MALLOC_CAP_DEFAULT);
+    TEST_ASSERT_NOT_NULL(patched);
+    TEST_ASSERT_NOT_NULL(built);
+
+    func_pair.build_func(patched, &phases, 0);
+    func_pair.build_func(built, &phases, 1);
+    TEST_ASSERT(func_pair.patch_func(patched, phases.luts, phases.luts + 64));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(built, patched, 1 << 16);
+
+    heap_caps_free(patched);
+    heap_caps_free(built);
+}
+
+TEST_CASE("1ppB 64k LUT patching matches rebuild", "[epdiy,unit,lut]") {
+    enum EpdDrawMode mode = MODE_GL16 | MODE_PACKING_1PPB_DIFFERENCE | MODE_FORCE_NO_PIE;
+    test_lut_patching(mode, 1);
+    test_lut_patching(mode, 4);
+}
+
+TEST_CASE("2ppB 64k LUT patching matches rebuild", "[epdiy,unit,lut]") {
+    test_lut_patching(MODE_GL16 | MODE_PACKING_2PPB | PREVIOUSLY_WHITE, 1);
+    test_lut_patching(MODE_GL16 | MODE_PACKING_2PPB | PREVIOUSLY_BLACK, 1);
+}
@@ -0,0 +1,145 @@
+#include <esp_heap_caps.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include "epd_display.h"
+#include "epd_internals.h"
+#include "epdiy.h"
+#include "esp_timer.h"
+
+#include "output_common/lut.h"
+#include "output_common/render_context.h"
+#include "output_common/render_method.h"
+
+/// Number of lookups to average over for each measurement.
+#define LOOKUP_ITERATIONS 200
+/// Number of LUT builds to average over for each measurement.
+#define BUILD_ITERATIONS 10
+
+/// Horizontal blanking of the LCD driver in bus cycles (LE high time + front porch).
+#define LCD_LINE_BLANKING_CYCLES 8
+
+typedef struct {
+    const char* name;
+    enum EpdDrawMode mode;
+    uint32_t lut_size;
+    /// Pixels per byte of input data.
+    int pixels_per_byte;
+} LutBenchmarkConfig;
+
+static const LutBenchmarkConfig benchmark_configs[] = {
+    { "1ppB 64k", MODE_GL16 | MODE_PACKING_1PPB_DIFFERENCE | MODE_FORCE_NO_PIE, 1 << 16, 1 },
+    { "1ppB 1k", MODE_GL16 | MODE_PACKING_1PPB_DIFFERENCE | MODE_FORCE_NO_PIE, 1 << 10, 1 },
+#ifdef RENDER_METHOD_LCD
+    { "1ppB 1k VE", MODE_GL16 | MODE_PACKING_1PPB_DIFFERENCE, 1 << 10, 1 },
+#endif
+    { "2ppB 64k white", MODE_GL16 | MODE_PACKING_2PPB | PREVIOUSLY_WHITE, 1 << 16, 2 },
+    { "2ppB 64k black", MODE_GL16 | MODE_PACKING_2PPB | PREVIOUSLY_BLACK, 1 << 16, 2 },
+    { "2ppB 1k white", MODE_GL16 | MODE_PACKING_2PPB | PREVIOUSLY_WHITE, 1 << 10, 2 },
+    { "2ppB 1k black", MODE_GL16 | MODE_PACKING_2PPB | PREVIOUSLY_BLACK, 1 << 10, 2 },
+    { "8ppB white", MODE_DU | MODE_PACKING_8PPB | PREVIOUSLY_WHITE, 1 << 10, 8 },
+    { "8ppB black", MODE_DU | MODE_PACKING_8PPB | PREVIOUSLY_BLACK, 1 << 10, 8 },
+};
+
+/// Displays covering the range of common display widths.
+static const EpdDisplay_t* benchmark_displays[] = {
+    &ED060SCT, &ED047TC1, &ED060XC3, &ED097TC2, &ED052TC4, &ED133UT2,
+};
+
+/**
+ * Time to output a single line on the LCD bus at the display's nominal
+ * bus speed in ns, which is the budget for preparing a line.
+ */
+static int line_period_ns(const EpdDisplay_t* display) {
+    int bus_cycles = display->width / 4 / (display->bus_width / 8) + LCD_LINE_BLANKING_CYCLES;
+    return bus_cycles * 1000 / display->bus_speed;
+}
+
+static const EpdWaveformPhases* benchmark_phases(
+    const EpdWaveform* waveform, enum EpdDrawMode mode
+) {
+    for (int i = 0; i < waveform->num_modes; i++) {
+        if (waveform->mode_data[i]->type == (mode & 0x3F)) {
+            return waveform->mode_data[i]->range_data[0];
+        }
+    }
+    return waveform->mode_data[0]->range_data[0];
+}
+
+static void benchmark_lut_functions(
+    const LutBenchmarkConfig* config, const EpdDisplay_t* display, uint8_t* lut
+) {
+    int width = display->width;
+    LutFunctionPair pair = find_lut_functions(config->mode, config->lut_size);
+    if (pair.build_func == NULL || pair.lookup_func == NULL) {
+        printf("%-16s %5d px: not available with this render method.\n", config->name, width);
+        return;
+    }
+
+    uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    uint8_t* line_data = heap_caps_aligned_alloc(16, width / config->pixels_per_byte, caps);
+    uint8_t* result_line = heap_caps_aligned_alloc(16, width / 4, caps);
+    TEST_ASSERT_NOT_NULL(line_data);
+    TEST_ASSERT_NOT_NULL(result_line);
+
+    // pseudo-random image content, so that all LUT entries are used
+    uint32_t seed = 0x12345678;
+    for (int i = 0; i < width / config->pixels_per_byte; i++) {
+        seed = seed * 1664525 + 1013904223;
+        line_data[i] = seed >> 24;
+    }
+
+    const EpdWaveformPhases* phases = benchmark_phases(display->default_waveform, config->mode);
+
+    uint64_t start = esp_timer_get_time();
+    for (int i = 0; i < BUILD_ITERATIONS; i++) {
+        pair.build_func(lut, phases, i % phases->phases);
+    }
+    int build_us = (esp_timer_get_time() - start) / BUILD_ITERATIONS;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < LOOKUP_ITERATIONS; i++) {
+        pair.lookup_func((const uint32_t*)line_data, result_line, lut, width);
+    }
+    int lookup_ns = (esp_timer_get_time() - start) * 1000 / LOOKUP_ITERATIONS;
+    if (lookup_ns == 0) {
+        lookup_ns = 1;
+    }
+
+    // The render threads prepare lines in parallel, so each of them
+    // may take up to DEFAULT_RENDER_THREADS line periods for a line.
+    int budget_ns = line_period_ns(display) * DEFAULT_RENDER_THREADS;
+    printf(
+        "%-16s %5d px: build %6dus, lookup %7dns/line, %8d lines/s, "
+        "line period %5dns @ %2dMHz, headroom %5.2fx\n",
+        config->name,
+        width,
+        build_us,
+        lookup_ns,
+        1000000000 / lookup_ns,
+        line_period_ns(display),
+        display->bus_speed,
+        (float)budget_ns / lookup_ns
+    );
+
+    heap_caps_free(line_data);
+    heap_caps_free(result_line);
+}
+
+TEST_CASE("benchmark all LUT function pairs", "[epdiy,benchmark,lut]") {
+    uint8_t* lut = heap_caps_malloc(1 << 16, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    TEST_ASSERT_NOT_NULL(lut);
+
+    int num_configs = sizeof(benchmark_configs) / sizeof(LutBenchmarkConfig);
+    int num_displays = sizeof(benchmark_displays) / sizeof(EpdDisplay_t*);
+    for (int c = 0; c < num_configs; c++) {
+        for (int d = 0; d < num_displays; d++) {
+            memset(lut, 0, 1 << 16);
+            benchmark_lut_functions(&benchmark_configs[c], benchmark_displays[d], lut);
+        }
+    }
+
+    heap_caps_free(lut);
+}
@@ -0,0 +1,749 @@
+#include <esp_heap_caps.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "epdiy.h"
+#include "output_common/render_method.h"
+
+#ifdef RENDER_METHOD_HOST
+#include "output_common/render_context.h"
+#include "output_host/render_host.h"
+#include "output_host/simulate.h"
+#include "render.h"
+
+static const EpdRect test_rect = { .x = 100, .y = 50, .width = 200, .height = 20 };
+
+static int expected_frame_count(const EpdWaveform* waveform, enum EpdDrawMode mode) {
+    for (int i = 0; i < waveform->num_modes; i++) {
+        if (waveform->mode_data[i]->type == (mode & 0x3F)) {
+            return waveform->mode_data[i]->range_data[0]->phases;
+        }
+    }
+    return -1;
+}
+
+static uint8_t pixel_action(const EpdHostCapture* capture, int frame, int x, int y) {
+    const uint8_t* line = epd_host_capture_line(capture, frame, y);
+    return (line[x / 4] >> (2 * (x % 4))) & 0x3;
+}
+
+/**
+ * Check that only pixels in `test_rect` were driven, and that all of them were darkened.
+ */
+static void assert_only_rect_darkened(const EpdHostCapture* capture) {
+    for (int y = 0; y < capture->height; y++) {
+        bool in_rows = y >= test_rect.y && y < test_rect.y + test_rect.height;
+        for (int x = 0; x < capture->width; x++) {
+            bool in_rect = in_rows && x >= test_rect.x && x < test_rect.x + test_rect.width;
+            bool darkened = false;
+            for (int f = 0; f < capture->frame_count; f++) {
+                uint8_t action = pixel_action(capture, f, x, y);
+                if (!in_rect) {
+                    TEST_ASSERT_EQUAL_UINT8(0, action);
+                }
+                darkened |= action == 0x1;
+            }
+            TEST_ASSERT(darkened == in_rect);
+        }
+    }
+}
+
+TEST_CASE("host renderer records every frame of a 2ppB draw", "[epdiy,host]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    epd_host_capture_reset();
+
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* fb = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    TEST_ASSERT_NOT_NULL(fb);
+    memset(fb, 0xFF, fb_size);
+    epd_fill_rect(test_rect, 0x00, fb);
+
+    enum EpdDrawMode mode = MODE_GL16 | MODE_PACKING_2PPB | PREVIOUSLY_WHITE;
+    enum EpdDrawError err = epd_draw_base(
+        epd_full_screen(), fb, epd_full_screen(), mode, 25, NULL, NULL, &epdiy_ED060SCT
+    );
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, err);
+
+    const EpdHostCapture* capture = epd_host_capture();
+    TEST_ASSERT_EQUAL(expected_frame_count(&epdiy_ED060SCT, mode), capture->frame_count);
+    TEST_ASSERT_EQUAL(epd_width(), capture->width);
+    TEST_ASSERT_EQUAL(epd_height(), capture->height);
+    assert_only_rect_darkened(capture);
+
+    heap_caps_free(fb);
+    epd_host_capture_reset();
+    epd_deinit();
+}
+
+/**
+ * Get the high-level state shared by all tests, with an all white screen.
+ * The high-level API can only be initialized once.
+ */
+static EpdiyHighlevelState* white_hl_state() {
+    static EpdiyHighlevelState hl;
+    static bool initialized = false;
+    if (!initialized) {
+        hl = epd_hl_init(&epdiy_ED060SCT);
+        initialized = true;
+    }
+    epd_hl_set_all_white(&hl);
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_hl_update_screen(&hl, MODE_GL16, 25));
+    epd_host_capture_reset();
+    return &hl;
+}
+
+TEST_CASE("host renderer records high-level partial updates", "[epdiy,host]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    EpdiyHighlevelState* hl = white_hl_state();
+
+    epd_fill_rect(test_rect, 0x00, epd_hl_get_framebuffer(hl));
+    enum EpdDrawError err = epd_hl_update_screen(hl, MODE_GL16, 25);
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, err);
+
+    const EpdHostCapture* capture = epd_host_capture();
+    TEST_ASSERT_EQUAL(expected_frame_count(&epdiy_ED060SCT, MODE_GL16), capture->frame_count);
+    assert_only_rect_darkened(capture);
+
+    epd_host_capture_reset();
+    epd_deinit();
+}
+
+static bool rects_contain(const EpdRect* rects, int num_rects, int x, int y) {
+    for (int i = 0; i < num_rects; i++) {
+        EpdRect r = rects[i];
+        if (x >= r.x && x < r.x + r.width && y >= r.y && y < r.y + r.height) {
+            return true;
+        }
+    }
+    return false;
+}
+
+TEST_CASE("high-level updates only drive changed regions", "[epdiy,host]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    EpdiyHighlevelState* hl = white_hl_state();
+
+    // two widgets in opposite corners
+    const EpdRect rects[2] = {
+        { .x = 16, .y = 8, .width = 64, .height = 32 },
+        { .x = 700, .y = 540, .width = 80, .height = 40 },
+    };
+    uint8_t* fb = epd_hl_get_framebuffer(hl);
+    epd_fill_rect(rects[0], 0x00, fb);
+    epd_fill_rect(rects[1], 0x80, fb);
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_hl_update_screen(hl, MODE_GC16, 25));
+
+    const EpdHostCapture* capture = epd_host_capture();
+    TEST_ASSERT(capture->frame_count > 0);
+    for (int f = 0; f < capture->frame_count; f++) {
+        for (int y = 0; y < capture->height; y++) {
+            for (int x = 0; x < capture->width; x++) {
+                if (!rects_contain(rects, 2, x, y)) {
+                    TEST_ASSERT_EQUAL_UINT8(0, pixel_action(capture, f, x, y));
+                }
+            }
+        }
+    }
+
+    epd_host_capture_reset();
+    epd_deinit();
+}
+
+TEST_CASE("high-level updates mirror the output, not the framebuffers", "[epdiy,host]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    EpdiyHighlevelState* hl = white_hl_state();
+    hl->mirror_x = true;
+
+    uint8_t* fb = epd_hl_get_framebuffer(hl);
+    epd_fill_rect(test_rect, 0x00, fb);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* expected_fb = malloc(fb_size);
+    TEST_ASSERT_NOT_NULL(expected_fb);
+    memcpy(expected_fb, fb, fb_size);
+
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_hl_update_screen(hl, MODE_GL16, 25));
+    hl->mirror_x = false;
+
+    const EpdHostCapture* capture = epd_host_capture();
+    TEST_ASSERT(capture->frame_count > 0);
+    for (int y = 0; y < capture->height; y++) {
+        bool in_rows = y >= test_rect.y && y < test_rect.y + test_rect.height;
+        for (int x = 0; x < capture->width; x++) {
+            int fb_x = capture->width - 1 - x;
+            bool in_rect = in_rows && fb_x >= test_rect.x && fb_x < test_rect.x + test_rect.width;
+            bool darkened = false;
+            for (int f = 0; f < capture->frame_count; f++) {
+                darkened |= pixel_action(capture, f, x, y) == 0x1;
+            }
+            TEST_ASSERT(darkened == in_rect);
+        }
+    }
+
+    // both framebuffers stay in drawing orientation
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_fb, hl->front_fb, fb_size);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_fb, hl->back_fb, fb_size);
+
+    free(expected_fb);
+    epd_host_capture_reset();
+    epd_deinit();
+}
+
+/**
+ * Draw `test_rect` with a gradient in a high-level update and return a copy
+ * of the recorded frames. The display is white again afterwards.
+ */
+static uint8_t* capture_hl_update(EpdiyHighlevelState* hl, bool mirror_x, int* frames_size) {
+    uint8_t* fb = epd_hl_get_framebuffer(hl);
+    for (int x = 0; x < test_rect.width; x++) {
+        EpdRect column = { test_rect.x + x, test_rect.y, 1, test_rect.height };
+        epd_fill_rect(column, (x % 16) * 0x10, fb);
+    }
+    hl->mirror_x = mirror_x;
+    enum EpdDrawError err = epd_hl_update_screen(hl, MODE_GC16, 25);
+    hl->mirror_x = false;
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, err);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(hl->front_fb, hl->back_fb, epd_width() / 2 * epd_height());
+
+    const EpdHostCapture* capture = epd_host_capture();
+    *frames_size = capture->frame_count * capture->height * capture->line_bytes;
+    uint8_t* frames = malloc(*frames_size);
+    TEST_ASSERT_NOT_NULL(frames);
+    memcpy(frames, capture->frames, *frames_size);
+
+    epd_hl_set_all_white(hl);
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_hl_update_screen(hl, MODE_GL16, 25));
+    epd_host_capture_reset();
+    return frames;
+}
+
+TEST_CASE("fused difference drawing gives identical output", "[epdiy,host]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    EpdiyHighlevelState* hl = white_hl_state();
+    // the same state, but without a difference image
+    EpdiyHighlevelState fused = *hl;
+    fused.difference_fb = NULL;
+
+    for (int mirrored = 0; mirrored < 2; mirrored++) {
+        int size_buffered, size_fused;
+        uint8_t* buffered = capture_hl_update(hl, mirrored, &size_buffered);
+        uint8_t* direct = capture_hl_update(&fused, mirrored, &size_fused);
+
+        TEST_ASSERT(size_buffered > 0);
+        TEST_ASSERT_EQUAL(size_buffered, size_fused);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(buffered, direct, size_buffered);
+        free(buffered);
+        free(direct);
+    }
+
+    epd_deinit();
+}
+
+TEST_CASE("tracked row changes give identical output", "[epdiy,host]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    EpdiyHighlevelState* hl = white_hl_state();
+    // the same state, with the changes of the drawing functions recorded
+    EpdiyHighlevelState tracked = *hl;
+    tracked.row_changes = calloc(epd_height(), sizeof(EpdRowChanges));
+    TEST_ASSERT_NOT_NULL(tracked.row_changes);
+
+    for (int mirrored = 0; mirrored < 2; mirrored++) {
+        int size_full, size_tracked;
+        uint8_t* full = capture_hl_update(hl, mirrored, &size_full);
+
+        epd_track_row_changes(tracked.front_fb, tracked.row_changes);
+        uint8_t* direct = capture_hl_update(&tracked, mirrored, &size_tracked);
+        epd_track_row_changes(NULL, NULL);
+
+        TEST_ASSERT_EQUAL(size_full, size_tracked);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(full, direct, size_full);
+        for (int y = 0; y < epd_height(); y++) {
+            TEST_ASSERT(tracked.row_changes[y].start >= tracked.row_changes[y].end);
+        }
+        free(full);
+        free(direct);
+    }
+    epd_track_row_changes(tracked.front_fb, tracked.row_changes);
+
+    // unrecorded changes are not found
+    tracked.front_fb[test_rect.y * epd_width() / 2 + test_rect.x / 2] = 0x00;
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_hl_update_screen(&tracked, MODE_GL16, 25));
+    TEST_ASSERT_EQUAL(0, epd_host_capture()->frame_count);
+
+    epd_hl_mark_changed(&tracked, test_rect);
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_hl_update_screen(&tracked, MODE_GL16, 25));
+    TEST_ASSERT(epd_host_capture()->frame_count > 0);
+    epd_host_capture_reset();
+
+    epd_hl_set_all_white(&tracked);
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_hl_update_screen(&tracked, MODE_GL16, 25));
+    epd_host_capture_reset();
+    epd_track_row_changes(NULL, NULL);
+    free(tracked.row_changes);
+    epd_deinit();
+}
+
+/**
+ * Draw a gradient and return a copy of the recorded frames.
+ */
+static uint8_t* capture_gradient_draw(
+    enum EpdInitOptions options, int render_threads, int* frames_size
+) {
+    EpdInitConfig config = { .i2c = NULL, .render_threads = render_threads };
+    epd_init_with_config(&epd_board_host, &ED060SCT, options, &config);
+    epd_host_capture_reset();
+
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* fb = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    TEST_ASSERT_NOT_NULL(fb);
+    for (int i = 0; i < fb_size; i++) {
+        fb[i] = (i % 16) * 0x11;
+    }
+
+    enum EpdDrawMode mode = MODE_GL16 | MODE_PACKING_2PPB | PREVIOUSLY_WHITE;
+    enum EpdDrawError err = epd_draw_base(
+        epd_full_screen(), fb, epd_full_screen(), mode, 25, NULL, NULL, &epdiy_ED060SCT
+    );
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, err);
+
+    const EpdHostCapture* capture = epd_host_capture();
+    *frames_size = capture->frame_count * capture->height * capture->line_bytes;
+    uint8_t* frames = malloc(*frames_size);
+    TEST_ASSERT_NOT_NULL(frames);
+    memcpy(frames, capture->frames, *frames_size);
+
+    heap_caps_free(fb);
+    epd_host_capture_reset();
+    epd_deinit();
+    return frames;
+}
+
+TEST_CASE("double buffered LUT gives identical output", "[epdiy,host]") {
+    int size_single, size_double;
+    uint8_t* single = capture_gradient_draw(EPD_LUT_64K, 0, &size_single);
+    uint8_t* doubled
+        = capture_gradient_draw(EPD_LUT_64K | EPD_LUT_DOUBLE_BUFFERED, 0, &size_double);
+
+    TEST_ASSERT_EQUAL(size_single, size_double);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(single, doubled, size_single);
+
+    free(single);
+    free(doubled);
+}
+
+TEST_CASE("output does not depend on the number of render threads", "[epdiy,host]") {
+    int size_default;
+    uint8_t* reference = capture_gradient_draw(EPD_LUT_64K, 0, &size_default);
+
+    const int thread_counts[] = { 1, 2, 5 };
+    for (int i = 0; i < sizeof(thread_counts) / sizeof(int); i++) {
+        int size;
+        uint8_t* frames = capture_gradient_draw(EPD_LUT_64K, thread_counts[i], &size);
+        TEST_ASSERT_EQUAL(size_default, size);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(reference, frames, size);
+        free(frames);
+    }
+
+    free(reference);
+}
+
+TEST_CASE("line queue holds the lines a frame is started after", "[epdiy,host]") {
+    const int thread_counts[] = { 1, 2, MAX_RENDER_THREADS };
+    const enum EpdInitOptions queue_options[] = { EPD_OPTIONS_DEFAULT, EPD_FEED_QUEUE_8 };
+    for (int i = 0; i < sizeof(thread_counts) / sizeof(int); i++) {
+        for (int j = 0; j < sizeof(queue_options) / sizeof(queue_options[0]); j++) {
+            int lines = render_queue_lines(queue_options[j], thread_counts[i]);
+            TEST_ASSERT_GREATER_OR_EQUAL(FRAME_START_LINES, lines);
+            TEST_ASSERT_GREATER_OR_EQUAL(thread_counts[i] * 8, lines);
+        }
+    }
+    TEST_ASSERT_EQUAL(32 * MAX_RENDER_THREADS, render_queue_lines(EPD_LUT_64K, MAX_RENDER_THREADS));
+}
+
+static void count_draw_done(enum EpdDrawError result, void* user_data) {
+    int* calls = user_data;
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, result);
+    (*calls)++;
+}
+
+TEST_CASE("asynchronous draws give identical output", "[epdiy,host]") {
+    int size_sync;
+    uint8_t* reference = capture_gradient_draw(EPD_LUT_64K, 0, &size_sync);
+
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    epd_host_capture_reset();
+
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* fb = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    TEST_ASSERT_NOT_NULL(fb);
+    for (int i = 0; i < fb_size; i++) {
+        fb[i] = (i % 16) * 0x11;
+    }
+
+    int calls = 0;
+    enum EpdDrawMode mode = MODE_GL16 | MODE_PACKING_2PPB | PREVIOUSLY_WHITE;
+    enum EpdDrawError err = epd_draw_base_async(
+        epd_full_screen(),
+        fb,
+        epd_full_screen(),
+        mode,
+        25,
+        NULL,
+        NULL,
+        &epdiy_ED060SCT,
+        count_draw_done,
+        &calls
+    );
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, err);
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_draw_wait());
+    TEST_ASSERT_EQUAL(1, calls);
+    TEST_ASSERT_FALSE(epd_draw_in_progress());
+
+    const EpdHostCapture* capture = epd_host_capture();
+    TEST_ASSERT_EQUAL(size_sync, capture->frame_count * capture->height * capture->line_bytes);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(reference, capture->frames, size_sync);
+
+    // invalid draws are rejected right away, without calling back
+    EpdRect invalid_crop = { .x = 0, .y = 0, .width = -1, .height = 10 };
+    err = epd_draw_base_async(
+        epd_full_screen(),
+        fb,
+        invalid_crop,
+        mode,
+        25,
+        NULL,
+        NULL,
+        &epdiy_ED060SCT,
+        count_draw_done,
+        &calls
+    );
+    TEST_ASSERT_EQUAL(EPD_DRAW_INVALID_CROP, err);
+    TEST_ASSERT_EQUAL(EPD_DRAW_INVALID_CROP, epd_draw_wait());
+    TEST_ASSERT_EQUAL(1, calls);
+
+    free(reference);
+    heap_caps_free(fb);
+    epd_host_capture_reset();
+    epd_deinit();
+}
+
+#if EPD_RENDER_STATS
+TEST_CASE("render statistics count frames, LUTs and lines", "[epdiy,host]") {
+    EpdInitConfig config = { .i2c = NULL, .render_threads = 3 };
+    epd_init_with_config(&epd_board_host, &ED060SCT, EPD_LUT_64K, &config);
+    epd_host_capture_reset();
+
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* fb = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    TEST_ASSERT_NOT_NULL(fb);
+    memset(fb, 0xFF, fb_size);
+    epd_fill_rect(test_rect, 0x00, fb);
+
+    // only the rows of the rectangle are looked up
+    bool* drawn_lines = calloc(epd_height(), sizeof(bool));
+    TEST_ASSERT_NOT_NULL(drawn_lines);
+    for (int y = test_rect.y; y < test_rect.y + test_rect.height; y++) {
+        drawn_lines[y] = true;
+    }
+
+    epd_reset_render_stats();
+    enum EpdDrawMode mode = MODE_GL16 | MODE_PACKING_2PPB | PREVIOUSLY_WHITE;
+    enum EpdDrawError err = epd_draw_base(
+        epd_full_screen(), fb, epd_full_screen(), mode, 25, drawn_lines, NULL, &epdiy_ED060SCT
+    );
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, err);
+
+    EpdRenderStats stats;
+    TEST_ASSERT_TRUE(epd_get_render_stats(&stats));
+    uint32_t frames = expected_frame_count(&epdiy_ED060SCT, mode);
+    TEST_ASSERT_EQUAL(frames, stats.frames);
+    TEST_ASSERT_EQUAL(frames, stats.lut_builds + stats.lut_patches + stats.lut_reuses);
+    TEST_ASSERT(stats.max_frame_us <= stats.scan_time_us);
+    TEST_ASSERT_EQUAL(3, stats.num_threads);
+    TEST_ASSERT(stats.queue_low_water >= 1);
+    TEST_ASSERT(stats.queue_high_water >= stats.queue_low_water);
+
+    uint32_t lines = 0, skipped = 0;
+    for (int i = 0; i < stats.num_threads; i++) {
+        const EpdThreadStats* thread = &stats.threads[i];
+        uint32_t histogram_lines = 0;
+        for (int b = 0; b < EPD_STATS_LOOKUP_BUCKETS; b++) {
+            histogram_lines += thread->lookup_us[b];
+        }
+        TEST_ASSERT_EQUAL(thread->lines, histogram_lines);
+        lines += thread->lines;
+        skipped += thread->skipped_lines;
+    }
+    TEST_ASSERT_EQUAL(frames * test_rect.height, lines);
+    TEST_ASSERT(skipped >= frames * (epd_height() - test_rect.height));
+
+    epd_reset_render_stats();
+    TEST_ASSERT_TRUE(epd_get_render_stats(&stats));
+    TEST_ASSERT_EQUAL(0, stats.frames);
+    TEST_ASSERT_EQUAL(0, stats.threads[0].lines);
+    TEST_ASSERT_EQUAL(-1, stats.queue_low_water);
+
+    free(drawn_lines);
+    heap_caps_free(fb);
+    epd_host_capture_reset();
+    epd_deinit();
+}
+#endif
+
+TEST_CASE("render statistics percentiles are histogram bucket bounds", "[epdiy,unit]") {
+    EpdThreadStats thread = { 0 };
+    TEST_ASSERT_EQUAL(-1, epd_render_stats_lookup_percentile(&thread, 50));
+
+    thread.lines = 100;
+    thread.lookup_us[2] = 90;
+    thread.lookup_us[10] = 9;
+    thread.lookup_us[EPD_STATS_LOOKUP_BUCKETS - 1] = 1;
+    TEST_ASSERT_EQUAL(3, epd_render_stats_lookup_percentile(&thread, 50));
+    TEST_ASSERT_EQUAL(3, epd_render_stats_lookup_percentile(&thread, 90));
+    TEST_ASSERT_EQUAL(11, epd_render_stats_lookup_percentile(&thread, 99));
+    TEST_ASSERT_EQUAL(
+        EPD_STATS_LOOKUP_BUCKETS, epd_render_stats_lookup_percentile(&thread, 100)
+    );
+}
+
+/**
+ * Draw `region` alone and return a copy of the recorded frames and their count.
+ */
+static uint8_t* capture_region_draw(
+    const uint8_t* fb, const EpdDrawRegion* region, int** frame_times, int* frame_count
+) {
+    epd_host_capture_reset();
+    EpdDirtyRegions regions = { .count = 1, .rects = { region->area } };
+    enum EpdDrawError err = epd_draw_regions(
+        epd_full_screen(),
+        fb,
+        epd_full_screen(),
+        region->mode,
+        25,
+        NULL,
+        NULL,
+        region->waveform,
+        &regions
+    );
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, err);
+
+    const EpdHostCapture* capture = epd_host_capture();
+    size_t size = (size_t)capture->frame_count * capture->height * capture->line_bytes;
+    uint8_t* frames = malloc(size);
+    *frame_times = malloc(capture->frame_count * sizeof(int));
+    TEST_ASSERT_NOT_NULL(frames);
+    TEST_ASSERT_NOT_NULL(*frame_times);
+    memcpy(frames, capture->frames, size);
+    memcpy(*frame_times, capture->frame_times, capture->frame_count * sizeof(int));
+    *frame_count = capture->frame_count;
+    return frames;
+}
+
+static bool rect_contains(EpdRect r, int x, int y) {
+    return x >= r.x && x < r.x + r.width && y >= r.y && y < r.y + r.height;
+}
+
+/**
+ * Check that a multi-mode draw drives each region like a draw of the region alone.
+ */
+static void check_multi_draw(enum EpdInitOptions options) {
+    epd_init(&epd_board_host, &ED060SCT, options);
+
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* fb = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    TEST_ASSERT_NOT_NULL(fb);
+    for (int i = 0; i < fb_size; i++) {
+        fb[i] = ((i / 7) % 16) * 0x11;
+    }
+
+    // regions share a lookup block, and have a different number of phases
+    const EpdDrawRegion regions[2] = {
+        { .area = { .x = 10, .y = 20, .width = 131, .height = 40 },
+          .mode = MODE_DU | MODE_PACKING_2PPB | PREVIOUSLY_WHITE,
+          .waveform = &epdiy_ED060SCT },
+        { .area = { .x = 141, .y = 40, .width = 250, .height = 60 },
+          .mode = MODE_GL16 | MODE_PACKING_2PPB | PREVIOUSLY_WHITE,
+          .waveform = &epdiy_ED060SCT },
+    };
+
+    int* single_times[2];
+    int single_count[2];
+    uint8_t* single[2];
+    for (int r = 0; r < 2; r++) {
+        single[r] = capture_region_draw(fb, &regions[r], &single_times[r], &single_count[r]);
+    }
+    TEST_ASSERT(single_count[0] < single_count[1]);
+
+    epd_host_capture_reset();
+    epd_reset_render_stats();
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_draw_multi(fb, regions, 2, 25));
+#if EPD_RENDER_STATS
+    // every mode prepares its LUT for each of its frames
+    EpdRenderStats stats;
+    TEST_ASSERT_TRUE(epd_get_render_stats(&stats));
+    TEST_ASSERT_EQUAL(
+        single_count[0] + single_count[1], stats.lut_builds + stats.lut_patches + stats.lut_reuses
+    );
+    // with second LUT buffers, only the first LUT of each mode is built before its frame
+    if (options & EPD_LUT_DOUBLE_BUFFERED) {
+        TEST_ASSERT_EQUAL(2, stats.lut_builds + stats.lut_patches);
+    }
+#endif
+
+    const EpdHostCapture* capture = epd_host_capture();
+    TEST_ASSERT_EQUAL(single_count[1], capture->frame_count);
+    size_t frame_size = (size_t)capture->height * capture->line_bytes;
+    for (int f = 0; f < capture->frame_count; f++) {
+        int expected_time = single_times[1][f];
+        if (f < single_count[0] && single_times[0][f] > expected_time) {
+            expected_time = single_times[0][f];
+        }
+        TEST_ASSERT_EQUAL(expected_time, capture->frame_times[f]);
+
+        for (int y = 0; y < capture->height; y++) {
+            for (int x = 0; x < capture->width; x++) {
+                uint8_t expected = 0;
+                for (int r = 0; r < 2; r++) {
+                    if (rect_contains(regions[r].area, x, y) && f < single_count[r]) {
+                        const uint8_t* line = single[r] + f * frame_size + y * capture->line_bytes;
+                        expected = (line[x / 4] >> (2 * (x % 4))) & 0x3;
+                    }
+                }
+                TEST_ASSERT_EQUAL_UINT8(expected, pixel_action(capture, f, x, y));
+            }
+        }
+    }
+
+    // overlapping regions are rejected
+    EpdDrawRegion overlapping[2] = { regions[0], regions[1] };
+    overlapping[1].area.x = 100;
+    TEST_ASSERT_EQUAL(EPD_DRAW_INVALID_CROP, epd_draw_multi(fb, overlapping, 2, 25));
+
+    for (int r = 0; r < 2; r++) {
+        free(single[r]);
+        free(single_times[r]);
+    }
+    heap_caps_free(fb);
+    epd_host_capture_reset();
+    epd_deinit();
+}
+
+TEST_CASE("multi-mode draws drive each region with its own waveform", "[epdiy,host]") {
+    check_multi_draw(EPD_LUT_64K);
+    check_multi_draw(EPD_LUT_64K | EPD_LUT_DOUBLE_BUFFERED);
+}
+
+TEST_CASE("posted updates join the update in progress", "[epdiy,host]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    EpdiyHighlevelState* hl = white_hl_state();
+    uint8_t* fb = epd_hl_get_framebuffer(hl);
+    int frames = expected_frame_count(&epdiy_ED060SCT, MODE_GL16);
+
+    const EpdRect first = { .x = 32, .y = 32, .width = 200, .height = 100 };
+    const EpdRect second = { .x = 400, .y = 300, .width = 100, .height = 50 };
+    const EpdRect conflicting = { .x = 200, .y = 100, .width = 100, .height = 20 };
+    epd_fill_rect(first, 0x00, fb);
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_hl_post_update(hl, MODE_GL16, 25, first));
+    epd_fill_rect(second, 0x00, fb);
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_hl_post_update(hl, MODE_GL16, 25, second));
+    // queued until the first area is done
+    epd_fill_rect(conflicting, 0x00, fb);
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_hl_post_update(hl, MODE_GL16, 25, conflicting));
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_hl_wait_updates(hl));
+    TEST_ASSERT_EQUAL(0, hl->num_pending);
+
+    // the second area starts while the first one is driven
+    const EpdHostCapture* capture = epd_host_capture();
+    int second_start = -1;
+    for (int f = 0; f < capture->frame_count && second_start < 0; f++) {
+        if (pixel_action(capture, f, second.x, second.y) != 0) {
+            second_start = f;
+        }
+    }
+    TEST_ASSERT(second_start >= 0 && second_start < frames);
+    TEST_ASSERT(capture->frame_count < 3 * frames);
+
+    // the conflicting area starts after the first one is done
+    for (int f = 0; f < frames; f++) {
+        TEST_ASSERT_EQUAL_UINT8(0, pixel_action(capture, f, 260, 110));
+    }
+
+    int full_drive_time = epd_host_full_drive_time(&epdiy_ED060SCT, MODE_GL16, 25);
+    EpdHostSimulation sim
+        = epd_host_simulation_init(epd_width(), epd_height(), full_drive_time, NULL);
+    epd_host_simulate(&sim, capture);
+    TEST_ASSERT_EQUAL(0, epd_host_simulation_max_error(&sim, fb));
+
+    epd_host_simulation_deinit(&sim);
+    epd_host_capture_reset();
+    epd_deinit();
+}
+
+TEST_CASE("posted updates report errors of earlier updates", "[epdiy,host]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    EpdiyHighlevelState* hl = white_hl_state();
+    uint8_t* fb = epd_hl_get_framebuffer(hl);
+
+    const EpdRect first = { .x = 32, .y = 32, .width = 200, .height = 100 };
+    const EpdRect conflicting = { .x = 200, .y = 100, .width = 100, .height = 20 };
+    epd_host_fail_next_draw(EPD_DRAW_EMPTY_LINE_QUEUE);
+    epd_fill_rect(first, 0x00, fb);
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_hl_post_update(hl, MODE_GL16, 25, first));
+    // queued until the failing update is done, which then succeeds
+    epd_fill_rect(conflicting, 0x00, fb);
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_hl_post_update(hl, MODE_GL16, 25, conflicting));
+    TEST_ASSERT_EQUAL(EPD_DRAW_EMPTY_LINE_QUEUE, epd_hl_wait_updates(hl));
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_hl_wait_updates(hl));
+
+    // a pipelined draw reports the errors of the last one until they are read
+    const enum EpdDrawMode mode = MODE_GL16 | MODE_PACKING_2PPB | PREVIOUSLY_WHITE;
+    EpdDirtyRegions regions = { .count = 1, .rects = { first } };
+    epd_host_fail_next_draw(EPD_DRAW_EMPTY_LINE_QUEUE);
+    TEST_ASSERT_EQUAL(
+        EPD_DRAW_SUCCESS, epd_draw_pipelined(fb, mode, 25, &epdiy_ED060SCT, &regions)
+    );
+    regions.rects[0] = conflicting;
+    TEST_ASSERT_EQUAL(
+        EPD_DRAW_SUCCESS, epd_draw_pipelined(fb, mode, 25, &epdiy_ED060SCT, &regions)
+    );
+    TEST_ASSERT_EQUAL(EPD_DRAW_EMPTY_LINE_QUEUE, epd_draw_wait());
+    TEST_ASSERT_EQUAL(
+        EPD_DRAW_SUCCESS, epd_draw_pipelined(fb, mode, 25, &epdiy_ED060SCT, &regions)
+    );
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_draw_wait());
+
+    epd_host_capture_reset();
+    epd_deinit();
+}
+
+TEST_CASE("simulator predicts the drawn image", "[epdiy,host]") {
+    epd_init(&epd_board_host, &ED060SCT, EPD_LUT_64K);
+    EpdiyHighlevelState* hl = white_hl_state();
+
+    uint8_t* fb = epd_hl_get_framebuffer(hl);
+    epd_fill_rect(test_rect, 0x00, fb);
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_hl_update_screen(hl, MODE_GL16, 25));
+
+    int full_drive_time = epd_host_full_drive_time(&epdiy_ED060SCT, MODE_GL16, 25);
+    TEST_ASSERT(full_drive_time > 0);
+    EpdHostSimulation sim
+        = epd_host_simulation_init(epd_width(), epd_height(), full_drive_time, NULL);
+    epd_host_simulate(&sim, epd_host_capture());
+    TEST_ASSERT_EQUAL(0, epd_host_simulation_max_error(&sim, fb));
+
+    for (int y = 0; y < sim.height; y++) {
+        bool in_rows = y >= test_rect.y && y < test_rect.y + test_rect.height;
+        for (int x = 0; x < sim.width; x++) {
+            bool in_rect = in_rows && x >= test_rect.x && x < test_rect.x + test_rect.width;
+            uint32_t energy = sim.energy[y * sim.width + x];
+            TEST_ASSERT(in_rect ? energy >= full_drive_time : energy == 0);
+        }
+    }
+
+    epd_host_simulation_deinit(&sim);
+    epd_host_capture_reset();
+    epd_deinit();
+}
+
+#endif